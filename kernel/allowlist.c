@@ -21,6 +21,8 @@
 #include "allowlist.h"
 #include "manager.h"
 #include "su_mount_ns.h"
+#include "boot_timeline.h"
+#include "status_page.h"
 
 #define FILE_MAGIC 0x7f4b5355 // ' KSU', u32
 #define FILE_FORMAT_VERSION 3 // u32
@@ -265,6 +267,8 @@ out:
 
 out_unlock:
     mutex_unlock(&allowlist_mutex);
+    if (!result)
+        ksu_status_changed();
     return result;
 }
 
@@ -510,6 +514,7 @@ void ksu_load_allow_list()
 exit:
 	ksu_show_allow_list();
 	filp_close(fp, 0);
+	ksu_boot_mark(KSU_BOOT_ALLOWLIST_LOADED);
 }
 
 void ksu_prune_allowlist(bool (*is_uid_valid)(uid_t, char *, void *),
@@ -546,6 +551,7 @@ void ksu_prune_allowlist(bool (*is_uid_valid)(uid_t, char *, void *),
 
     if (modified) {
         smp_mb();
+        ksu_status_changed();
         ksu_persistent_allow_list();
     }
 }
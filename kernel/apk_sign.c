@@ -2,8 +2,16 @@
 #include <linux/fs.h>
 #include <linux/gfp.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
 #ifdef CONFIG_KSU_DEBUG
 #include <linux/moduleparam.h>
 #endif
@@ -18,269 +26,344 @@
 #include "app_profile.h"
 #include "klog.h" // IWYU pragma: keep
 
-struct sdesc {
-	struct shash_desc shash;
-	char ctx[];
-};
+/*
+ * One sha256 tfm for the module's lifetime. Allocating it is the expensive
+ * part and a tfm is safe to share, each digest gets its own descriptor.
+ */
+static struct crypto_shash *sha256_tfm;
+static DEFINE_MUTEX(sha256_tfm_lock);
 
-static struct sdesc *init_sdesc(struct crypto_shash *alg)
+static struct crypto_shash *ksu_sha256_tfm(void)
 {
-	struct sdesc *sdesc;
-	int size;
-
-	size = sizeof(struct shash_desc) + crypto_shash_descsize(alg);
-	sdesc = kzalloc(size, GFP_KERNEL);
-	if (!sdesc)
-		return ERR_PTR(-ENOMEM);
-	sdesc->shash.tfm = alg;
-	return sdesc;
-}
-
-static int calc_hash(struct crypto_shash *alg, const unsigned char *data,
-                     unsigned int datalen, unsigned char *digest)
-{
-	struct sdesc *sdesc;
-	int ret;
-
-	sdesc = init_sdesc(alg);
-	if (IS_ERR(sdesc)) {
-		pr_info("can't alloc sdesc\n");
-		return PTR_ERR(sdesc);
+	struct crypto_shash *tfm = smp_load_acquire(&sha256_tfm);
+
+	if (tfm)
+		return tfm;
+
+	mutex_lock(&sha256_tfm_lock);
+	tfm = sha256_tfm;
+	if (!tfm) {
+		tfm = crypto_alloc_shash("sha256", 0, 0);
+		if (IS_ERR(tfm))
+			pr_info("can't alloc alg sha256\n");
+		else
+			smp_store_release(&sha256_tfm, tfm);
 	}
-
-	ret = crypto_shash_digest(&sdesc->shash, data, datalen, digest);
-	kfree(sdesc);
-	return ret;
+	mutex_unlock(&sha256_tfm_lock);
+	return tfm;
 }
 
 static int ksu_sha256(const unsigned char *data, unsigned int datalen,
                       unsigned char *digest)
 {
-	struct crypto_shash *alg;
-	char *hash_alg_name = "sha256";
+	struct crypto_shash *tfm = ksu_sha256_tfm();
 	int ret;
 
-	alg = crypto_alloc_shash(hash_alg_name, 0, 0);
-	if (IS_ERR(alg)) {
-		pr_info("can't alloc alg %s\n", hash_alg_name);
-		return PTR_ERR(alg);
+	if (IS_ERR(tfm))
+		return PTR_ERR(tfm);
+
+	{
+		SHASH_DESC_ON_STACK(desc, tfm);
+
+		desc->tfm = tfm;
+		ret = crypto_shash_digest(desc, data, datalen, digest);
+		shash_desc_zero(desc);
 	}
-	ret = calc_hash(alg, data, datalen, digest);
-	crypto_free_shash(alg);
 	return ret;
 }
 
-static bool check_block(struct file *fp, u32 *size4, loff_t *pos, u32 *offset,
-                        unsigned expected_size, const char *expected_sha256)
+void ksu_apk_sign_exit(void)
 {
-	kernel_read(fp, size4, 0x4, pos); // signer-sequence length
-	kernel_read(fp, size4, 0x4, pos); // signer length
-	kernel_read(fp, size4, 0x4, pos); // signed data length
+	if (!IS_ERR_OR_NULL(sha256_tfm))
+		crypto_free_shash(sha256_tfm);
+	sha256_tfm = NULL;
+}
 
-	*offset += 0x4 * 3;
+/*
+ * Bounded little-endian readers over an in-memory buffer. Each advances *p
+ * and fails instead of running past end.
+ */
+static bool take_u32(const u8 **p, const u8 *end, u32 *val)
+{
+	if (end - *p < 4)
+		return false;
+	*val = get_unaligned_le32(*p);
+	*p += 4;
+	return true;
+}
 
-	kernel_read(fp, size4, 0x4, pos); // digests-sequence length
+static bool skip_bytes(const u8 **p, const u8 *end, u32 len)
+{
+	if (end - *p < len)
+		return false;
+	*p += len;
+	return true;
+}
 
-	*pos += *size4;
-	*offset += 0x4 + *size4;
+/*
+ * Match the first certificate of the first signer in a v2 block: 1 if it
+ * matches, 0 if not, -errno if it couldn't be hashed.
+ */
+static int check_block(const u8 *p, const u8 *end, unsigned expected_size,
+                        const char *expected_sha256)
+{
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	char hash_str[SHA256_DIGEST_SIZE * 2 + 1];
+	u32 len;
+	int ret;
 
-	kernel_read(fp, size4, 0x4, pos); // certificates length
-	kernel_read(fp, size4, 0x4, pos); // certificate length
-	*offset += 0x4 * 2;
+	if (!take_u32(&p, end, &len) || // signer-sequence length
+	    !take_u32(&p, end, &len) || // signer length
+	    !take_u32(&p, end, &len) || // signed data length
+	    !take_u32(&p, end, &len) || // digests-sequence length
+	    !skip_bytes(&p, end, len) ||
+	    !take_u32(&p, end, &len) || // certificates length
+	    !take_u32(&p, end, &len)) // certificate length
+		return 0;
+
+	if (len != expected_size || end - p < len)
+		return 0;
+
+	ret = ksu_sha256(p, len, digest);
+	if (ret) {
+		pr_info("sha256 error: %d\n", ret);
+		return ret;
+	}
 
-	if (*size4 == expected_size) {
-		*offset += *size4;
+	bin2hex(hash_str, digest, SHA256_DIGEST_SIZE);
+	hash_str[SHA256_DIGEST_SIZE * 2] = '\0';
+	pr_info("sha256: %s, expected: %s\n", hash_str, expected_sha256);
+	return strcmp(expected_sha256, hash_str) == 0;
+}
 
-#define CERT_MAX_LENGTH 1024
-		char cert[CERT_MAX_LENGTH];
-		if (*size4 > CERT_MAX_LENGTH) {
-			pr_info("cert length overlimit\n");
-			return false;
-		}
-		kernel_read(fp, cert, *size4, pos);
-		unsigned char digest[SHA256_DIGEST_SIZE];
-		if (IS_ERR(ksu_sha256(cert, *size4, digest))) {
-			pr_info("sha256 error\n");
-			return false;
-		}
+#define CD_ENTRY_SIZE 46 // fixed part of a central directory file header
+#define CD_ENTRY_MAGIC 0x02014b50u
+#define CD_MAX SZ_8M
 
-		char hash_str[SHA256_DIGEST_SIZE * 2 + 1];
-		hash_str[SHA256_DIGEST_SIZE * 2] = '\0';
+// A short read is an error: the size it is held to came from i_size
+static int read_at(struct file *fp, void *buf, size_t len, loff_t pos)
+{
+	ssize_t ret = kernel_read(fp, buf, len, &pos);
 
-        bin2hex(hash_str, digest, SHA256_DIGEST_SIZE);
-        pr_info("sha256: %s, expected: %s\n", hash_str, expected_sha256);
-        if (strcmp(expected_sha256, hash_str) == 0) {
-            return true;
-        }
-    }
-    return false;
+	if (ret < 0)
+		return ret;
+	return ret == len ? 0 : -EIO;
 }
 
-struct zip_entry_header {
-	uint32_t signature;
-	uint16_t version;
-	uint16_t flags;
-	uint16_t compression;
-	uint16_t mod_time;
-	uint16_t mod_date;
-	uint32_t crc32;
-	uint32_t compressed_size;
-	uint32_t uncompressed_size;
-	uint16_t file_name_length;
-	uint16_t extra_field_length;
-} __attribute__((packed));
-
-// This is a necessary but not sufficient condition, but it is enough for us
-static bool has_v1_signature_file(struct file *fp)
+/*
+ * This is a necessary but not sufficient condition, but it is enough for us.
+ * The central directory lists every entry back to back, so one read of it
+ * answers what used to take a read per local file header. Returns 1 if
+ * it is there, 0 if not, -errno if the directory couldn't be read.
+ */
+static int has_v1_signature_file(struct file *fp, u32 cd_offset, u32 cd_size)
 {
-	struct zip_entry_header header;
 	const char MANIFEST[] = "META-INF/MANIFEST.MF";
-
-	loff_t pos = 0;
-
-    while (kernel_read(fp, &header, sizeof(struct zip_entry_header), &pos) ==
-           sizeof(struct zip_entry_header)) {
-        if (header.signature != 0x04034b50) {
-            // ZIP magic: 'PK'
-            return false;
-        }
-        // Read the entry file name
-        if (header.file_name_length == sizeof(MANIFEST) - 1) {
-            char fileName[sizeof(MANIFEST)];
-            kernel_read(fp, fileName, header.file_name_length, &pos);
-            fileName[header.file_name_length] = '\0';
-
-            // Check if the entry matches META-INF/MANIFEST.MF
-            if (strncmp(MANIFEST, fileName, sizeof(MANIFEST) - 1) == 0) {
-                return true;
-            }
-        } else {
-            // Skip the entry file name
-            pos += header.file_name_length;
-        }
-
-		// Skip to the next entry
-		pos += header.extra_field_length + header.compressed_size;
+	const u8 *p, *end;
+	int found;
+	u8 *cd;
+
+	if (!cd_size || cd_size > CD_MAX)
+		return 0;
+
+	cd = kvmalloc(cd_size, GFP_KERNEL);
+	if (!cd)
+		return -ENOMEM;
+	found = read_at(fp, cd, cd_size, cd_offset);
+	if (found)
+		goto out;
+
+	p = cd;
+	end = cd + cd_size;
+	while (end - p >= CD_ENTRY_SIZE &&
+	       get_unaligned_le32(p) == CD_ENTRY_MAGIC) {
+		u16 name_len = get_unaligned_le16(p + 28);
+		u32 entry_len = CD_ENTRY_SIZE + name_len +
+				get_unaligned_le16(p + 30) + // extra field
+				get_unaligned_le16(p + 32); // comment
+
+		if (end - p < entry_len)
+			break;
+
+		if (name_len == sizeof(MANIFEST) - 1 &&
+		    !memcmp(p + CD_ENTRY_SIZE, MANIFEST, name_len)) {
+			found = 1;
+			break;
+		}
+		p += entry_len;
 	}
 
-	return false;
+out:
+	kvfree(cd);
+	return found;
 }
 
-static __always_inline bool check_v2_signature(char *path,
-                                               unsigned expected_size,
-                                               const char *expected_sha256)
+#define EOCD_SIZE 22
+#define EOCD_MAGIC 0x06054b50u
+#define EOCD_COMMENT_MAX 0xffff
+#define SIG_BLOCK_FOOTER 24 // size of block, then the magic
+#define SIG_BLOCK_MAX SZ_4M
+
+// https://en.wikipedia.org/wiki/Zip_(file_format)#End_of_central_directory_record_(EOCD)
+static long find_eocd(const u8 *tail, size_t tail_len)
 {
-	unsigned char buffer[0x11] = { 0 };
-	u32 size4;
-	u64 size8, size_of_block;
+	u32 i;
+
+	for (i = 0; i <= EOCD_COMMENT_MAX && EOCD_SIZE + i <= tail_len; i++) {
+		const u8 *eocd = tail + tail_len - EOCD_SIZE - i;
 
-	loff_t pos;
+		if (get_unaligned_le16(eocd + 20) == i &&
+		    get_unaligned_le32(eocd) == EOCD_MAGIC)
+			return eocd - tail;
+	}
+	return -1;
+}
 
-	bool v2_signing_valid = false;
+/*
+ * The file is read twice: once for the tail that can hold the EOCD, once
+ * for the whole signing block in front of the central directory. Both are
+ * then parsed from memory.
+ *
+ * Returns 1 for a v2-only APK signed with the expected certificate, 0 for
+ * anything else that was read in full, -errno if reading or hashing it
+ * failed. Only 0 holds for good, the errors may go away on the next try.
+ */
+static __always_inline int check_v2_signature(char *path,
+                                              unsigned expected_size,
+                                              const char *expected_sha256)
+{
+	u8 footer[SIG_BLOCK_FOOTER];
+	u8 *buf = NULL;
+	const u8 *p, *end;
+	size_t tail_len;
+	loff_t size;
+	long eocd;
+	u32 cd_offset, cd_size;
+	u64 block_size;
+	int ret = 0, v1;
+
+	int v2_signing_valid = 0;
 	int v2_signing_blocks = 0;
 	bool v3_signing_exist = false;
 	bool v3_1_signing_exist = false;
 
-	int i;
 	struct file *fp = filp_open(path, O_RDONLY, 0);
 	if (IS_ERR(fp)) {
 		pr_err("open %s error.\n", path);
-		return false;
+		return PTR_ERR(fp);
 	}
 
 	// disable inotify for this file
 	fp->f_mode |= FMODE_NONOTIFY;
 
-	// https://en.wikipedia.org/wiki/Zip_(file_format)#End_of_central_directory_record_(EOCD)
-	for (i = 0;; ++i) {
-		unsigned short n;
-		pos = generic_file_llseek(fp, -i - 2, SEEK_END);
-		kernel_read(fp, &n, 2, &pos);
-		if (n == i) {
-			pos -= 22;
-			kernel_read(fp, &size4, 4, &pos);
-			if ((size4 ^ 0xcafebabeu) == 0xccfbf1eeu) {
-				break;
-			}
-		}
-		if (i == 0xffff) {
-			pr_info("error: cannot find eocd\n");
-			goto clean;
-		}
-	}
+	size = i_size_read(file_inode(fp));
+	if (size < EOCD_SIZE)
+		goto clean;
 
-	pos += 12;
-	// offset
-	kernel_read(fp, &size4, 0x4, &pos);
-	pos = size4 - 0x18;
+	tail_len = min_t(loff_t, size, EOCD_SIZE + EOCD_COMMENT_MAX);
+	buf = kvmalloc(tail_len, GFP_KERNEL);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto clean;
+	}
+	ret = read_at(fp, buf, tail_len, size - tail_len);
+	if (ret)
+		goto clean;
 
-	kernel_read(fp, &size8, 0x8, &pos);
-	kernel_read(fp, buffer, 0x10, &pos);
-	if (strcmp((char *)buffer, "APK Sig Block 42")) {
+	eocd = find_eocd(buf, tail_len);
+	if (eocd < 0) {
+		pr_info("error: cannot find eocd\n");
 		goto clean;
 	}
+	cd_size = get_unaligned_le32(buf + eocd + 12);
+	cd_offset = get_unaligned_le32(buf + eocd + 16);
+	kvfree(buf);
+	buf = NULL;
 
-	pos = size4 - (size8 + 0x8);
-	kernel_read(fp, &size_of_block, 0x8, &pos);
-	if (size_of_block != size8) {
+	if (cd_offset < SIG_BLOCK_FOOTER || (u64)cd_offset + cd_size > size)
+		goto clean;
+	ret = read_at(fp, footer, sizeof(footer), cd_offset - SIG_BLOCK_FOOTER);
+	if (ret)
+		goto clean;
+	if (memcmp(footer + 8, "APK Sig Block 42", 16))
+		goto clean;
+
+	// block_size counts everything after its own leading copy
+	block_size = get_unaligned_le64(footer);
+	if (block_size < SIG_BLOCK_FOOTER || block_size > SIG_BLOCK_MAX ||
+	    block_size + 8 > cd_offset)
+		goto clean;
+
+	buf = kvmalloc(block_size + 8, GFP_KERNEL);
+	if (!buf) {
+		ret = -ENOMEM;
 		goto clean;
 	}
+	ret = read_at(fp, buf, block_size + 8, cd_offset - (block_size + 8));
+	if (ret)
+		goto clean;
+	if (get_unaligned_le64(buf) != block_size)
+		goto clean;
 
-    int loop_count = 0;
-    while (loop_count++ < 10) {
-        uint32_t id;
-        uint32_t offset;
-        kernel_read(fp, &size8, 0x8,
-                    &pos); // sequence length
-        if (size8 == size_of_block) {
-            break;
-        }
-        kernel_read(fp, &id, 0x4, &pos); // id
-        offset = 4;
-        if (id == 0x7109871au) {
-            v2_signing_blocks++;
-            v2_signing_valid = check_block(fp, &size4, &pos, &offset,
-                                           expected_size, expected_sha256);
-        } else if (id == 0xf05368c0u) {
-            // http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#73
-            v3_signing_exist = true;
-        } else if (id == 0x1b93ad61u) {
-            // http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#74
-            v3_1_signing_exist = true;
-        } else {
+	// id-value pairs sit between the two size fields
+	p = buf + 8;
+	end = buf + block_size + 8 - SIG_BLOCK_FOOTER;
+	while (end - p >= 12) {
+		u64 len = get_unaligned_le64(p);
+		u32 id;
+
+		p += 8;
+		if (len < 4 || len > end - p)
+			break;
+		id = get_unaligned_le32(p);
+
+		if (id == 0x7109871au) {
+			v2_signing_blocks++;
+			v2_signing_valid = check_block(p + 4, p + len,
+						       expected_size,
+						       expected_sha256);
+		} else if (id == 0xf05368c0u) {
+			// http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#73
+			v3_signing_exist = true;
+		} else if (id == 0x1b93ad61u) {
+			// http://aospxref.com/android-14.0.0_r2/xref/frameworks/base/core/java/android/util/apk/ApkSignatureSchemeV3Verifier.java#74
+			v3_1_signing_exist = true;
+		} else {
 #ifdef CONFIG_KSU_DEBUG
 			pr_info("Unknown id: 0x%08x\n", id);
 #endif
 		}
-		pos += (size8 - offset);
+		p += len;
 	}
 
 	if (v2_signing_blocks != 1) {
 #ifdef CONFIG_KSU_DEBUG
         pr_err("Unexpected v2 signature count: %d\n", v2_signing_blocks);
 #endif
-		v2_signing_valid = false;
+		v2_signing_valid = 0;
 	}
 
-	if (v2_signing_valid) {
-		int has_v1_signing = has_v1_signature_file(fp);
-		if (has_v1_signing) {
+	if (v2_signing_valid > 0) {
+		v1 = has_v1_signature_file(fp, cd_offset, cd_size);
+		if (v1 < 0) {
+			ret = v1;
+		} else if (v1) {
 			pr_err("Unexpected v1 signature scheme found!\n");
-			filp_close(fp, 0);
-			return false;
+			v2_signing_valid = 0;
 		}
 	}
 clean:
+	kvfree(buf);
 	filp_close(fp, 0);
 
 	if (v3_signing_exist || v3_1_signing_exist) {
 #ifdef CONFIG_KSU_DEBUG
 		pr_err("Unexpected v3 signature scheme found!\n");
 #endif
-		return false;
+		return 0;
 	}
 
-	return v2_signing_valid;
+	return ret ?: v2_signing_valid;
 }
 
 #ifdef CONFIG_KSU_DEBUG
@@ -346,18 +429,18 @@ int get_pkg_from_apk_path(char *pkg, const char *path)
 	return 0;
 }
 
-bool is_manager_apk(char *path)
+int is_manager_apk(char *path)
 {
 #ifdef KSU_MANAGER_PACKAGE
 	char pkg[KSU_MAX_PACKAGE_NAME];
 	if (get_pkg_from_apk_path(pkg, path) < 0) {
 		pr_err("Failed to get package name from apk path: %s\n", path);
-		return false;
+		return 0;
 	}
 
 	// pkg is `<real package>`
 	if (strncmp(pkg, KSU_MANAGER_PACKAGE, sizeof(KSU_MANAGER_PACKAGE))) {
-		return false;
+		return 0;
 	}
 #endif
 	return check_v2_signature(path, EXPECTED_MANAGER_SIZE, EXPECTED_MANAGER_HASH);
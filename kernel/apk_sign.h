@@ -3,7 +3,14 @@
 
 #include <linux/types.h>
 
-bool is_manager_apk(char *path);
+/*
+ * 1 if @path is the manager's APK, 0 if it is not, -errno if that couldn't
+ * be told because reading or hashing it failed.
+ */
+int is_manager_apk(char *path);
 int get_pkg_from_apk_path(char *pkg, const char *path);
 
+// Drop the cached sha256 tfm
+void ksu_apk_sign_exit(void);
+
 #endif
@@ -0,0 +1,29 @@
+#include <linux/atomic.h>
+#include <linux/kernel.h>
+#include <linux/timekeeping.h>
+
+#include "boot_timeline.h"
+
+static atomic64_t boot_marks[KSU_BOOT_MARK_MAX];
+
+void ksu_boot_mark(enum ksu_boot_mark mark)
+{
+	u64 now;
+
+	if (mark >= KSU_BOOT_MARK_MAX)
+		return;
+
+	now = ktime_to_ns(ktime_get_boottime());
+	atomic64_cmpxchg(&boot_marks[mark], 0, now);
+}
+
+u32 ksu_boot_timeline_read(u64 *stamps, u32 count)
+{
+	u32 i;
+
+	count = min_t(u32, count, KSU_BOOT_MARK_MAX);
+	for (i = 0; i < count; i++)
+		stamps[i] = atomic64_read(&boot_marks[i]);
+
+	return count;
+}
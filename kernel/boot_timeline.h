@@ -0,0 +1,25 @@
+#ifndef __KSU_H_BOOT_TIMELINE
+#define __KSU_H_BOOT_TIMELINE
+
+#include <linux/types.h>
+
+// Keep in sync with ksud's debug boot-timeline labels
+enum ksu_boot_mark {
+	KSU_BOOT_MODULE_INIT = 0,
+	KSU_BOOT_INIT_RC_HOOKED = 1,
+	KSU_BOOT_FIRST_ZYGOTE = 2,
+	KSU_BOOT_POST_FS_DATA = 3,
+	KSU_BOOT_ALLOWLIST_LOADED = 4,
+	KSU_BOOT_MODULE_MOUNTED = 5,
+	KSU_BOOT_BOOT_COMPLETED = 6,
+	KSU_BOOT_MANAGER_CROWNED = 7,
+	KSU_BOOT_MARK_MAX,
+};
+
+// Record CLOCK_BOOTTIME for @mark, only the first call per mark sticks
+void ksu_boot_mark(enum ksu_boot_mark mark);
+
+// Copy up to @count stamps in ns (0 = not reached yet), returns the number copied
+u32 ksu_boot_timeline_read(u64 *stamps, u32 count);
+
+#endif
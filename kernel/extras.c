@@ -96,13 +96,9 @@ int ksu_handle_slow_avc_audit(u32 *tsid)
 }
 
 #ifdef CONFIG_KPROBES
-#include <linux/kprobes.h>
-#include <linux/slab.h>
 #include "arch.h"
-static struct kprobe *slow_avc_audit_kp;
-//	.symbol_name = "slow_avc_audit",
-//	.pre_handler = slow_avc_audit_pre_handler,
-static int slow_avc_audit_pre_handler(struct kprobe *p, struct pt_regs *regs)
+#include "hook_backend.h"
+static int slow_avc_audit_pre_handler(struct pt_regs *regs, void *data)
 {
 	if (atomic_read(&disable_spoof))
 		return 0;
@@ -128,42 +124,19 @@ static int slow_avc_audit_pre_handler(struct kprobe *p, struct pt_regs *regs)
 	return 0;
 }
 
-// copied from upstream
-static struct kprobe *init_kprobe(const char *name,
-				  kprobe_pre_handler_t handler)
-{
-	struct kprobe *kp = kzalloc(sizeof(struct kprobe), GFP_KERNEL);
-	if (!kp)
-		return NULL;
-	kp->symbol_name = name;
-	kp->pre_handler = handler;
-
-	int ret = register_kprobe(kp);
-	pr_info("sucompat: register_%s kprobe: %d\n", name, ret);
-	if (ret) {
-		kfree(kp);
-		return NULL;
-	}
-
-	return kp;
-}
-static void destroy_kprobe(struct kprobe **kp_ptr)
-{
-	struct kprobe *kp = *kp_ptr;
-	if (!kp)
-		return;
-	unregister_kprobe(kp);
-	synchronize_rcu();
-	kfree(kp);
-	*kp_ptr = NULL;
-}
+// tsid is rewritten in place, keep this one on kprobe
+static struct ksu_hook slow_avc_audit_hook = {
+	.symbol = "slow_avc_audit",
+	.entry = slow_avc_audit_pre_handler,
+	.flags = KSU_HOOK_WRITES_REGS,
+};
 #endif // CONFIG_KPROBES
 
 void ksu_avc_spoof_disable(void)
 {
 #ifdef CONFIG_KPROBES
-	pr_info("avc_spoof/exit: unregister slow_avc_audit kprobe!\n");
-	destroy_kprobe(&slow_avc_audit_kp);
+	pr_info("avc_spoof/exit: unregister slow_avc_audit hook!\n");
+	ksu_hook_unregister(&slow_avc_audit_hook);
 #endif
 	atomic_set(&disable_spoof, 1);
 	pr_info("avc_spoof/exit: slow_avc_audit spoofing disabled!\n");
@@ -178,8 +151,8 @@ void ksu_avc_spoof_enable(void)
 	}
 
 #ifdef CONFIG_KPROBES
-	pr_info("avc_spoof/init: register slow_avc_audit kprobe!\n");
-	slow_avc_audit_kp = init_kprobe("slow_avc_audit", slow_avc_audit_pre_handler);
+	ret = ksu_hook_register(&slow_avc_audit_hook);
+	pr_info("avc_spoof/init: register slow_avc_audit hook: %d\n", ret);
 #endif	
 	// once we get the sids, we can now enable the hook handler
 	atomic_set(&disable_spoof, 0);
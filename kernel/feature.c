@@ -1,24 +1,91 @@
 #include "feature.h"
 #include "klog.h" // IWYU pragma: keep
+#include "status_page.h"
 
 #include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+
+/*
+ * Registered handlers, sorted by feature_id. Feature ids are sparse (custom
+ * extensions start at 10000), so this is a small sorted array rather than a
+ * table indexed by id. Writers copy it and publish the copy with RCU, so
+ * readers never take feature_mutex.
+ */
+struct feature_table {
+	struct rcu_head rcu;
+	u32 count;
+	const struct ksu_feature_handler *handlers[];
+};
+
+static struct feature_table __rcu *feature_table;
+
+// serializes table updates and set_handler calls
+static DEFINE_MUTEX(feature_mutex);
 
-static const struct ksu_feature_handler *feature_handlers[KSU_FEATURE_MAX];
+// Index of @feature_id in @table, or -(insert position) - 1 if absent
+static int feature_index(const struct feature_table *table, u32 feature_id)
+{
+	int lo = 0, hi = table ? table->count : 0;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		u32 id = table->handlers[mid]->feature_id;
+
+		if (id == feature_id)
+			return mid;
+		if (id < feature_id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-static DEFINE_MUTEX(feature_mutex);
+	return -lo - 1;
+}
+
+static const struct ksu_feature_handler *
+feature_lookup(const struct feature_table *table, u32 feature_id)
+{
+	int i = feature_index(table, feature_id);
+
+	return i >= 0 ? table->handlers[i] : NULL;
+}
+
+static struct feature_table *feature_table_locked(void)
+{
+	return rcu_dereference_protected(feature_table,
+					 lockdep_is_held(&feature_mutex));
+}
+
+static struct feature_table *feature_table_alloc(u32 count)
+{
+	struct feature_table *table;
+
+	table = kzalloc(struct_size(table, handlers, count), GFP_KERNEL);
+	if (table)
+		table->count = count;
+	return table;
+}
+
+static void feature_table_publish(struct feature_table *old,
+				  struct feature_table *new)
+{
+	rcu_assign_pointer(feature_table, new);
+	if (old)
+		kfree_rcu(old, rcu);
+}
 
 int ksu_register_feature_handler(const struct ksu_feature_handler *handler)
 {
+	struct feature_table *old, *new;
+	u32 count;
+	int i;
+
 	if (!handler) {
 		pr_err("feature: register handler is NULL\n");
 		return -EINVAL;
 	}
 
-	if (handler->feature_id >= KSU_FEATURE_MAX) {
-		pr_err("feature: invalid feature_id %u\n", handler->feature_id);
-		return -EINVAL;
-	}
-
     if (!handler->get_handler && !handler->set_handler) {
         pr_err("feature: no handler provided for feature %u\n",
                handler->feature_id);
@@ -27,43 +94,81 @@ int ksu_register_feature_handler(const struct ksu_feature_handler *handler)
 
 	mutex_lock(&feature_mutex);
 
-	if (feature_handlers[handler->feature_id]) {
+	old = feature_table_locked();
+	count = old ? old->count : 0;
+	i = feature_index(old, handler->feature_id);
+
+	if (i >= 0) {
 		pr_warn("feature: handler for %u already registered, overwriting\n",
 		handler->feature_id);
+		new = feature_table_alloc(count);
+		if (!new)
+			goto nomem;
+		memcpy(new->handlers, old->handlers, count * sizeof(*new->handlers));
+	} else {
+		i = -i - 1;
+		new = feature_table_alloc(count + 1);
+		if (!new)
+			goto nomem;
+		if (old) {
+			memcpy(new->handlers, old->handlers,
+			       i * sizeof(*new->handlers));
+			memcpy(new->handlers + i + 1, old->handlers + i,
+			       (count - i) * sizeof(*new->handlers));
+		}
 	}
 
-	feature_handlers[handler->feature_id] = handler;
+	new->handlers[i] = handler;
+	feature_table_publish(old, new);
 
 	pr_info("feature: registered handler for %s (id=%u)\n",
 		handler->name ? handler->name : "unknown", handler->feature_id);
 
 	mutex_unlock(&feature_mutex);
+	ksu_status_changed();
 	return 0;
+
+nomem:
+	mutex_unlock(&feature_mutex);
+	return -ENOMEM;
 }
 
 int ksu_unregister_feature_handler(u32 feature_id)
 {
+	struct feature_table *old, *new = NULL;
 	int ret = 0;
-
-	if (feature_id >= KSU_FEATURE_MAX) {
-		pr_err("feature: invalid feature_id %u\n", feature_id);
-		return -EINVAL;
-	}
+	int i;
 
 	mutex_lock(&feature_mutex);
 
-	if (!feature_handlers[feature_id]) {
+	old = feature_table_locked();
+	i = feature_index(old, feature_id);
+
+	if (i < 0) {
 		pr_warn("feature: no handler registered for %u\n", feature_id);
 		ret = -ENOENT;
 		goto out;
 	}
 
-	feature_handlers[feature_id] = NULL;
+	if (old->count > 1) {
+		new = feature_table_alloc(old->count - 1);
+		if (!new) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		memcpy(new->handlers, old->handlers, i * sizeof(*new->handlers));
+		memcpy(new->handlers + i, old->handlers + i + 1,
+		       (old->count - i - 1) * sizeof(*new->handlers));
+	}
+
+	feature_table_publish(old, new);
 
 	pr_info("feature: unregistered handler for id=%u\n", feature_id);
 
 out:
 	mutex_unlock(&feature_mutex);
+	if (!ret)
+		ksu_status_changed();
 	return ret;
 }
 
@@ -72,19 +177,14 @@ int ksu_get_feature(u32 feature_id, u64 *value, bool *supported)
 	int ret = 0;
 	const struct ksu_feature_handler *handler;
 
-	if (feature_id >= KSU_FEATURE_MAX) {
-		pr_err("feature: invalid feature_id %u\n", feature_id);
-		return -EINVAL;
-	}
-
 	if (!value || !supported) {
 		pr_err("feature: invalid parameters\n");
 		return -EINVAL;
 	}
 
-	mutex_lock(&feature_mutex);
+	rcu_read_lock();
 
-	handler = feature_handlers[feature_id];
+	handler = feature_lookup(rcu_dereference(feature_table), feature_id);
 
 	if (!handler) {
 		*supported = false;
@@ -107,23 +207,44 @@ int ksu_get_feature(u32 feature_id, u64 *value, bool *supported)
 	}
 
 out:
-	mutex_unlock(&feature_mutex);
+	rcu_read_unlock();
 	return ret;
 }
 
+u32 ksu_get_all_features(struct ksu_feature_value *out, u32 max)
+{
+	const struct feature_table *table;
+	u32 i, n = 0;
+
+	rcu_read_lock();
+
+	table = rcu_dereference(feature_table);
+	for (i = 0; table && i < table->count; i++) {
+		const struct ksu_feature_handler *handler = table->handlers[i];
+		u64 value;
+
+		if (!handler->get_handler || handler->get_handler(&value))
+			continue;
+
+		if (n < max) {
+			out[n].id = handler->feature_id;
+			out[n].value = value;
+		}
+		n++;
+	}
+
+	rcu_read_unlock();
+	return n;
+}
+
 int ksu_set_feature(u32 feature_id, u64 value)
 {
 	int ret = 0;
 	const struct ksu_feature_handler *handler;
 
-	if (feature_id >= KSU_FEATURE_MAX) {
-		pr_err("feature: invalid feature_id %u\n", feature_id);
-		return -EINVAL;
-	}
-
 	mutex_lock(&feature_mutex);
 
-	handler = feature_handlers[feature_id];
+	handler = feature_lookup(feature_table_locked(), feature_id);
 
 	if (!handler) {
 		pr_err("feature: feature %u not registered\n", feature_id);
@@ -144,29 +265,23 @@ int ksu_set_feature(u32 feature_id, u64 value)
 
 out:
 	mutex_unlock(&feature_mutex);
+	if (!ret)
+		ksu_status_changed();
 	return ret;
 }
 
 void ksu_feature_init(void)
 {
-	int i;
-
-	for (i = 0; i < KSU_FEATURE_MAX; i++) {
-		feature_handlers[i] = NULL;
-	}
+	RCU_INIT_POINTER(feature_table, NULL);
 
 	pr_info("feature: feature management initialized\n");
 }
 
 void ksu_feature_exit(void)
 {
-	int i;
-
 	mutex_lock(&feature_mutex);
 
-	for (i = 0; i < KSU_FEATURE_MAX; i++) {
-		feature_handlers[i] = NULL;
-	}
+	feature_table_publish(feature_table_locked(), NULL);
 
 	mutex_unlock(&feature_mutex);
 
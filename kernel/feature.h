@@ -13,6 +13,7 @@ enum ksu_feature_id {
     KSU_FEATURE_MAX
 };
 
+// Called under rcu_read_lock(), must not sleep
 typedef int (*ksu_feature_get_t)(u64 *value);
 typedef int (*ksu_feature_set_t)(u64 value);
 
@@ -31,6 +32,14 @@ int ksu_get_feature(u32 feature_id, u64 *value, bool *supported);
 
 int ksu_set_feature(u32 feature_id, u64 value);
 
+struct ksu_feature_value {
+	u32 id;
+	u64 value;
+};
+
+// Fill @out with up to @max supported features, returns how many there are
+u32 ksu_get_all_features(struct ksu_feature_value *out, u32 max);
+
 void ksu_feature_init(void);
 
 void ksu_feature_exit(void);
@@ -0,0 +1,317 @@
+#include <linux/atomic.h>
+#include <linux/compiler.h>
+#include <linux/kprobes.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/version.h>
+
+#include "hook_backend.h"
+#include "klog.h" // IWYU pragma: keep
+#include "status_page.h"
+
+// 0: auto (fprobe if possible), 1: force kprobe, 2: prefer fprobe
+static int hook_backend_pref = KSU_HOOK_BACKEND_NONE;
+module_param_named(hook_backend, hook_backend_pref, int, 0);
+
+static atomic_t kprobe_hooks = ATOMIC_INIT(0);
+static atomic_t fprobe_hooks = ATOMIC_INIT(0);
+
+static const char *hook_name(const struct ksu_hook *hook)
+{
+	return hook->symbol ? hook->symbol : "<addr>";
+}
+
+static int kprobe_entry_wrapper(struct kprobe *p, struct pt_regs *regs)
+{
+	struct ksu_hook *hook = container_of(p, struct ksu_hook, kp);
+
+	hook->entry(regs, NULL);
+	return 0;
+}
+
+#ifdef CONFIG_KRETPROBES
+static struct kretprobe *ksu_get_kretprobe(struct kretprobe_instance *ri)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+	return get_kretprobe(ri);
+#else
+	return ri->rp;
+#endif
+}
+
+static int kretprobe_entry_wrapper(struct kretprobe_instance *ri,
+				   struct pt_regs *regs)
+{
+	struct ksu_hook *hook =
+		container_of(ksu_get_kretprobe(ri), struct ksu_hook, rp);
+
+	return hook->entry(regs, ri->data);
+}
+
+static int kretprobe_exit_wrapper(struct kretprobe_instance *ri,
+				  struct pt_regs *regs)
+{
+	struct ksu_hook *hook =
+		container_of(ksu_get_kretprobe(ri), struct ksu_hook, rp);
+
+	hook->exit(regs, ri->data);
+	return 0;
+}
+#endif
+
+static int register_kprobe_backend(struct ksu_hook *hook)
+{
+	int ret;
+
+	if (hook->exit) {
+#ifdef CONFIG_KRETPROBES
+		hook->rp.kp.symbol_name = hook->addr ? NULL : hook->symbol;
+		hook->rp.kp.addr = hook->addr;
+		hook->rp.entry_handler = hook->entry ? kretprobe_entry_wrapper :
+						       NULL;
+		hook->rp.handler = kretprobe_exit_wrapper;
+		hook->rp.data_size = hook->data_size;
+		hook->rp.maxactive = 0;
+		ret = register_kretprobe(&hook->rp);
+#else
+		ret = -EOPNOTSUPP;
+#endif
+	} else {
+		hook->kp.symbol_name = hook->addr ? NULL : hook->symbol;
+		hook->kp.addr = hook->addr;
+		hook->kp.pre_handler = kprobe_entry_wrapper;
+		ret = register_kprobe(&hook->kp);
+	}
+
+	return ret;
+}
+
+#ifdef KSU_HAVE_FPROBE
+#ifdef KSU_FPROBE_FTRACE_REGS
+/*
+ * Hooks are written against pt_regs. Where ftrace_regs isn't one (arm64)
+ * the argument and return registers are copied into one on the stack, and
+ * only those are valid; writes to it go nowhere, which KSU_HOOK_WRITES_REGS
+ * hooks never get here for.
+ */
+static int fprobe_entry_wrapper(struct fprobe *fp, unsigned long entry_ip,
+				unsigned long ret_ip, struct ftrace_regs *fregs,
+				void *entry_data)
+{
+	struct ksu_hook *hook = container_of(fp, struct ksu_hook, fp);
+	struct pt_regs regs;
+
+	return hook->entry(ftrace_partial_regs(fregs, &regs), entry_data);
+}
+
+static void fprobe_exit_wrapper(struct fprobe *fp, unsigned long entry_ip,
+				unsigned long ret_ip, struct ftrace_regs *fregs,
+				void *entry_data)
+{
+	struct ksu_hook *hook = container_of(fp, struct ksu_hook, fp);
+	struct pt_regs regs;
+
+	hook->exit(ftrace_partial_regs(fregs, &regs), entry_data);
+}
+#else
+static int fprobe_entry_wrapper(struct fprobe *fp, unsigned long entry_ip,
+				unsigned long ret_ip, struct pt_regs *regs,
+				void *entry_data)
+{
+	struct ksu_hook *hook = container_of(fp, struct ksu_hook, fp);
+
+	return hook->entry(regs, entry_data);
+}
+
+static void fprobe_exit_wrapper(struct fprobe *fp, unsigned long entry_ip,
+				unsigned long ret_ip, struct pt_regs *regs,
+				void *entry_data)
+{
+	struct ksu_hook *hook = container_of(fp, struct ksu_hook, fp);
+
+	hook->exit(regs, entry_data);
+}
+#endif
+
+static int register_fprobe_backend(struct ksu_hook *hook)
+{
+	unsigned long addr = (unsigned long)hook->addr;
+
+	hook->fp.entry_handler = hook->entry ? fprobe_entry_wrapper : NULL;
+	hook->fp.exit_handler = hook->exit ? fprobe_exit_wrapper : NULL;
+	hook->fp.entry_data_size = hook->data_size;
+
+	if (addr)
+		return register_fprobe_ips(&hook->fp, &addr, 1);
+	return register_fprobe(&hook->fp, hook->symbol, NULL);
+}
+#endif
+
+static int __ksu_hook_register(struct ksu_hook *hook,
+			       enum ksu_hook_backend pref)
+{
+	int ret = -EOPNOTSUPP;
+
+	if (ksu_hook_registered(hook))
+		return -EBUSY;
+
+	// probes refuse to register twice, start from a clean slate
+	memset(&hook->kp, 0, sizeof(*hook) - offsetof(struct ksu_hook, kp));
+
+#ifdef KSU_HAVE_FPROBE
+	if (pref != KSU_HOOK_BACKEND_KPROBE &&
+	    !(hook->flags & KSU_HOOK_WRITES_REGS)) {
+		ret = register_fprobe_backend(hook);
+		if (!ret) {
+			hook->backend = KSU_HOOK_BACKEND_FPROBE;
+			atomic_inc(&fprobe_hooks);
+			pr_info("hook: %s attached via fprobe\n", hook_name(hook));
+			return 0;
+		}
+		pr_info("hook: fprobe %s failed: %d, fallback to kprobe\n",
+			hook_name(hook), ret);
+		memset(&hook->fp, 0, sizeof(hook->fp));
+	}
+#endif
+
+	if (pref == KSU_HOOK_BACKEND_FPROBE && ret == -EOPNOTSUPP)
+		pr_info("hook: fprobe unavailable for %s\n", hook_name(hook));
+
+	ret = register_kprobe_backend(hook);
+	if (ret) {
+		pr_err("hook: kprobe %s failed: %d\n", hook_name(hook), ret);
+		return ret;
+	}
+
+	hook->backend = KSU_HOOK_BACKEND_KPROBE;
+	atomic_inc(&kprobe_hooks);
+	pr_info("hook: %s attached via kprobe\n", hook_name(hook));
+	return 0;
+}
+
+int ksu_hook_register(struct ksu_hook *hook)
+{
+	int ret = __ksu_hook_register(hook, hook_backend_pref);
+
+	if (!ret)
+		ksu_status_changed(); // hook mode may have changed
+	return ret;
+}
+
+void ksu_hook_unregister(struct ksu_hook *hook)
+{
+	switch (hook->backend) {
+	case KSU_HOOK_BACKEND_KPROBE:
+		if (hook->exit) {
+#ifdef CONFIG_KRETPROBES
+			unregister_kretprobe(&hook->rp);
+#endif
+		} else {
+			unregister_kprobe(&hook->kp);
+		}
+		atomic_dec(&kprobe_hooks);
+		break;
+#ifdef KSU_HAVE_FPROBE
+	case KSU_HOOK_BACKEND_FPROBE:
+		unregister_fprobe(&hook->fp);
+		atomic_dec(&fprobe_hooks);
+		break;
+#endif
+	default:
+		return;
+	}
+
+	hook->backend = KSU_HOOK_BACKEND_NONE;
+	ksu_status_changed();
+}
+
+const char *ksu_hook_mode_name(void)
+{
+	int kprobes = atomic_read(&kprobe_hooks);
+	int fprobes = atomic_read(&fprobe_hooks);
+
+	if (fprobes && kprobes)
+		return "Fprobe+Kprobes";
+	if (fprobes)
+		return "Fprobe";
+	return "Kprobes";
+}
+
+// Benchmark: time a trivial probed function under each backend
+
+#define KSU_HOOK_BENCH_DEFAULT_ITERS 100000
+#define KSU_HOOK_BENCH_MAX_ITERS 10000000
+
+static DEFINE_MUTEX(bench_lock);
+
+static noinline int ksu_hook_bench_target(int v)
+{
+	asm volatile("" : "+r"(v));
+	return v;
+}
+
+static int ksu_hook_bench_entry(struct pt_regs *regs, void *data)
+{
+	return 0;
+}
+
+static struct ksu_hook bench_hook = {
+	.entry = ksu_hook_bench_entry,
+};
+
+static u64 bench_loop(u32 iterations)
+{
+	u64 start = ktime_get_ns();
+	u32 i;
+
+	for (i = 0; i < iterations; i++) {
+		ksu_hook_bench_target(i);
+		// up to 10M calls that may each trap, don't hog the CPU
+		if (!(i & 0xfff))
+			cond_resched();
+	}
+
+	return ktime_get_ns() - start;
+}
+
+static u64 bench_backend(enum ksu_hook_backend backend, u32 iterations)
+{
+	u64 ns;
+
+	bench_hook.addr = (void *)ksu_hook_bench_target;
+	if (__ksu_hook_register(&bench_hook, backend))
+		return 0;
+
+	// fprobe falls back to kprobe silently, don't report it twice
+	if (bench_hook.backend != backend) {
+		ksu_hook_unregister(&bench_hook);
+		return 0;
+	}
+
+	ns = bench_loop(iterations);
+	ksu_hook_unregister(&bench_hook);
+	return ns;
+}
+
+int ksu_hook_benchmark(u32 iterations, struct ksu_hook_bench_result *res)
+{
+	if (!iterations)
+		iterations = KSU_HOOK_BENCH_DEFAULT_ITERS;
+	if (iterations > KSU_HOOK_BENCH_MAX_ITERS)
+		return -EINVAL;
+
+	mutex_lock(&bench_lock);
+	res->iterations = iterations;
+	res->baseline_ns = bench_loop(iterations);
+	res->kprobe_ns = bench_backend(KSU_HOOK_BACKEND_KPROBE, iterations);
+	res->fprobe_ns = bench_backend(KSU_HOOK_BACKEND_FPROBE, iterations);
+	mutex_unlock(&bench_lock);
+
+	pr_info("hook: bench %u calls: baseline %llu ns, kprobe %llu ns, fprobe %llu ns\n",
+		iterations, res->baseline_ns, res->kprobe_ns, res->fprobe_ns);
+	return 0;
+}
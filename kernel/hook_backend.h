@@ -0,0 +1,78 @@
+#ifndef __KSU_H_HOOK_BACKEND
+#define __KSU_H_HOOK_BACKEND
+
+#include <linux/types.h>
+#include <linux/version.h>
+#include <linux/kprobes.h>
+#include <linux/ptrace.h>
+
+/*
+ * fprobe attaches through the ftrace trampoline instead of a breakpoint,
+ * so a hit costs a call instead of a trap. Handlers take pt_regs from 6.5
+ * (int entry) and ftrace_regs from 6.14. Before 6.14 FPROBE depends on
+ * DYNAMIC_FTRACE_WITH_REGS, which arm64 replaced with WITH_ARGS in 6.2, so
+ * arm64 kernels, every GKI up to 6.12 included, only get fprobe from 6.14.
+ */
+#if defined(CONFIG_FPROBE) && LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+#define KSU_HAVE_FPROBE
+#include <linux/fprobe.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0)
+#define KSU_FPROBE_FTRACE_REGS
+#endif
+#endif
+
+enum ksu_hook_backend {
+	KSU_HOOK_BACKEND_NONE = 0,
+	KSU_HOOK_BACKEND_KPROBE = 1,
+	KSU_HOOK_BACKEND_FPROBE = 2,
+};
+
+// Handler writes argument registers, which only a kprobe reliably applies
+#define KSU_HOOK_WRITES_REGS (1 << 0)
+
+// Return non-zero from entry to skip the exit handler of a return hook
+typedef int (*ksu_hook_entry_t)(struct pt_regs *regs, void *data);
+typedef void (*ksu_hook_exit_t)(struct pt_regs *regs, void *data);
+
+struct ksu_hook {
+	const char *symbol;
+	void *addr; // used instead of symbol when set
+	ksu_hook_entry_t entry;
+	ksu_hook_exit_t exit; // optional, makes this a return hook
+	size_t data_size; // per-call scratch passed to entry/exit
+	unsigned int flags; // KSU_HOOK_*
+
+	/* private */
+	enum ksu_hook_backend backend;
+	union {
+		struct kprobe kp;
+		struct kretprobe rp;
+#ifdef KSU_HAVE_FPROBE
+		struct fprobe fp;
+#endif
+	};
+};
+
+// Attach hook with the best available backend, falling back to kprobe
+int ksu_hook_register(struct ksu_hook *hook);
+void ksu_hook_unregister(struct ksu_hook *hook);
+
+static inline bool ksu_hook_registered(const struct ksu_hook *hook)
+{
+	return hook->backend != KSU_HOOK_BACKEND_NONE;
+}
+
+// Summary of the backends currently attached, for KSU_IOCTL_GET_HOOK_MODE
+const char *ksu_hook_mode_name(void);
+
+struct ksu_hook_bench_result {
+	u32 iterations;
+	u64 baseline_ns;
+	u64 kprobe_ns;
+	u64 fprobe_ns;
+};
+
+// Time @iterations calls of a probed function under each backend
+int ksu_hook_benchmark(u32 iterations, struct ksu_hook_bench_result *res);
+
+#endif
@@ -1,5 +1,8 @@
 #include <linux/sched.h>
+#include <linux/atomic.h>
+#include <linux/bitops.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/slab.h>
 #include <linux/task_work.h>
 #include <linux/cred.h>
@@ -9,7 +12,15 @@
 #include <linux/nsproxy.h>
 #include <linux/path.h>
 #include <linux/printk.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/rcupdate.h>
+#include <linux/refcount.h>
+#include <linux/sort.h>
+#include <linux/stringhash.h>
 #include <linux/types.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
 
 
 #include "kernel_umount.h"
@@ -19,6 +30,7 @@
 #include "feature.h"
 #include "ksud.h"
 #include "ksu.h"
+#include "supercalls.h"
 
 static bool ksu_kernel_umount_enabled = true;
 
@@ -53,21 +65,582 @@ static void ksu_umount_mnt(struct path *path, int flags)
 	}
 }
 
-static void try_umount(const char *mnt, int flags)
+/*
+ * The try-umount list. Writers build a fresh copy under umount_list_mutex
+ * and publish it with RCU; readers take a reference instead of a lock, so
+ * the umount task_work can sleep in kern_path() while holding it. A copy
+ * is a single allocation: the targets, their walk order, the template
+ * plan, then every path back to back in target order.
+ *
+ * After each change a kworker resolves the targets (so lookups happen in
+ * init's mount namespace) and republishes the same entries sorted deepest
+ * first, so a parent is never detached before its children. The s_dev
+ * found at that point only orders targets of equal depth: whatever is
+ * mounted at a listed path when an app is forked is unmounted, even if a
+ * module remounted it since or the kworker's namespace saw something else.
+ * Apps run in their own copy of that namespace, so the vfsmounts
+ * themselves can't be reused.
+ */
+struct umount_target {
+	const char *path;
+	u32 hash;
+	unsigned int flags;
+	unsigned int depth; // path components, for ordering
+	dev_t dev; // s_dev of the mount when resolved, 0 if it wasn't mounted
+};
+
+/*
+ * Template mode: the first zygote child of a list generation walks every
+ * target and records which ones were actually mounted in its namespace.
+ * Later children are forked from the same zygote namespace, so they replay
+ * only those targets and skip the lookups for the rest. A generation ends
+ * whenever modules are mounted or the list changes, which publishes a new
+ * copy and starts a fresh recording. Off by default because a mount made
+ * behind ksud's back in between isn't seen until the next generation.
+ */
+static bool umount_template;
+module_param(umount_template, bool, 0);
+
+enum umount_plan_state {
+	UMOUNT_PLAN_NONE,
+	UMOUNT_PLAN_RECORDING,
+	UMOUNT_PLAN_READY,
+};
+
+struct umount_list {
+	struct rcu_head rcu;
+	refcount_t ref;
+	unsigned int gen;
+	bool resolved;
+	unsigned int count, max;
+	size_t paths_len, paths_max;
+	atomic_t plan_state; // enum umount_plan_state
+	unsigned int *order; // walk order, indices into targets
+	unsigned long *plan; // walk positions found mounted by the recording child
+	char *paths;
+	struct umount_target targets[];
+};
+
+static struct umount_list __rcu *umount_list;
+static unsigned int umount_list_gen;
+
+// serializes writers, readers only take a reference
+static DEFINE_MUTEX(umount_list_mutex);
+
+static unsigned int path_depth(const char *path)
 {
-	struct path path;
-	int err = kern_path(mnt, 0, &path);
-	if (err) {
-		return;
+	unsigned int depth = 0;
+	bool in_name = false;
+
+	for (; *path; path++) {
+		if (*path == '/') {
+			in_name = false;
+		} else if (!in_name) {
+			in_name = true;
+			depth++;
+		}
+	}
+
+	return depth;
+}
+
+static void umount_target_init(struct umount_target *t, const char *path,
+			       unsigned int flags)
+{
+	t->path = path;
+	t->hash = full_name_hash(NULL, path, strlen(path));
+	t->flags = flags;
+	t->depth = path_depth(path);
+	t->dev = 0;
+}
+
+static bool umount_target_same(const struct umount_target *a,
+			       const struct umount_target *b)
+{
+	return a->hash == b->hash && !strcmp(a->path, b->path);
+}
+
+static struct umount_list *umount_list_alloc(unsigned int max,
+					     size_t paths_max)
+{
+	struct umount_list *list;
+	size_t order_off, plan_off, paths_off;
+
+	order_off = struct_size(list, targets, max);
+	plan_off = ALIGN(order_off + max * sizeof(*list->order), sizeof(long));
+	paths_off = plan_off + BITS_TO_LONGS(max) * sizeof(long);
+
+	list = kvzalloc(paths_off + paths_max, GFP_KERNEL);
+	if (!list)
+		return NULL;
+
+	refcount_set(&list->ref, 1);
+	list->max = max;
+	list->paths_max = paths_max;
+	list->order = (void *)list + order_off;
+	list->plan = (void *)list + plan_off;
+	list->paths = (char *)list + paths_off;
+	return list;
+}
+
+// Append a copy of @src, the caller sized @list for it
+static struct umount_target *umount_list_push(struct umount_list *list,
+					      const struct umount_target *src)
+{
+	struct umount_target *t = &list->targets[list->count];
+	size_t len = strlen(src->path) + 1;
+
+	*t = *src;
+	t->path = memcpy(list->paths + list->paths_len, src->path, len);
+	t->dev = 0;
+	list->paths_len += len;
+	list->order[list->count] = list->count;
+	list->count++;
+
+	return t;
+}
+
+static void umount_list_free_rcu(struct rcu_head *rcu)
+{
+	kvfree(container_of(rcu, struct umount_list, rcu));
+}
+
+static void umount_list_put(struct umount_list *list)
+{
+	// module exit's rcu_barrier() waits for the last of these
+	if (list && refcount_dec_and_test(&list->ref))
+		call_rcu(&list->rcu, umount_list_free_rcu);
+}
+
+static struct umount_list *umount_list_get(void)
+{
+	struct umount_list *list;
+
+	rcu_read_lock();
+	do {
+		// a zero count means a newer copy is already published
+		list = rcu_dereference(umount_list);
+	} while (list && !refcount_inc_not_zero(&list->ref));
+	rcu_read_unlock();
+
+	return list;
+}
+
+static struct umount_list *umount_list_locked(void)
+{
+	return rcu_dereference_protected(umount_list,
+					 lockdep_is_held(&umount_list_mutex));
+}
+
+static int umount_target_cmp(const void *a, const void *b)
+{
+	const struct umount_target *ta = *(const struct umount_target **)a;
+	const struct umount_target *tb = *(const struct umount_target **)b;
+
+	// deepest first, then the ones that were mounted when resolved
+	if (ta->depth != tb->depth)
+		return ta->depth > tb->depth ? -1 : 1;
+	if (!ta->dev != !tb->dev)
+		return ta->dev ? -1 : 1;
+	return 0;
+}
+
+static void umount_list_resolve(struct work_struct *work)
+{
+	struct umount_list *list, *resolved = NULL;
+	struct umount_target **sorted = NULL;
+	unsigned int i;
+
+	list = umount_list_get();
+	if (!list || list->resolved)
+		goto out;
+
+	resolved = umount_list_alloc(list->count, list->paths_len);
+	sorted = kmalloc_array(list->count, sizeof(*sorted), GFP_KERNEL);
+	if (!resolved || !sorted)
+		goto out;
+
+	// lookups may sleep on slow filesystems, nothing is locked here
+	for (i = 0; i < list->count; i++) {
+		struct umount_target *t;
+		struct path path;
+
+		t = umount_list_push(resolved, &list->targets[i]);
+		sorted[i] = t;
+		if (kern_path(t->path, 0, &path))
+			continue;
+		if (path.dentry == path.mnt->mnt_root)
+			t->dev = path.mnt->mnt_sb->s_dev;
+		path_put(&path);
+	}
+
+	sort(sorted, list->count, sizeof(*sorted), umount_target_cmp, NULL);
+	for (i = 0; i < list->count; i++)
+		resolved->order[i] = sorted[i] - resolved->targets;
+	resolved->gen = list->gen;
+	resolved->resolved = true;
+
+	mutex_lock(&umount_list_mutex);
+	// a writer got in first, its own resolve is already queued
+	if (umount_list_locked() == list) {
+		rcu_assign_pointer(umount_list, resolved);
+		umount_list_put(list); // the published reference
+		pr_info("umount list: resolved %u entries, gen %u\n",
+			list->count, list->gen);
+		resolved = NULL;
+	}
+	mutex_unlock(&umount_list_mutex);
+
+out:
+	kfree(sorted);
+	umount_list_put(resolved);
+	umount_list_put(list);
+}
+
+static DECLARE_WORK(umount_resolve_work, umount_list_resolve);
+
+// Swap in @list as a new generation, call with umount_list_mutex held
+static void umount_list_publish(struct umount_list *list)
+{
+	struct umount_list *old = umount_list_locked();
+
+	if (list && !list->count) {
+		umount_list_put(list);
+		list = NULL;
+	}
+
+	if (list)
+		list->gen = ++umount_list_gen;
+	rcu_assign_pointer(umount_list, list);
+	umount_list_put(old);
+
+	if (list)
+		schedule_work(&umount_resolve_work);
+}
+
+int ksu_umount_list_add(const char *path, unsigned int flags)
+{
+	struct umount_list *old, *new;
+	struct umount_target t;
+	unsigned int i, count = 0;
+	size_t paths_len = 0;
+	int ret = 0;
+
+	umount_target_init(&t, path, flags);
+
+	mutex_lock(&umount_list_mutex);
+
+	old = umount_list_locked();
+	if (old) {
+		for (i = 0; i < old->count; i++) {
+			if (umount_target_same(&old->targets[i], &t)) {
+				ret = -EEXIST;
+				goto out;
+			}
+		}
+		count = old->count;
+		paths_len = old->paths_len;
+	}
+
+	new = umount_list_alloc(count + 1, paths_len + strlen(path) + 1);
+	if (!new) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	// newest first
+	umount_list_push(new, &t);
+	for (i = 0; i < count; i++)
+		umount_list_push(new, &old->targets[i]);
+	umount_list_publish(new);
+
+out:
+	mutex_unlock(&umount_list_mutex);
+	return ret;
+}
+
+int ksu_umount_list_del(const char *path)
+{
+	struct umount_list *old, *new;
+	struct umount_target t;
+	unsigned int i;
+	int ret = 0;
+
+	umount_target_init(&t, path, 0);
+
+	mutex_lock(&umount_list_mutex);
+
+	old = umount_list_locked();
+	if (!old)
+		goto out;
+
+	new = umount_list_alloc(old->count, old->paths_len);
+	if (!new) {
+		ret = -ENOMEM;
+		goto out;
 	}
 
+	for (i = 0; i < old->count; i++) {
+		if (!umount_target_same(&old->targets[i], &t))
+			umount_list_push(new, &old->targets[i]);
+	}
+
+	if (new->count == old->count)
+		umount_list_put(new);
+	else
+		umount_list_publish(new);
+
+out:
+	mutex_unlock(&umount_list_mutex);
+	return ret;
+}
+
+void ksu_umount_list_wipe(void)
+{
+	mutex_lock(&umount_list_mutex);
+	umount_list_publish(NULL);
+	mutex_unlock(&umount_list_mutex);
+}
+
+int ksu_umount_list_replace(const void *buf, size_t size)
+{
+	const char *records = buf;
+	struct ksu_umount_record rec;
+	struct umount_list *new = NULL;
+	unsigned int *slots = NULL;
+	unsigned int count = 0, dupes = 0, nslots = 0;
+	size_t off, paths_len = 0;
+	int ret = 0;
+
+	// validate and size everything before touching the live list
+	for (off = 0; off < size; off += sizeof(rec) + rec.len) {
+		if (size - off < sizeof(rec))
+			return -EINVAL;
+
+		memcpy(&rec, records + off, sizeof(rec));
+		if (rec.len < 2 || rec.len > KSU_UMOUNT_PATH_MAX ||
+		    rec.len > size - off - sizeof(rec))
+			return -EINVAL;
+
+		// exactly one NUL, at the end
+		if (strnlen(records + off + sizeof(rec), rec.len) != rec.len - 1)
+			return -EINVAL;
+
+		count++;
+		paths_len += rec.len;
+	}
+
+	if (count) {
+		nslots = roundup_pow_of_two(count * 2);
+		slots = kvcalloc(nslots, sizeof(*slots), GFP_KERNEL);
+		new = umount_list_alloc(count, paths_len);
+		if (!slots || !new) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	for (off = 0; off < size; off += sizeof(rec) + rec.len) {
+		struct umount_target t;
+		unsigned int slot;
+
+		memcpy(&rec, records + off, sizeof(rec));
+		umount_target_init(&t, records + off + sizeof(rec), rec.flags);
+
+		// open addressing on the path hash, slots hold index + 1
+		for (slot = t.hash & (nslots - 1); slots[slot];
+		     slot = (slot + 1) & (nslots - 1)) {
+			if (umount_target_same(&new->targets[slots[slot] - 1],
+					       &t))
+				break;
+		}
+
+		// first record wins
+		if (slots[slot]) {
+			dupes++;
+			continue;
+		}
+
+		slots[slot] = new->count + 1;
+		umount_list_push(new, &t);
+	}
+
+	mutex_lock(&umount_list_mutex);
+	umount_list_publish(new);
+	mutex_unlock(&umount_list_mutex);
+	new = NULL;
+
+	pr_info("umount list: replaced with %u entries, %u duplicates dropped\n",
+		count - dupes, dupes);
+
+out:
+	kvfree(slots);
+	umount_list_put(new);
+	return ret;
+}
+
+void ksu_umount_list_invalidate(void)
+{
+	struct umount_list *old, *new;
+	unsigned int i;
+
+	mutex_lock(&umount_list_mutex);
+
+	old = umount_list_locked();
+	if (!old)
+		goto out;
+
+	// same entries, but the old resolve and plan are stale now
+	new = umount_list_alloc(old->count, old->paths_len);
+	if (!new) {
+		// keep the copy, but never replay its plan again
+		atomic_set(&old->plan_state, UMOUNT_PLAN_RECORDING);
+		goto out;
+	}
+
+	for (i = 0; i < old->count; i++)
+		umount_list_push(new, &old->targets[i]);
+	umount_list_publish(new);
+
+out:
+	mutex_unlock(&umount_list_mutex);
+}
+
+size_t ksu_umount_list_paths_len(void)
+{
+	struct umount_list *list = umount_list_get();
+	size_t len = list ? list->paths_len : 0;
+
+	umount_list_put(list);
+	return len;
+}
+
+int ksu_umount_list_copy_paths(char __user *buf)
+{
+	struct umount_list *list = umount_list_get();
+	int ret = 0;
+
+	if (list && copy_to_user(buf, list->paths, list->paths_len))
+		ret = -EFAULT;
+
+	umount_list_put(list);
+	return ret;
+}
+
+int ksu_umount_list_snapshot(void __user *buf, u32 size)
+{
+	struct umount_list *list = umount_list_get();
+	struct ksu_umount_snapshot hdr = { .total_len = sizeof(hdr) };
+	char __user *out = buf;
+	unsigned int i;
+	int ret = 0;
+
+	if (size < sizeof(hdr)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (list) {
+		hdr.count = list->count;
+		hdr.total_len += list->count * sizeof(struct ksu_umount_record) +
+				 list->paths_len;
+	}
+
+	if (copy_to_user(out, &hdr, sizeof(hdr))) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	// the header alone tells the caller how much to allocate
+	if (hdr.total_len > size) {
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	out += sizeof(hdr);
+	for (i = 0; i < hdr.count; i++) {
+		const struct umount_target *t = &list->targets[i];
+		struct ksu_umount_record rec = {
+			.flags = t->flags,
+			.len = strlen(t->path) + 1,
+		};
+
+		if (copy_to_user(out, &rec, sizeof(rec)) ||
+		    copy_to_user(out + sizeof(rec), t->path, rec.len)) {
+			ret = -EFAULT;
+			goto out;
+		}
+		out += sizeof(rec) + rec.len;
+	}
+
+out:
+	umount_list_put(list);
+	return ret;
+}
+
+// Returns true if @t was mounted here, whether or not the umount worked
+static bool try_umount_target(const struct umount_target *t)
+{
+	struct path path;
+
+	if (kern_path(t->path, 0, &path))
+		return false;
+
 	if (path.dentry != path.mnt->mnt_root) {
-		// it is not root mountpoint, maybe umounted by others already.
+		// not a mount root, nothing is mounted there
 		path_put(&path);
+		return false;
+	}
+
+	ksu_umount_mnt(&path, t->flags);
+	return true;
+}
+
+static void umount_walk(const struct umount_list *list)
+{
+	unsigned int i;
+
+	for (i = 0; i < list->count; i++) {
+		const struct umount_target *t = &list->targets[list->order[i]];
+
+		if (!list->resolved)
+			pr_info("%s: unmounting: %s flags 0x%x\n", __func__,
+				t->path, t->flags);
+		try_umount_target(t);
+	}
+}
+
+static void umount_resolved(struct umount_list *list)
+{
+	unsigned int i;
+
+	if (!umount_template) {
+		umount_walk(list);
 		return;
 	}
 
-    ksu_umount_mnt(&path, flags);
+	switch (atomic_read_acquire(&list->plan_state)) {
+	case UMOUNT_PLAN_READY:
+		for_each_set_bit (i, list->plan, list->count)
+			try_umount_target(&list->targets[list->order[i]]);
+		return;
+	case UMOUNT_PLAN_NONE:
+		if (atomic_cmpxchg(&list->plan_state, UMOUNT_PLAN_NONE,
+				   UMOUNT_PLAN_RECORDING) != UMOUNT_PLAN_NONE)
+			break;
+		for (i = 0; i < list->count; i++) {
+			if (try_umount_target(&list->targets[list->order[i]]))
+				set_bit(i, list->plan);
+		}
+		atomic_set_release(&list->plan_state, UMOUNT_PLAN_READY);
+		pr_info("umount template: gen %u recorded %u of %u targets\n",
+			list->gen, bitmap_weight(list->plan, list->count),
+			list->count);
+		return;
+	}
+
+	// another child is still recording, do the full walk
+	umount_walk(list);
 }
 
 struct umount_tw {
@@ -79,14 +652,16 @@ static void umount_tw_func(struct callback_head *cb)
 	struct umount_tw *tw = container_of(cb, struct umount_tw, cb);
 	const struct cred *saved = override_creds(ksu_cred);
 
-    struct mount_entry *entry;
-    down_read(&mount_list_lock);
-    list_for_each_entry (entry, &mount_list, list) {
-        pr_info("%s: unmounting: %s flags 0x%x\n", __func__, entry->umountable,
-                entry->flags);
-        try_umount(entry->umountable, entry->flags);
-    }
-    up_read(&mount_list_lock);
+	struct umount_list *list = umount_list_get();
+
+	if (list) {
+		// not resolved yet, the walk is in list order then
+		if (list->resolved)
+			umount_resolved(list);
+		else
+			umount_walk(list);
+		umount_list_put(list);
+	}
 
 	revert_creds(saved);
 
@@ -163,8 +738,9 @@ int ksu_handle_umount(uid_t old_uid, uid_t new_uid)
 
 void ksu_umount_all(void)
 {
-	struct mount_entry *entry;
+	struct umount_list *list;
 	const struct cred *saved;
+	unsigned int i;
 
 	if (!ksu_module_mounted) {
 		pr_info("ksu_umount_all: no modules mounted, skip\n");
@@ -179,13 +755,15 @@ void ksu_umount_all(void)
 	saved = override_creds(ksu_cred);
 
 	/* Step 1: unmount paths from the registered mount list */
-	down_read(&mount_list_lock);
-	list_for_each_entry(entry, &mount_list, list) {
-		pr_info("ksu_umount_all: list: %s flags 0x%x\n",
-			entry->umountable, entry->flags);
-		try_umount(entry->umountable, entry->flags);
+	list = umount_list_get();
+	for (i = 0; list && i < list->count; i++) {
+		const struct umount_target *t = &list->targets[list->order[i]];
+
+		pr_info("ksu_umount_all: list: %s flags 0x%x\n", t->path,
+			t->flags);
+		try_umount_target(t);
 	}
-	up_read(&mount_list_lock);
+	umount_list_put(list);
 
 	/* Third-party module mounts (Zygisk, LSPosed, MoveCertificate, etc.)
 	 * are handled by the Manager App's user-space cleanup script. */
@@ -206,4 +784,7 @@ void ksu_kernel_umount_init(void)
 void ksu_kernel_umount_exit(void)
 {
 	ksu_unregister_feature_handler(KSU_FEATURE_KERNEL_UMOUNT);
+
+	cancel_work_sync(&umount_resolve_work);
+	ksu_umount_list_wipe();
 }
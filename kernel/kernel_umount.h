@@ -2,8 +2,6 @@
 #define __KSU_H_KERNEL_UMOUNT
 
 #include <linux/types.h>
-#include <linux/list.h>
-#include <linux/rwsem.h>
 
 void ksu_kernel_umount_init(void);
 void ksu_kernel_umount_exit(void);
@@ -14,13 +12,22 @@ int ksu_handle_umount(uid_t old_uid, uid_t new_uid);
 // Unmount all module mounts globally (called during module exit)
 void ksu_umount_all(void);
 
-// for the umount list
-struct mount_entry {
-    char *umountable;
-    unsigned int flags;
-    struct list_head list;
-};
-extern struct list_head mount_list;
-extern struct rw_semaphore mount_list_lock;
+// The try-umount list. Writers publish a new copy, readers never block them
+int ksu_umount_list_add(const char *path, unsigned int flags);
+int ksu_umount_list_del(const char *path);
+void ksu_umount_list_wipe(void);
+
+// Swap the whole list for the packed ksu_umount_record stream in @buf
+int ksu_umount_list_replace(const void *buf, size_t size);
+
+// Size of every path with its NUL, and those paths copied back to back
+size_t ksu_umount_list_paths_len(void);
+int ksu_umount_list_copy_paths(char __user *buf);
+
+// Header and records of one consistent copy, -ENOSPC if @size is too small
+int ksu_umount_list_snapshot(void __user *buf, u32 size);
+
+// Mounts changed behind the list, e.g. modules just got mounted
+void ksu_umount_list_invalidate(void);
 
 #endif
@@ -9,6 +9,7 @@
 #include <linux/sched/signal.h>
 
 #include "allowlist.h"
+#include "apk_sign.h"
 #include "app_profile.h"
 #include "feature.h"
 #include "klog.h" // IWYU pragma: keep
@@ -20,6 +21,8 @@
 #include "file_wrapper.h"
 #include "kernel_umount.h"
 #include "selinux/selinux.h"
+#include "boot_timeline.h"
+#include "status_page.h"
 
 struct cred *ksu_cred;
 
@@ -35,6 +38,8 @@ int __init kernelsu_init(void)
 	pr_alert("*************************************************************");
 #endif
 
+	ksu_boot_mark(KSU_BOOT_MODULE_INIT);
+
     ksu_cred = prepare_creds();
     if (!ksu_cred) {
         pr_err("prepare cred failed!\n");
@@ -44,6 +49,8 @@ int __init kernelsu_init(void)
 
 	ksu_feature_init();
 
+	ksu_status_init();
+
 	ksu_supercalls_init();
 
 	ksu_syscall_hook_manager_init();
@@ -134,10 +141,15 @@ void kernelsu_exit(void)
 #endif
 #endif
 
+	// stop publishing before the state behind the page is torn down
+	ksu_status_exit();
+
 	ksu_allowlist_exit();
 
 	ksu_throne_tracker_exit();
 
+	ksu_apk_sign_exit();
+
 	ksu_observer_exit();
 
 	ksu_ksud_exit();
@@ -9,7 +9,7 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/version.h>
-#include <linux/input-event-codes.h>
+#include <linux/input.h>
 #include <linux/kprobes.h>
 #include <linux/printk.h>
 #include <linux/types.h>
@@ -19,6 +19,7 @@
 #include <linux/uio.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
 
 #include "manager.h"
 #include "allowlist.h"
@@ -28,6 +29,10 @@
 #include "util.h"
 #include "selinux/selinux.h"
 #include "throne_tracker.h"
+#include "hook_backend.h"
+#include "boot_timeline.h"
+#include "status_page.h"
+#include "kernel_umount.h"
 
 bool ksu_module_mounted __read_mostly = false;
 bool ksu_boot_completed __read_mostly = false;
@@ -60,17 +65,53 @@ static void stop_init_rc_hook();
 static void stop_execve_hook();
 static void stop_input_hook();
 
-static struct work_struct stop_init_rc_hook_work;
-static struct work_struct stop_execve_hook_work;
-static struct work_struct stop_input_hook_work;
+/*
+ * Each boot hook is disarmed by its own event (init.rc hooked, first zygote,
+ * post-fs-data). The same delayed work is queued at init with a deadline so
+ * a hook whose event never comes doesn't stay armed for the whole uptime.
+ */
+static struct delayed_work stop_init_rc_hook_work;
+static struct delayed_work stop_execve_hook_work;
+static struct delayed_work stop_input_hook_work;
+
+static unsigned int boot_hook_timeout = 300; // seconds, 0 disables
+module_param(boot_hook_timeout, uint, 0);
 
-/* Mutex-guarded kprobe registration state to prevent double-unregister
- * between async work items and module exit */
+/*
+ * How many times each boot hook fired, logged when it is disarmed.
+ * Per-cpu since sys_read fires on every read() in the system.
+ */
+enum boot_hook_id {
+	BOOT_HOOK_EXECVE,
+	BOOT_HOOK_SYS_READ,
+	BOOT_HOOK_SYS_FSTAT,
+	BOOT_HOOK_INPUT_EVENT,
+	BOOT_HOOK_MAX,
+};
+
+static const char *const boot_hook_names[BOOT_HOOK_MAX] = {
+	"execve", "sys_read", "sys_fstat", "input_event",
+};
+
+static DEFINE_PER_CPU(unsigned long[BOOT_HOOK_MAX], boot_hook_hits);
+
+static inline void boot_hook_hit(enum boot_hook_id id)
+{
+	this_cpu_inc(boot_hook_hits[id]);
+}
+
+static unsigned long boot_hook_hits_sum(enum boot_hook_id id)
+{
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu (cpu)
+		sum += per_cpu(boot_hook_hits, cpu)[id];
+	return sum;
+}
+
+/* Serializes hook unregistration between async work items and module exit */
 static DEFINE_MUTEX(kp_lock);
-static bool execve_kp_registered;
-static bool sys_read_kp_registered;
-static bool sys_fstat_kp_registered;
-static bool input_event_kp_registered;
 
 void on_post_fs_data(void)
 {
@@ -81,8 +122,10 @@ void on_post_fs_data(void)
 	}
 	done = true;
 	pr_info("on_post_fs_data!\n");
+	ksu_boot_mark(KSU_BOOT_POST_FS_DATA);
 
 	ksu_load_allow_list();
+	ksu_throne_tracker_load_cache();
 	ksu_observer_init();
 	// sanity check, this may influence the performance
 	stop_input_hook();
@@ -115,6 +158,8 @@ void on_module_mounted(void)
 {
 	pr_info("on_module_mounted!\n");
 	ksu_module_mounted = true;
+	ksu_boot_mark(KSU_BOOT_MODULE_MOUNTED);
+	ksu_umount_list_invalidate();
 }
 
 extern void ksu_avc_spoof_late_init();
@@ -122,6 +167,7 @@ void on_boot_completed(void)
 {
     ksu_boot_completed = true;
     pr_info("on_boot_completed!\n");
+    ksu_boot_mark(KSU_BOOT_BOOT_COMPLETED);
     track_throne(true);
     ksu_avc_spoof_late_init();
 }
@@ -271,6 +317,7 @@ int ksu_handle_execveat_ksud(int *fd, struct filename **filename_ptr,
 		if (check_argv(*argv, 1, "-Xzygote", buf, sizeof(buf))) {
 			pr_info("exec zygote, /data prepared, second_stage: %d\n",
 				init_second_stage_executed);
+			ksu_boot_mark(KSU_BOOT_FIRST_ZYGOTE);
 			rcu_read_lock();
 			struct task_struct *init_task =
 				rcu_dereference(current->real_parent);
@@ -377,6 +424,12 @@ append_ksu_rc:
 	return ret;
 }
 
+// Cheap filter so the hot read/fstat hooks skip fget() for everyone but init
+static inline bool maybe_init_task(void)
+{
+	return current->tgid == 1 && !strcmp(current->comm, "init");
+}
+
 static bool is_init_rc(struct file *fp)
 {
 	if (strcmp(current->comm, "init")) {
@@ -409,7 +462,12 @@ static bool is_init_rc(struct file *fp)
 
 static void ksu_handle_sys_read(unsigned int fd)
 {
-	struct file *file = fget(fd);
+	struct file *file;
+
+	if (!maybe_init_task())
+		return;
+
+	file = fget(fd);
 	if (!file) {
 		return;
 	}
@@ -426,6 +484,7 @@ static void ksu_handle_sys_read(unsigned int fd)
 		goto skip;
 	}
 	rc_hooked = true;
+	ksu_boot_mark(KSU_BOOT_INIT_RC_HOOKED);
 
 	// now we can sure that the init process is reading
 	// `/system/etc/init/init.rc`
@@ -461,27 +520,100 @@ static bool is_volumedown_enough(unsigned int count)
 	return count >= 3;
 }
 
-int ksu_handle_input_handle_event(unsigned int *type, unsigned int *code,
-					int *value)
+/*
+ * Safe mode detection: an input handler bound only to devices that can emit
+ * KEY_VOLUMEDOWN, so touch and sensor events never reach us. It is
+ * unregistered from stop_input_hook_work once the window closes.
+ */
+static void ksu_input_event(struct input_handle *handle, unsigned int type,
+			    unsigned int code, int value)
 {
-	if (*type == EV_KEY && *code == KEY_VOLUMEDOWN) {
-		int val = *value;
-		pr_info("KEY_VOLUMEDOWN val: %d\n", val);
-		if (val) {
-			// key pressed, count it
-			volumedown_pressed_count += 1;
-			if (is_volumedown_enough(volumedown_pressed_count)) {
-				stop_input_hook();
-			}
+	boot_hook_hit(BOOT_HOOK_INPUT_EVENT);
+
+	if (type != EV_KEY || code != KEY_VOLUMEDOWN)
+		return;
+
+	pr_info("KEY_VOLUMEDOWN val: %d\n", value);
+	if (value) {
+		// key pressed, count it
+		volumedown_pressed_count += 1;
+		if (is_volumedown_enough(volumedown_pressed_count)) {
+			stop_input_hook();
+			ksu_status_changed();
 		}
 	}
+}
 
+static int ksu_input_connect(struct input_handler *handler,
+			     struct input_dev *dev,
+			     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int ret;
+
+	handle = kzalloc(sizeof(*handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "ksu_safemode";
+
+	ret = input_register_handle(handle);
+	if (ret)
+		goto err_free;
+
+	ret = input_open_device(handle);
+	if (ret)
+		goto err_unregister;
+
+	pr_info("safemode: watching %s\n", dev->name ? dev->name : "input");
 	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return ret;
+}
+
+static void ksu_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id ksu_input_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+		.keybit = { [BIT_WORD(KEY_VOLUMEDOWN)] =
+				    BIT_MASK(KEY_VOLUMEDOWN) },
+	},
+	{},
+};
+
+static struct input_handler ksu_input_handler = {
+	.event = ksu_input_event,
+	.connect = ksu_input_connect,
+	.disconnect = ksu_input_disconnect,
+	.name = "ksu_safemode",
+	.id_table = ksu_input_ids,
+};
+
+static bool input_handler_registered;
+
+static bool safe_mode = false;
+
+bool ksu_peek_safe_mode(void)
+{
+	return safe_mode || is_volumedown_enough(volumedown_pressed_count);
 }
 
 bool ksu_is_safe_mode()
 {
-	static bool safe_mode = false;
 	if (safe_mode) {
 		// don't need to check again, userspace may call multiple times
 		return true;
@@ -501,7 +633,7 @@ bool ksu_is_safe_mode()
 	return false;
 }
 
-static int sys_execve_handler_pre(struct kprobe *p, struct pt_regs *regs)
+static int sys_execve_handler_pre(struct pt_regs *regs, void *data)
 {
 	struct pt_regs *real_regs = PT_REAL_REGS(regs);
 	const char __user **filename_user =
@@ -515,6 +647,7 @@ static int sys_execve_handler_pre(struct kprobe *p, struct pt_regs *regs)
 	unsigned long addr;
 	const char __user *fn;
 
+	boot_hook_hit(BOOT_HOOK_EXECVE);
 	if (!filename_user)
 		return 0;
 
@@ -536,22 +669,26 @@ static int sys_execve_handler_pre(struct kprobe *p, struct pt_regs *regs)
 	return ksu_handle_execveat_ksud(AT_FDCWD, &filename_p, &argv, NULL, NULL);
 }
 
-static int sys_read_handler_pre(struct kprobe *p, struct pt_regs *regs)
+static int sys_read_handler_pre(struct pt_regs *regs, void *data)
 {
 	struct pt_regs *real_regs = PT_REAL_REGS(regs);
 	unsigned int fd = PT_REGS_PARM1(real_regs);
 
+	boot_hook_hit(BOOT_HOOK_SYS_READ);
 	ksu_handle_sys_read(fd);
 	return 0;
 }
 
-static int sys_fstat_handler_pre(struct kretprobe_instance *p,
-					struct pt_regs *regs)
+static int sys_fstat_handler_pre(struct pt_regs *regs, void *data)
 {
 	struct pt_regs *real_regs = PT_REAL_REGS(regs);
 	unsigned int fd = PT_REGS_PARM1(real_regs);
 	void *statbuf = PT_REGS_PARM2(real_regs);
-	*(void **)&p->data = NULL;
+	*(void **)data = NULL;
+
+	boot_hook_hit(BOOT_HOOK_SYS_FSTAT);
+	if (!maybe_init_task())
+		return 1;
 
 	struct file *file = fget(fd);
 	if (!file)
@@ -559,17 +696,16 @@ static int sys_fstat_handler_pre(struct kretprobe_instance *p,
 	if (is_init_rc(file)) {
 		pr_info("stat init.rc");
 		fput(file);
-		*(void **)&p->data = statbuf;
+		*(void **)data = statbuf;
 		return 0;
 	}
 	fput(file);
 	return 1;
 }
 
-static int sys_fstat_handler_post(struct kretprobe_instance *p,
-					struct pt_regs *regs)
+static void sys_fstat_handler_post(struct pt_regs *regs, void *data)
 {
-	void __user *statbuf = *(void **)&p->data;
+	void __user *statbuf = *(void **)data;
 	if (statbuf) {
 		void __user *st_size_ptr = statbuf + offsetof(struct stat, st_size);
 		long size, new_size;
@@ -586,83 +722,75 @@ static int sys_fstat_handler_post(struct kretprobe_instance *p,
 			pr_err("read statbuf 0x%lx failed", (unsigned long)st_size_ptr);
 		}
 	}
-
-	return 0;
 }
 
-static int input_handle_event_handler_pre(struct kprobe *p,
-						struct pt_regs *regs)
-{
-	unsigned int *type = (unsigned int *)&PT_REGS_PARM2(regs);
-	unsigned int *code = (unsigned int *)&PT_REGS_PARM3(regs);
-	int *value = (int *)&PT_REGS_CCALL_PARM4(regs);
-	return ksu_handle_input_handle_event(type, code, value);
-}
-
-static struct kprobe execve_kp = {
-	.symbol_name = SYS_EXECVE_SYMBOL,
-	.pre_handler = sys_execve_handler_pre,
+static struct ksu_hook execve_kp = {
+	.symbol = SYS_EXECVE_SYMBOL,
+	.entry = sys_execve_handler_pre,
 };
-static struct kprobe sys_read_kp = {
-	.symbol_name = SYS_READ_SYMBOL,
-	.pre_handler = sys_read_handler_pre,
+static struct ksu_hook sys_read_kp = {
+	.symbol = SYS_READ_SYMBOL,
+	.entry = sys_read_handler_pre,
 };
 
-static struct kretprobe sys_fstat_kp = {
-	.kp.symbol_name = SYS_FSTAT_SYMBOL,
-	.entry_handler = sys_fstat_handler_pre,
-	.handler = sys_fstat_handler_post,
+static struct ksu_hook sys_fstat_kp = {
+	.symbol = SYS_FSTAT_SYMBOL,
+	.entry = sys_fstat_handler_pre,
+	.exit = sys_fstat_handler_post,
 	.data_size = sizeof(void *),
 };
 
-static struct kprobe input_event_kp = {
-	.symbol_name = "input_event",
-	.pre_handler = input_handle_event_handler_pre,
-};
+static void disarm_boot_hook(struct ksu_hook *hook, enum boot_hook_id id)
+{
+	if (!ksu_hook_registered(hook))
+		return;
+	ksu_hook_unregister(hook);
+	pr_info("ksud: %s hook disarmed after %lu hits\n", boot_hook_names[id],
+		boot_hook_hits_sum(id));
+}
 
 static void do_stop_init_rc_hook(struct work_struct *work)
 {
 	mutex_lock(&kp_lock);
-	if (sys_read_kp_registered) {
-		unregister_kprobe(&sys_read_kp);
-		sys_read_kp_registered = false;
-	}
-	if (sys_fstat_kp_registered) {
-		unregister_kretprobe(&sys_fstat_kp);
-		sys_fstat_kp_registered = false;
-	}
+	disarm_boot_hook(&sys_read_kp, BOOT_HOOK_SYS_READ);
+	disarm_boot_hook(&sys_fstat_kp, BOOT_HOOK_SYS_FSTAT);
 	mutex_unlock(&kp_lock);
 }
 
 static void do_stop_execve_hook(struct work_struct *work)
 {
 	mutex_lock(&kp_lock);
-	if (execve_kp_registered) {
-		unregister_kprobe(&execve_kp);
-		execve_kp_registered = false;
-	}
+	disarm_boot_hook(&execve_kp, BOOT_HOOK_EXECVE);
 	mutex_unlock(&kp_lock);
 }
 
+static void unregister_input_handler(void)
+{
+	if (!input_handler_registered)
+		return;
+	input_unregister_handler(&ksu_input_handler);
+	input_handler_registered = false;
+	pr_info("ksud: input handler removed after %lu events\n",
+		boot_hook_hits_sum(BOOT_HOOK_INPUT_EVENT));
+}
+
 static void do_stop_input_hook(struct work_struct *work)
 {
 	mutex_lock(&kp_lock);
-	if (input_event_kp_registered) {
-		unregister_kprobe(&input_event_kp);
-		input_event_kp_registered = false;
-	}
+	unregister_input_handler();
 	mutex_unlock(&kp_lock);
 }
 
 static void stop_init_rc_hook()
 {
-	bool ret = schedule_work(&stop_init_rc_hook_work);
+	// pull the deadline in to now
+	bool ret = mod_delayed_work(system_wq, &stop_init_rc_hook_work, 0);
 	pr_info("unregister init_rc_hook kprobe: %d!\n", ret);
 }
 
 static void stop_execve_hook()
 {
-	bool ret = schedule_work(&stop_execve_hook_work);
+	bool ret = mod_delayed_work(system_wq, &stop_execve_hook_work, 0);
 	pr_info("unregister execve kprobe: %d!\n", ret);
 }
 
@@ -673,8 +801,8 @@ static void stop_input_hook()
 		return;
 	}
 	input_hook_stopped = true;
-	bool ret = schedule_work(&stop_input_hook_work);
-	pr_info("unregister input kprobe: %d!\n", ret);
+	bool ret = mod_delayed_work(system_wq, &stop_input_hook_work, 0);
+	pr_info("unregister input handler: %d!\n", ret);
 }
 
 // ksud: module support
@@ -682,29 +810,32 @@ void ksu_ksud_init()
 {
 	int ret;
 
-	ret = register_kprobe(&execve_kp);
+	// the handlers may queue these as soon as the hooks are live
+	INIT_DELAYED_WORK(&stop_init_rc_hook_work, do_stop_init_rc_hook);
+	INIT_DELAYED_WORK(&stop_execve_hook_work, do_stop_execve_hook);
+	INIT_DELAYED_WORK(&stop_input_hook_work, do_stop_input_hook);
+
+	ret = ksu_hook_register(&execve_kp);
 	pr_info("ksud: execve_kp: %d\n", ret);
-	if (!ret)
-		execve_kp_registered = true;
 
-	ret = register_kprobe(&sys_read_kp);
+	ret = ksu_hook_register(&sys_read_kp);
 	pr_info("ksud: sys_read_kp: %d\n", ret);
-	if (!ret)
-		sys_read_kp_registered = true;
 
-	ret = register_kretprobe(&sys_fstat_kp);
+	ret = ksu_hook_register(&sys_fstat_kp);
 	pr_info("ksud: sys_fstat_kp: %d\n", ret);
-	if (!ret)
-		sys_fstat_kp_registered = true;
 
-	ret = register_kprobe(&input_event_kp);
-	pr_info("ksud: input_event_kp: %d\n", ret);
+	ret = input_register_handler(&ksu_input_handler);
+	pr_info("ksud: input handler: %d\n", ret);
 	if (!ret)
-		input_event_kp_registered = true;
+		input_handler_registered = true;
+
+	if (boot_hook_timeout) {
+		unsigned long deadline = boot_hook_timeout * HZ;
 
-	INIT_WORK(&stop_init_rc_hook_work, do_stop_init_rc_hook);
-	INIT_WORK(&stop_execve_hook_work, do_stop_execve_hook);
-	INIT_WORK(&stop_input_hook_work, do_stop_input_hook);
+		schedule_delayed_work(&stop_init_rc_hook_work, deadline);
+		schedule_delayed_work(&stop_execve_hook_work, deadline);
+		schedule_delayed_work(&stop_input_hook_work, deadline);
+	}
 }
 
 void ksu_ksud_exit()
@@ -716,28 +847,16 @@ void ksu_ksud_exit()
 		hooked_rc_file = NULL;
 	}
 
-	/* Flush pending work items first so they don't race with us */
-	flush_work(&stop_init_rc_hook_work);
-	flush_work(&stop_execve_hook_work);
-	flush_work(&stop_input_hook_work);
+	/* Cancel pending deadlines first so they don't race with us */
+	cancel_delayed_work_sync(&stop_init_rc_hook_work);
+	cancel_delayed_work_sync(&stop_execve_hook_work);
+	cancel_delayed_work_sync(&stop_input_hook_work);
 
 	/* Now unregister anything that the work items didn't get to */
 	mutex_lock(&kp_lock);
-	if (execve_kp_registered) {
-		unregister_kprobe(&execve_kp);
-		execve_kp_registered = false;
-	}
-	if (sys_read_kp_registered) {
-		unregister_kprobe(&sys_read_kp);
-		sys_read_kp_registered = false;
-	}
-	if (sys_fstat_kp_registered) {
-		unregister_kretprobe(&sys_fstat_kp);
-		sys_fstat_kp_registered = false;
-	}
-	if (input_event_kp_registered) {
-		unregister_kprobe(&input_event_kp);
-		input_event_kp_registered = false;
-	}
+	ksu_hook_unregister(&execve_kp);
+	ksu_hook_unregister(&sys_read_kp);
+	ksu_hook_unregister(&sys_fstat_kp);
+	unregister_input_handler();
 	mutex_unlock(&kp_lock);
 }
@@ -14,6 +14,9 @@ void on_boot_completed(void);
 
 bool ksu_is_safe_mode(void);
 
+// Safe mode verdict without closing the detection window
+bool ksu_peek_safe_mode(void);
+
 int nuke_ext4_sysfs(const char *mnt);
 
 extern u32 ksu_file_sid;
@@ -4,10 +4,13 @@
 #include <linux/cred.h>
 #include <linux/types.h>
 #include "allowlist.h"
+#include "status_page.h"
 
 #define KSU_INVALID_APPID -1
 
 extern uid_t ksu_manager_appid; // DO NOT DIRECT USE
+// Bumped on every manager change so cached roles can tell they are stale
+extern unsigned int ksu_manager_gen;
 
 static inline bool ksu_is_manager_appid_valid()
 {
@@ -29,14 +32,25 @@ static inline uid_t ksu_get_manager_appid()
 	return ksu_manager_appid;
 }
 
+static inline unsigned int ksu_get_manager_gen(void)
+{
+	return READ_ONCE(ksu_manager_gen);
+}
+
 static inline void ksu_set_manager_appid(uid_t appid)
 {
 	ksu_manager_appid = appid;
+	smp_wmb();
+	WRITE_ONCE(ksu_manager_gen, ksu_manager_gen + 1);
+	ksu_status_changed();
 }
 
 static inline void ksu_invalidate_manager_uid()
 {
 	ksu_manager_appid = KSU_INVALID_APPID;
+	smp_wmb();
+	WRITE_ONCE(ksu_manager_gen, ksu_manager_gen + 1);
+	ksu_status_changed();
 }
 
 int ksu_observer_init(void);
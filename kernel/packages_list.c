@@ -0,0 +1,234 @@
+/*
+ * packages.list parsing and the package map, #included by throne_tracker.c
+ * the way tiny_sulog.c is by supercalls.c. Only use what that file's kernel
+ * headers provide: tools/test builds this file on the host against stubs.
+ */
+
+/*
+ * Parsed packages.list. Entries and their names live in two arenas that
+ * grow by doubling, so a parse makes a handful of allocations instead of
+ * one per package. Once parsing is done the entries are chained into
+ * buckets by package name hash; lookups compare the appid and the hash
+ * before touching the name.
+ */
+struct package_entry {
+	u32 uid;
+	u32 hash; // full_name_hash() of the package name
+	u32 name; // offset into package_map.names
+	u32 next; // next entry in the bucket, index + 1, 0 ends the chain
+};
+
+struct package_map {
+	struct package_entry *entries;
+	u32 count, max;
+	char *names;
+	u32 names_len, names_max;
+	u32 *buckets; // index + 1 of the first entry, 0 if empty
+	u32 mask;
+	u32 manager_appid; // noted while parsing, saves a scan for it
+	bool manager_seen;
+};
+
+static int package_map_grow(void **arena, u32 *max, size_t elem, u32 need)
+{
+	u32 new_max = *max;
+	void *p;
+
+	if (need <= *max)
+		return 0;
+
+	while (new_max < need)
+		new_max = new_max ? new_max * 2 : 64;
+
+	p = kvmalloc_array(new_max, elem, GFP_KERNEL);
+	if (!p)
+		return -ENOMEM;
+
+	if (*arena) {
+		memcpy(p, *arena, (size_t)*max * elem);
+		kvfree(*arena);
+	}
+	*arena = p;
+	*max = new_max;
+	return 0;
+}
+
+static u32 package_hash(const char *package, size_t len)
+{
+	return full_name_hash(NULL, package, len);
+}
+
+static int package_map_add(struct package_map *map, u32 uid,
+			   const char *package)
+{
+	size_t len = strnlen(package, KSU_MAX_PACKAGE_NAME - 1);
+	struct package_entry *e;
+
+	if (package_map_grow((void **)&map->entries, &map->max,
+			     sizeof(*map->entries), map->count + 1) ||
+	    package_map_grow((void **)&map->names, &map->names_max, 1,
+			     map->names_len + len + 1))
+		return -ENOMEM;
+
+	if (uid == map->manager_appid)
+		map->manager_seen = true;
+
+	e = &map->entries[map->count++];
+	e->uid = uid;
+	e->hash = package_hash(package, len);
+	e->name = map->names_len;
+	e->next = 0;
+
+	memcpy(map->names + map->names_len, package, len);
+	map->names[map->names_len + len] = '\0';
+	map->names_len += len + 1;
+	return 0;
+}
+
+// Chain the parsed entries into buckets, at least two per entry
+static int package_map_index(struct package_map *map)
+{
+	u32 size = roundup_pow_of_two(max_t(u32, map->count * 2, 16));
+	u32 i;
+
+	map->buckets = kvcalloc(size, sizeof(*map->buckets), GFP_KERNEL);
+	if (!map->buckets)
+		return -ENOMEM;
+
+	map->mask = size - 1;
+	for (i = 0; i < map->count; i++) {
+		u32 *head = &map->buckets[map->entries[i].hash & map->mask];
+
+		map->entries[i].next = *head;
+		*head = i + 1;
+	}
+	return 0;
+}
+
+/*
+ * Find @package, and when @appid is not KSU_INVALID_APPID require that
+ * appid too.
+ */
+static struct package_entry *package_map_find(struct package_map *map,
+					      u32 appid, const char *package)
+{
+	size_t len = strnlen(package, KSU_MAX_PACKAGE_NAME - 1);
+	u32 hash = package_hash(package, len);
+	u32 i;
+
+	if (!map->buckets)
+		return NULL;
+
+	for (i = map->buckets[hash & map->mask]; i;
+	     i = map->entries[i - 1].next) {
+		struct package_entry *e = &map->entries[i - 1];
+
+		if (e->hash != hash)
+			continue;
+		if (appid != KSU_INVALID_APPID && e->uid != appid)
+			continue;
+		if (!strncmp(map->names + e->name, package, len) &&
+		    !map->names[e->name + len])
+			return e;
+	}
+	return NULL;
+}
+
+static void package_map_free(struct package_map *map)
+{
+	kvfree(map->entries);
+	kvfree(map->names);
+	kvfree(map->buckets);
+	memset(map, 0, sizeof(*map));
+}
+
+/*
+ * packages.list lines are "<package> <uid> <debuggable> <data dir> ...".
+ * Only the first two fields matter here; @line is NUL terminated in place.
+ */
+static int parse_package_line(char *line, struct package_map *map)
+{
+	char *package = strsep(&line, " ");
+	char *uid = strsep(&line, " ");
+	u32 res;
+
+	if (!package || !*package || !uid) {
+		pr_err("update_uid: package or uid is NULL!\n");
+		return -EINVAL;
+	}
+
+	if (kstrtou32(uid, 10, &res)) {
+		pr_err("update_uid: uid parse err\n");
+		return -EINVAL;
+	}
+
+	return package_map_add(map, res, package);
+}
+
+/*
+ * Read the file a page at a time and split lines in place. A partial line
+ * at the end of a chunk moves to the front of the buffer and the next read
+ * appends to it; a line longer than the buffer is dropped up to its newline.
+ * Returns the number of packages parsed or a negative errno.
+ */
+static int parse_packages_list(struct file *fp, struct package_map *map)
+{
+	char *buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	size_t len = 0;
+	loff_t pos = 0;
+	bool skipping = false, eof = false;
+	int count = 0;
+
+	if (!buf)
+		return -ENOMEM;
+
+	while (!eof) {
+		ssize_t n = kernel_read(fp, buf + len, PAGE_SIZE - 1 - len, &pos);
+		char *line, *nl;
+		size_t rest;
+
+		if (n < 0) {
+			kfree(buf);
+			return n;
+		}
+		if (n == 0) {
+			// a last line without a newline still counts
+			eof = true;
+			if (len && !skipping)
+				buf[len++] = '\n';
+		}
+		len += n;
+
+		line = buf;
+		rest = len;
+		while ((nl = memchr(line, '\n', rest))) {
+			*nl = '\0';
+			if (skipping) {
+				skipping = false;
+			} else if (nl > line) {
+				int ret = parse_package_line(line, map);
+
+				if (ret == -ENOMEM) {
+					kfree(buf);
+					return ret;
+				}
+				if (!ret)
+					count++;
+			}
+			rest -= nl + 1 - line;
+			line = nl + 1;
+		}
+
+		if (rest == PAGE_SIZE - 1) {
+			if (!skipping)
+				pr_err("update_uid: line too long, skipping it\n");
+			skipping = true;
+			rest = 0;
+		}
+		memmove(buf, line, rest);
+		len = rest;
+	}
+
+	kfree(buf);
+	return count;
+}
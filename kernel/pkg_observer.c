@@ -10,6 +10,7 @@
 #include "throne_tracker.h"
 
 #define MASK_SYSTEM (FS_CREATE | FS_MOVE | FS_EVENT_ON_CHILD)
+#define MASK_APP (FS_CREATE | FS_MOVED_TO | FS_EVENT_ON_CHILD)
 
 struct watch_dir {
 	const char *path;
@@ -21,17 +22,28 @@ struct watch_dir {
 
 static struct fsnotify_group *g;
 
+static struct watch_dir g_watch = { .path = "/data/system",
+                                    .mask = MASK_SYSTEM };
+// new package directories, so a manager search can skip the rest
+static struct watch_dir g_app_watch = { .path = "/data/app",
+                                        .mask = MASK_APP };
+
 static int ksu_handle_inode_event(struct fsnotify_mark *mark, u32 mask,
                                   struct inode *inode, struct inode *dir,
                                   const struct qstr *file_name, u32 cookie)
 {
     if (!file_name)
         return 0;
+    if (mark == g_app_watch.mark) {
+        if (mask & FS_ISDIR)
+            ksu_throne_tracker_note_app_dir(file_name->name, file_name->len);
+        return 0;
+    }
     if (mask & FS_ISDIR)
         return 0;
     if (file_name->len == 13 && !memcmp(file_name->name, "packages.list", 13)) {
         pr_info("packages.list detected: %d\n", mask);
-        track_throne(false);
+        ksu_throne_tracker_schedule();
     }
     return 0;
 }
@@ -99,9 +111,6 @@ static void unwatch_one_dir(struct watch_dir *wd)
 	}
 }
 
-static struct watch_dir g_watch = { .path = "/data/system",
-                                    .mask = MASK_SYSTEM };
-
 int ksu_observer_init(void)
 {
 	int ret = 0;
@@ -115,6 +124,9 @@ int ksu_observer_init(void)
 		return PTR_ERR(g);
 
 	ret = watch_one_dir(&g_watch);
+	// until this works, manager searches keep walking all of /data/app
+	if (!watch_one_dir(&g_app_watch))
+		ksu_throne_tracker_watching_app_dirs();
 	pr_info("observer init done\n");
 	return 0;
 }
@@ -148,6 +160,8 @@ void ksu_observer_exit(void)
 	 */
 	if (g_watch.mark)
 		WRITE_ONCE(g_watch.mark->mask, 0);
+	if (g_app_watch.mark)
+		WRITE_ONCE(g_app_watch.mark->mask, 0);
 
 	spin_lock(&g->notification_lock);
 	g->shutdown = true;
@@ -157,5 +171,8 @@ void ksu_observer_exit(void)
 	g_watch.mark = NULL;
 	g_watch.inode = NULL;
 	memset(&g_watch.kpath, 0, sizeof(g_watch.kpath));
+	g_app_watch.mark = NULL;
+	g_app_watch.inode = NULL;
+	memset(&g_app_watch.kpath, 0, sizeof(g_app_watch.kpath));
 	pr_info("observer exit done\n");
 }
@@ -255,30 +255,11 @@ static void reset_avc_cache()
     selinux_xfrm_notify_policyload();
 }
 
-int handle_sepolicy(unsigned long arg3, void __user *arg4)
+// Apply one rule to @db, called with ksu_rules held
+static int apply_sepol_rule(struct policydb *db, const struct sepol_data *data)
 {
-    struct policydb *db;
-
-    if (!arg4) {
-        return -EINVAL;
-    }
-
-    if (!getenforce()) {
-        pr_info("SELinux permissive or disabled when handle policy!\n");
-    }
-
-    struct sepol_data data;
-    if (copy_from_user(&data, arg4, sizeof(struct sepol_data))) {
-        pr_err("sepol: copy sepol_data failed.\n");
-        return -EINVAL;
-    }
-
-    u32 cmd = data.cmd;
-    u32 subcmd = data.subcmd;
-
-    mutex_lock(&ksu_rules);
-
-    db = get_policydb();
+    u32 cmd = data->cmd;
+    u32 subcmd = data->subcmd;
 
     int ret = -EINVAL;
     if (cmd == CMD_NORMAL_PERM) {
@@ -288,22 +269,22 @@ int handle_sepolicy(unsigned long arg3, void __user *arg4)
         char perm_buf[MAX_SEPOL_LEN];
 
         char *s, *t, *c, *p;
-        if (get_object(src_buf, data.sepol1, sizeof(src_buf), &s) < 0) {
+        if (get_object(src_buf, data->sepol1, sizeof(src_buf), &s) < 0) {
             pr_err("sepol: copy src failed.\n");
             goto exit;
         }
 
-        if (get_object(tgt_buf, data.sepol2, sizeof(tgt_buf), &t) < 0) {
+        if (get_object(tgt_buf, data->sepol2, sizeof(tgt_buf), &t) < 0) {
             pr_err("sepol: copy tgt failed.\n");
             goto exit;
         }
 
-        if (get_object(cls_buf, data.sepol3, sizeof(cls_buf), &c) < 0) {
+        if (get_object(cls_buf, data->sepol3, sizeof(cls_buf), &c) < 0) {
             pr_err("sepol: copy cls failed.\n");
             goto exit;
         }
 
-        if (get_object(perm_buf, data.sepol4, sizeof(perm_buf), &p) < 0) {
+        if (get_object(perm_buf, data->sepol4, sizeof(perm_buf), &p) < 0) {
             pr_err("sepol: copy perm failed.\n");
             goto exit;
         }
@@ -331,23 +312,23 @@ int handle_sepolicy(unsigned long arg3, void __user *arg4)
         char perm_set[MAX_SEPOL_LEN];
 
         char *s, *t, *c;
-        if (get_object(src_buf, data.sepol1, sizeof(src_buf), &s) < 0) {
+        if (get_object(src_buf, data->sepol1, sizeof(src_buf), &s) < 0) {
             pr_err("sepol: copy src failed.\n");
             goto exit;
         }
-        if (get_object(tgt_buf, data.sepol2, sizeof(tgt_buf), &t) < 0) {
+        if (get_object(tgt_buf, data->sepol2, sizeof(tgt_buf), &t) < 0) {
             pr_err("sepol: copy tgt failed.\n");
             goto exit;
         }
-        if (get_object(cls_buf, data.sepol3, sizeof(cls_buf), &c) < 0) {
+        if (get_object(cls_buf, data->sepol3, sizeof(cls_buf), &c) < 0) {
             pr_err("sepol: copy cls failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(operation, data.sepol4, sizeof(operation)) < 0) {
+        if (strncpy_from_user(operation, data->sepol4, sizeof(operation)) < 0) {
             pr_err("sepol: copy operation failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(perm_set, data.sepol5, sizeof(perm_set)) < 0) {
+        if (strncpy_from_user(perm_set, data->sepol5, sizeof(perm_set)) < 0) {
             pr_err("sepol: copy perm_set failed.\n");
             goto exit;
         }
@@ -366,7 +347,7 @@ int handle_sepolicy(unsigned long arg3, void __user *arg4)
     } else if (cmd == CMD_TYPE_STATE) {
         char src[MAX_SEPOL_LEN];
 
-        if (strncpy_from_user(src, data.sepol1, sizeof(src)) < 0) {
+        if (strncpy_from_user(src, data->sepol1, sizeof(src)) < 0) {
             pr_err("sepol: copy src failed.\n");
             goto exit;
         }
@@ -386,11 +367,11 @@ int handle_sepolicy(unsigned long arg3, void __user *arg4)
         char type[MAX_SEPOL_LEN];
         char attr[MAX_SEPOL_LEN];
 
-        if (strncpy_from_user(type, data.sepol1, sizeof(type)) < 0) {
+        if (strncpy_from_user(type, data->sepol1, sizeof(type)) < 0) {
             pr_err("sepol: copy type failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(attr, data.sepol2, sizeof(attr)) < 0) {
+        if (strncpy_from_user(attr, data->sepol2, sizeof(attr)) < 0) {
             pr_err("sepol: copy attr failed.\n");
             goto exit;
         }
@@ -410,7 +391,7 @@ int handle_sepolicy(unsigned long arg3, void __user *arg4)
     } else if (cmd == CMD_ATTR) {
         char attr[MAX_SEPOL_LEN];
 
-        if (strncpy_from_user(attr, data.sepol1, sizeof(attr)) < 0) {
+        if (strncpy_from_user(attr, data->sepol1, sizeof(attr)) < 0) {
             pr_err("sepol: copy attr failed.\n");
             goto exit;
         }
@@ -427,28 +408,28 @@ int handle_sepolicy(unsigned long arg3, void __user *arg4)
         char default_type[MAX_SEPOL_LEN];
         char object[MAX_SEPOL_LEN];
 
-        if (strncpy_from_user(src, data.sepol1, sizeof(src)) < 0) {
+        if (strncpy_from_user(src, data->sepol1, sizeof(src)) < 0) {
             pr_err("sepol: copy src failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(tgt, data.sepol2, sizeof(tgt)) < 0) {
+        if (strncpy_from_user(tgt, data->sepol2, sizeof(tgt)) < 0) {
             pr_err("sepol: copy tgt failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(cls, data.sepol3, sizeof(cls)) < 0) {
+        if (strncpy_from_user(cls, data->sepol3, sizeof(cls)) < 0) {
             pr_err("sepol: copy cls failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(default_type, data.sepol4, sizeof(default_type)) <
+        if (strncpy_from_user(default_type, data->sepol4, sizeof(default_type)) <
             0) {
             pr_err("sepol: copy default_type failed.\n");
             goto exit;
         }
         char *real_object;
-        if (data.sepol5 == NULL) {
+        if (data->sepol5 == NULL) {
             real_object = NULL;
         } else {
-            if (strncpy_from_user(object, data.sepol5, sizeof(object)) < 0) {
+            if (strncpy_from_user(object, data->sepol5, sizeof(object)) < 0) {
                 pr_err("sepol: copy object failed.\n");
                 goto exit;
             }
@@ -466,19 +447,19 @@ int handle_sepolicy(unsigned long arg3, void __user *arg4)
         char cls[MAX_SEPOL_LEN];
         char default_type[MAX_SEPOL_LEN];
 
-        if (strncpy_from_user(src, data.sepol1, sizeof(src)) < 0) {
+        if (strncpy_from_user(src, data->sepol1, sizeof(src)) < 0) {
             pr_err("sepol: copy src failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(tgt, data.sepol2, sizeof(tgt)) < 0) {
+        if (strncpy_from_user(tgt, data->sepol2, sizeof(tgt)) < 0) {
             pr_err("sepol: copy tgt failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(cls, data.sepol3, sizeof(cls)) < 0) {
+        if (strncpy_from_user(cls, data->sepol3, sizeof(cls)) < 0) {
             pr_err("sepol: copy cls failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(default_type, data.sepol4, sizeof(default_type)) <
+        if (strncpy_from_user(default_type, data->sepol4, sizeof(default_type)) <
             0) {
             pr_err("sepol: copy default_type failed.\n");
             goto exit;
@@ -497,15 +478,15 @@ int handle_sepolicy(unsigned long arg3, void __user *arg4)
         char name[MAX_SEPOL_LEN];
         char path[MAX_SEPOL_LEN];
         char context[MAX_SEPOL_LEN];
-        if (strncpy_from_user(name, data.sepol1, sizeof(name)) < 0) {
+        if (strncpy_from_user(name, data->sepol1, sizeof(name)) < 0) {
             pr_err("sepol: copy name failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(path, data.sepol2, sizeof(path)) < 0) {
+        if (strncpy_from_user(path, data->sepol2, sizeof(path)) < 0) {
             pr_err("sepol: copy path failed.\n");
             goto exit;
         }
-        if (strncpy_from_user(context, data.sepol3, sizeof(context)) < 0) {
+        if (strncpy_from_user(context, data->sepol3, sizeof(context)) < 0) {
             pr_err("sepol: copy context failed.\n");
             goto exit;
         }
@@ -520,6 +501,29 @@ int handle_sepolicy(unsigned long arg3, void __user *arg4)
     }
 
 exit:
+    return ret;
+}
+
+int handle_sepolicy(unsigned long arg3, void __user *arg4)
+{
+    struct sepol_data data;
+    int ret;
+
+    if (!arg4) {
+        return -EINVAL;
+    }
+
+    if (!getenforce()) {
+        pr_info("SELinux permissive or disabled when handle policy!\n");
+    }
+
+    if (copy_from_user(&data, arg4, sizeof(struct sepol_data))) {
+        pr_err("sepol: copy sepol_data failed.\n");
+        return -EINVAL;
+    }
+
+    mutex_lock(&ksu_rules);
+    ret = apply_sepol_rule(get_policydb(), &data);
     mutex_unlock(&ksu_rules);
 
     // only allow and xallow needs to reset avc cache, but we cannot do that because
@@ -527,4 +531,60 @@ exit:
     reset_avc_cache();
 
     return ret;
-}
\ No newline at end of file
+}
+
+/*
+ * Apply @count rules laid out like handle_sepolicy()'s argument. The whole
+ * array is applied under one hold of ksu_rules and the AVC is reset once at
+ * the end, instead of once per rule. A failing rule doesn't stop the rest;
+ * its error goes to @results[i] if given and is counted in @failed.
+ */
+int handle_sepolicy_batch(void __user *rules, u32 count, s32 __user *results,
+                          u32 *failed)
+{
+    struct sepol_data __user *urules = rules;
+    struct sepol_data data;
+    struct policydb *db;
+    int ret = 0;
+    u32 i;
+
+    *failed = 0;
+    if (!rules || !count) {
+        return -EINVAL;
+    }
+
+    if (!getenforce()) {
+        pr_info("SELinux permissive or disabled when handle policy!\n");
+    }
+
+    mutex_lock(&ksu_rules);
+
+    db = get_policydb();
+
+    for (i = 0; i < count; i++) {
+        int err;
+
+        if (copy_from_user(&data, &urules[i], sizeof(data))) {
+            pr_err("sepol: copy rule %u failed.\n", i);
+            ret = -EFAULT;
+            break;
+        }
+
+        err = apply_sepol_rule(db, &data);
+        if (err)
+            (*failed)++;
+
+        if (results && put_user(err, &results[i])) {
+            ret = -EFAULT;
+            break;
+        }
+    }
+
+    mutex_unlock(&ksu_rules);
+
+    // rules before a fault are already in the policy
+    if (i)
+        reset_avc_cache();
+
+    return ret;
+}
@@ -35,6 +35,8 @@ void apply_kernelsu_rules();
 void revert_kernelsu_rules();
 
 int handle_sepolicy(unsigned long arg3, void __user *arg4);
+int handle_sepolicy_batch(void __user *rules, u32 count, s32 __user *results,
+                          u32 *failed);
 
 void setup_ksu_cred();
 
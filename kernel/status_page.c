@@ -0,0 +1,228 @@
+#include <linux/gfp.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+
+#include "status_page.h"
+#include "allowlist.h"
+#include "feature.h"
+#include "hook_backend.h"
+#include "klog.h" // IWYU pragma: keep
+#include "ksu.h"
+#include "ksud.h"
+#include "manager.h"
+#include "supercalls.h"
+
+static struct ksu_status_page *status_page;
+
+// serializes writers, readers only ever look at seq
+static DEFINE_MUTEX(status_lock);
+
+static void status_collect(struct ksu_status_page *next)
+{
+	struct ksu_feature_value values[KSU_STATUS_FEATURE_MAX];
+	u16 allow_count = 0, deny_count = 0;
+	u32 i, count;
+
+	next->magic = KSU_STATUS_MAGIC;
+	next->size = sizeof(*next);
+	next->version = ksu_get_reported_version();
+#ifdef MODULE
+	next->flags |= 0x1;
+#endif
+	next->manager_appid = ksu_get_manager_appid();
+	next->manager_gen = ksu_get_manager_gen();
+
+	ksu_get_allow_list(NULL, 0, NULL, &allow_count, true);
+	ksu_get_allow_list(NULL, 0, NULL, &deny_count, false);
+	next->allow_count = allow_count;
+	next->deny_count = deny_count;
+
+	next->safe_mode = ksu_peek_safe_mode();
+	strscpy(next->hook_mode, ksu_hook_mode_name(), sizeof(next->hook_mode));
+	strscpy(next->version_tag, KERNEL_SU_VERSION_TAG,
+		sizeof(next->version_tag));
+
+	// only supported features are listed, absent ids read as unsupported
+	count = min_t(u32, ksu_get_all_features(values, ARRAY_SIZE(values)),
+		      ARRAY_SIZE(values));
+	for (i = 0; i < count; i++) {
+		next->features[i].id = values[i].id;
+		next->features[i].supported = 1;
+		next->features[i].value = values[i].value;
+	}
+	next->feature_count = count;
+}
+
+void ksu_status_refresh(void)
+{
+	struct ksu_status_page next = { 0 };
+	u32 seq;
+
+	mutex_lock(&status_lock);
+	if (!status_page)
+		goto out;
+
+	status_collect(&next);
+
+	seq = status_page->seq;
+	WRITE_ONCE(status_page->seq, seq + 1);
+	smp_wmb();
+	memcpy((char *)status_page + sizeof(next.seq),
+	       (char *)&next + sizeof(next.seq), sizeof(next) - sizeof(next.seq));
+	smp_wmb();
+	WRITE_ONCE(status_page->seq, seq + 2);
+
+out:
+	mutex_unlock(&status_lock);
+}
+
+static void status_work_func(struct work_struct *work)
+{
+	ksu_status_refresh();
+}
+
+static DECLARE_WORK(status_work, status_work_func);
+
+void ksu_status_changed(void)
+{
+	if (READ_ONCE(status_page))
+		schedule_work(&status_work);
+}
+
+/*
+ * Every live mapping of the page, one entry per vma. A mapping outlives the
+ * fd it came from, so PREPARE_UNLOAD can't find its owner through fd tables
+ * and asks here instead.
+ */
+struct status_mapping {
+	struct list_head list;
+	struct mm_struct *mm;
+};
+
+static LIST_HEAD(status_mappings);
+static DEFINE_SPINLOCK(status_mappings_lock);
+
+static void status_mapping_add(struct vm_area_struct *vma,
+			       struct status_mapping *m)
+{
+	m->mm = vma->vm_mm;
+	vma->vm_private_data = m;
+
+	spin_lock(&status_mappings_lock);
+	list_add(&m->list, &status_mappings);
+	spin_unlock(&status_mappings_lock);
+}
+
+// fork and mremap copy the vma, the copy gets its own entry
+static void status_vm_open(struct vm_area_struct *vma)
+{
+	status_mapping_add(vma, kmalloc(sizeof(struct status_mapping),
+					GFP_KERNEL | __GFP_NOFAIL));
+}
+
+static void status_vm_close(struct vm_area_struct *vma)
+{
+	struct status_mapping *m = vma->vm_private_data;
+
+	spin_lock(&status_mappings_lock);
+	list_del(&m->list);
+	spin_unlock(&status_mappings_lock);
+	kfree(m);
+}
+
+static const struct vm_operations_struct status_vm_ops = {
+	.open = status_vm_open,
+	.close = status_vm_close,
+};
+
+bool ksu_status_mapped_by(struct mm_struct *mm)
+{
+	struct status_mapping *m;
+	bool found = false;
+
+	spin_lock(&status_mappings_lock);
+	list_for_each_entry (m, &status_mappings, list) {
+		if (m->mm == mm) {
+			found = true;
+			break;
+		}
+	}
+	spin_unlock(&status_mappings_lock);
+
+	return found;
+}
+
+int ksu_status_mmap(struct vm_area_struct *vma)
+{
+	struct status_mapping *m;
+	int ret;
+
+	if (!status_page)
+		return -ENODEV;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	// no mprotect(PROT_WRITE) later either
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+	m = kmalloc(sizeof(*m), GFP_KERNEL);
+	if (!m)
+		return -ENOMEM;
+
+	ret = remap_pfn_range(vma, vma->vm_start,
+			      virt_to_phys(status_page) >> PAGE_SHIFT,
+			      PAGE_SIZE, vma->vm_page_prot);
+	if (ret) {
+		kfree(m);
+		return ret;
+	}
+
+	vma->vm_ops = &status_vm_ops;
+	status_mapping_add(vma, m);
+	return 0;
+}
+
+void ksu_status_init(void)
+{
+	BUILD_BUG_ON(sizeof(struct ksu_status_page) > PAGE_SIZE);
+
+	status_page = (struct ksu_status_page *)get_zeroed_page(GFP_KERNEL);
+	if (!status_page) {
+		pr_err("status: failed to allocate page\n");
+		return;
+	}
+
+	ksu_status_refresh();
+}
+
+/*
+ * Freeing the page under a live mapping is safe only because there can't be
+ * one by now: each mapping pins its vm_file, the driver file's f_op->owner
+ * pins this module, and exit doesn't run until the last of them is gone.
+ */
+void ksu_status_exit(void)
+{
+	struct ksu_status_page *page = status_page;
+
+	mutex_lock(&status_lock);
+	WRITE_ONCE(status_page, NULL);
+	mutex_unlock(&status_lock);
+
+	cancel_work_sync(&status_work);
+	if (page)
+		free_page((unsigned long)page);
+}
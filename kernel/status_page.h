@@ -0,0 +1,24 @@
+#ifndef __KSU_H_STATUS_PAGE
+#define __KSU_H_STATUS_PAGE
+
+#include <linux/types.h>
+
+struct mm_struct;
+struct vm_area_struct;
+
+// Recompute and publish the status page now, may sleep
+void ksu_status_refresh(void);
+
+// Note that some published state changed, safe from atomic context
+void ksu_status_changed(void);
+
+// Map the page read-only into @vma, backs .mmap of the ksu driver fd
+int ksu_status_mmap(struct vm_area_struct *vma);
+
+// Whether @mm still maps the page, even with the driver fd closed
+bool ksu_status_mapped_by(struct mm_struct *mm);
+
+void ksu_status_init(void);
+void ksu_status_exit(void);
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * Per-uid su usage counters, fed from write_sulog() so every sulog call
+ * site is covered. The table is a fixed open-addressed array that writers
+ * claim slots in with cmpxchg; a full table counts the event as dropped
+ * instead of growing. Reset publishes a fresh table and reads the old one
+ * once the writers still holding it are gone.
+ */
+#include <linux/atomic.h>
+#include <linux/hash.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+
+#include "klog.h" // IWYU pragma: keep
+#include "su_usage.h"
+
+#define SU_USAGE_BITS 9
+#define SU_USAGE_SLOTS (1 << SU_USAGE_BITS)
+#define SU_USAGE_PROBES 32
+
+struct su_usage_slot {
+	atomic_t key; // uid + 1, 0 while free
+	atomic_t faccessat;
+	atomic_t stat;
+	atomic_t execve;
+	atomic_t ioctl;
+	atomic_t denied;
+	atomic64_t last_ns;
+};
+
+struct su_usage_table {
+	atomic_t dropped;
+	struct su_usage_slot slots[SU_USAGE_SLOTS];
+};
+
+static struct su_usage_table __rcu *su_usage;
+static DEFINE_MUTEX(su_usage_mutex); // serializes reset and exit
+
+static struct su_usage_table *su_usage_alloc(void)
+{
+	return kvzalloc(sizeof(struct su_usage_table), GFP_KERNEL);
+}
+
+static struct su_usage_slot *su_usage_slot(struct su_usage_table *t,
+					   uid_t uid)
+{
+	int key = uid + 1;
+	u32 i = hash_32(uid, SU_USAGE_BITS);
+	int n;
+
+	for (n = 0; n < SU_USAGE_PROBES; n++, i = (i + 1) & (SU_USAGE_SLOTS - 1)) {
+		struct su_usage_slot *slot = &t->slots[i];
+		int old = atomic_read(&slot->key);
+
+		if (!old)
+			old = atomic_cmpxchg(&slot->key, 0, key);
+		// either ours all along, just claimed, or claimed by a racing writer for the same uid
+		if (!old || old == key)
+			return slot;
+	}
+
+	return NULL;
+}
+
+void ksu_su_usage_account(uid_t uid, u8 type, u8 outcome, u64 ts_ns)
+{
+	struct su_usage_table *t;
+	struct su_usage_slot *slot;
+
+	// preemption is off in write_sulog(), which is an RCU read side
+	t = rcu_dereference_sched(su_usage);
+	if (!t)
+		return;
+
+	slot = su_usage_slot(t, uid);
+	if (!slot) {
+		atomic_inc(&t->dropped);
+		return;
+	}
+
+	if (outcome == KSU_SULOG_DENIED) {
+		atomic_inc(&slot->denied);
+	} else {
+		switch (type) {
+		case KSU_SULOG_FACCESSAT:
+			atomic_inc(&slot->faccessat);
+			break;
+		case KSU_SULOG_STAT:
+			atomic_inc(&slot->stat);
+			break;
+		case KSU_SULOG_EXECVE:
+			atomic_inc(&slot->execve);
+			break;
+		case KSU_SULOG_IOCTL:
+			atomic_inc(&slot->ioctl);
+			break;
+		}
+	}
+
+	// events race in from several CPUs, keep the newest stamp
+	for (;;) {
+		s64 last = atomic64_read(&slot->last_ns);
+
+		if (last >= (s64)ts_ns ||
+		    atomic64_cmpxchg(&slot->last_ns, last, ts_ns) == last)
+			break;
+	}
+}
+
+static int su_usage_cmp(const void *a, const void *b)
+{
+	const struct ksu_su_usage_entry *x = a, *y = b;
+
+	// newest first, so a short buffer keeps the recent users
+	if (x->last_ns != y->last_ns)
+		return x->last_ns > y->last_ns ? -1 : 1;
+	return x->uid < y->uid ? -1 : x->uid > y->uid;
+}
+
+static u32 su_usage_collect(struct su_usage_table *t,
+			    struct ksu_su_usage_entry *out)
+{
+	u32 n = 0;
+	int i;
+
+	for (i = 0; i < SU_USAGE_SLOTS; i++) {
+		struct su_usage_slot *slot = &t->slots[i];
+		int key = atomic_read(&slot->key);
+
+		if (!key)
+			continue;
+
+		out[n].uid = key - 1;
+		out[n].faccessat = atomic_read(&slot->faccessat);
+		out[n].stat = atomic_read(&slot->stat);
+		out[n].execve = atomic_read(&slot->execve);
+		out[n].ioctl = atomic_read(&slot->ioctl);
+		out[n].denied = atomic_read(&slot->denied);
+		out[n].last_ns = atomic64_read(&slot->last_ns);
+		n++;
+	}
+
+	return n;
+}
+
+int ksu_su_usage_export(struct ksu_get_su_usage_cmd *cmd)
+{
+	struct ksu_su_usage_entry *entries;
+	struct su_usage_table *t, *fresh = NULL;
+	int ret = 0;
+	u32 total;
+
+	if (cmd->flags & ~KSU_SU_USAGE_RESET)
+		return -EINVAL;
+
+	entries = kvmalloc_array(SU_USAGE_SLOTS, sizeof(*entries), GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+
+	if (cmd->flags & KSU_SU_USAGE_RESET) {
+		fresh = su_usage_alloc();
+		if (!fresh) {
+			kvfree(entries);
+			return -ENOMEM;
+		}
+	}
+
+	mutex_lock(&su_usage_mutex);
+	t = rcu_dereference_protected(su_usage,
+				      lockdep_is_held(&su_usage_mutex));
+	if (!t) {
+		mutex_unlock(&su_usage_mutex);
+		kvfree(fresh);
+		kvfree(entries);
+		return -ENODEV;
+	}
+
+	if (fresh) {
+		rcu_assign_pointer(su_usage, fresh);
+		// every event lands in exactly one of the two tables
+		synchronize_rcu();
+	}
+
+	total = su_usage_collect(t, entries);
+	cmd->dropped = atomic_read(&t->dropped);
+	mutex_unlock(&su_usage_mutex);
+
+	if (fresh)
+		kvfree(t);
+
+	sort(entries, total, sizeof(*entries), su_usage_cmp, NULL);
+	cmd->total = total;
+	cmd->count = min(cmd->count, total);
+	if (copy_to_user(u64_to_user_ptr(cmd->entries), entries,
+			 cmd->count * sizeof(*entries)))
+		ret = -EFAULT;
+
+	kvfree(entries);
+	return ret;
+}
+
+void ksu_su_usage_init(void)
+{
+	struct su_usage_table *t = su_usage_alloc();
+
+	if (!t) {
+		pr_err("su_usage: alloc failed, usage is not counted\n");
+		return;
+	}
+
+	rcu_assign_pointer(su_usage, t);
+}
+
+void ksu_su_usage_exit(void)
+{
+	struct su_usage_table *t;
+
+	mutex_lock(&su_usage_mutex);
+	t = rcu_dereference_protected(su_usage,
+				      lockdep_is_held(&su_usage_mutex));
+	RCU_INIT_POINTER(su_usage, NULL);
+	mutex_unlock(&su_usage_mutex);
+
+	if (!t)
+		return;
+
+	synchronize_rcu();
+	kvfree(t);
+}
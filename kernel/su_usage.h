@@ -0,0 +1,17 @@
+#ifndef __KSU_H_SU_USAGE
+#define __KSU_H_SU_USAGE
+
+#include <linux/types.h>
+
+#include "supercalls.h"
+
+void ksu_su_usage_init(void);
+void ksu_su_usage_exit(void);
+
+// Count one sulog event for @uid; caller has preemption disabled
+void ksu_su_usage_account(uid_t uid, u8 type, u8 outcome, u64 ts_ns);
+
+// Fill @cmd from the table, swapping in an empty one first if it asks for KSU_SU_USAGE_RESET
+int ksu_su_usage_export(struct ksu_get_su_usage_cmd *cmd);
+
+#endif
@@ -17,10 +17,11 @@
 #include "klog.h" // IWYU pragma: keep
 #include "ksud.h"
 #include "sucompat.h"
+#include "supercalls.h"
 #include "app_profile.h"
 #include "util.h"
 
-extern void write_sulog(uint8_t sym);
+extern void write_sulog(uint8_t sym, uint8_t outcome);
 
 #define SU_PATH "/system/bin/su"
 #define SH_PATH "/system/bin/sh"
@@ -85,7 +86,7 @@ int ksu_handle_faccessat(int *dfd, const char __user **filename_user,
 	strncpy_from_user_nofault(path, *filename_user, sizeof(path));
 
     if (unlikely(!memcmp(path, su, sizeof(su)))) {
-        write_sulog('a');
+        write_sulog(KSU_SULOG_FACCESSAT, KSU_SULOG_REDIRECTED);
         pr_info("faccessat su->sh!\n");
         *filename_user = sh_user_path();
     }
@@ -111,7 +112,7 @@ int ksu_handle_stat(int *dfd, const char __user **filename_user, int *flags)
 	strncpy_from_user_nofault(path, *filename_user, sizeof(path));
 
     if (unlikely(!memcmp(path, su, sizeof(su)))) {
-        write_sulog('s');
+        write_sulog(KSU_SULOG_STAT, KSU_SULOG_REDIRECTED);
         pr_info("newfstatat su->sh!\n");
         *filename_user = sh_user_path();
     }
@@ -161,7 +162,7 @@ int ksu_handle_execve_sucompat(const char __user **filename_user,
 	if (likely(memcmp(path, su, sizeof(su))))
 		return 0;
 
-    write_sulog('x');
+    write_sulog(KSU_SULOG_EXECVE, KSU_SULOG_GRANTED);
 
     pr_info("sys_execve su found\n");
     *filename_user = ksud_user_path();
@@ -5,8 +5,14 @@
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/irq_work.h>
 #include <linux/slab.h>
 #include <linux/kprobes.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/poll.h>
 #include <linux/syscalls.h>
 #include <linux/module.h>
 #include <linux/sched/signal.h>
@@ -27,34 +33,39 @@
 #include "selinux/selinux.h"
 #include "file_wrapper.h"
 #include "syscall_hook_manager.h"
+#include "hook_backend.h"
+#include "boot_timeline.h"
+#include "status_page.h"
+#include "su_usage.h"
 
 #include "tiny_sulog.c"
 
-// Permission check functions
-bool only_manager(void)
+// Permission check functions, @roles is the caller's KSU_ROLE_* snapshot
+bool only_manager(u32 roles)
 {
-	return is_manager();
+	return roles & KSU_ROLE_MANAGER;
 }
 
-bool only_root(void)
+bool only_root(u32 roles)
 {
-	return current_uid().val == 0;
+	return roles & KSU_ROLE_ROOT;
 }
 
-bool manager_or_root(void)
+bool manager_or_root(u32 roles)
 {
-	return current_uid().val == 0 || is_manager();
+	return roles & (KSU_ROLE_ROOT | KSU_ROLE_MANAGER);
 }
 
-bool always_allow(void)
+bool always_allow(u32 roles)
 {
 	return true; // No permission check
 }
 
-bool allowed_for_su(void)
+bool allowed_for_su(u32 roles)
 {
-    bool is_allowed =
-        is_manager() || ksu_is_allow_uid_for_current(current_uid().val);
+    // the allowlist changes at runtime, so this one can't be cached
+    bool is_allowed = (roles & KSU_ROLE_MANAGER) ||
+                      ksu_is_allow_uid_for_current(current_uid().val);
     return is_allowed;
 }
 
@@ -62,7 +73,7 @@ static int do_grant_root(void __user *arg)
 {
 	// we already check uid above on allowed_for_su()
 
-    write_sulog('i'); // log ioctl escalation
+    write_sulog(KSU_SULOG_IOCTL, KSU_SULOG_GRANTED); // log ioctl escalation
 
     pr_info("allow root for: %d\n", current_uid().val);
     escape_with_root_profile();
@@ -72,17 +83,21 @@ static int do_grant_root(void __user *arg)
 
 static uint32_t ksuver_override = 0;
 
+u32 ksu_get_reported_version(void)
+{
+	u32 version = READ_ONCE(ksuver_override);
+
+	return version ? version : KERNEL_SU_VERSION;
+}
+
 static int do_get_info(void __user *arg)
 {
-    struct ksu_get_info_cmd cmd = { .version = KERNEL_SU_VERSION, .flags = 0 };
+    struct ksu_get_info_cmd cmd = { .version = ksu_get_reported_version(), .flags = 0 };
 
 #ifdef MODULE
 	cmd.flags |= 0x1;
 #endif
 
-	if (ksuver_override)
-	    cmd.version = ksuver_override;
-
 	if (is_manager()) {
 		cmd.flags |= 0x2;
 	}
@@ -146,6 +161,32 @@ static int do_set_sepolicy(void __user *arg)
 	return handle_sepolicy(cmd.cmd, (void __user *)cmd.arg);
 }
 
+static int do_set_sepolicy_batch(void __user *arg)
+{
+	struct ksu_set_sepolicy_batch_cmd cmd;
+	int ret;
+
+	if (copy_from_user(&cmd, arg, sizeof(cmd))) {
+		pr_err("set_sepolicy_batch: copy_from_user failed\n");
+		return -EFAULT;
+	}
+
+	if (cmd.count > KSU_SEPOLICY_BATCH_MAX)
+		return -E2BIG;
+
+	ret = handle_sepolicy_batch((void __user *)cmd.rules, cmd.count,
+				    (s32 __user *)cmd.results, &cmd.failed);
+	if (ret)
+		return ret;
+
+	if (copy_to_user(arg, &cmd, sizeof(cmd))) {
+		pr_err("set_sepolicy_batch: copy_to_user failed\n");
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
 static int do_check_safemode(void __user *arg)
 {
 	struct ksu_check_safemode_cmd cmd;
@@ -355,6 +396,7 @@ static int do_set_app_profile(void __user *arg)
     if (!ret) {
         ksu_persistent_allow_list();
         ksu_mark_running_process();
+        ksu_status_refresh();
     }
     return ret;
 }
@@ -404,9 +446,74 @@ static int do_set_feature(void __user *arg)
 		return ret;
 	}
 
+	// publish before returning so the caller reads back its own write
+	ksu_status_refresh();
+
 	return 0;
 }
 
+static int do_get_all_features(void __user *arg)
+{
+	struct ksu_feature_value values[KSU_FEATURE_LIST_MAX];
+	struct ksu_get_all_features_cmd *cmd;
+	int ret = 0;
+	u32 i;
+
+	cmd = kzalloc(sizeof(*cmd), GFP_KERNEL);
+	if (!cmd)
+		return -ENOMEM;
+
+	cmd->total = ksu_get_all_features(values, ARRAY_SIZE(values));
+	cmd->count = min_t(u32, cmd->total, ARRAY_SIZE(values));
+	for (i = 0; i < cmd->count; i++) {
+		cmd->features[i].id = values[i].id;
+		cmd->features[i].value = values[i].value;
+	}
+
+	if (copy_to_user(arg, cmd, sizeof(*cmd))) {
+		pr_err("get_all_features: copy_to_user failed\n");
+		ret = -EFAULT;
+	}
+
+	kfree(cmd);
+	return ret;
+}
+
+static int do_get_su_usage(void __user *arg)
+{
+	struct ksu_get_su_usage_cmd cmd;
+	int ret;
+
+	if (copy_from_user(&cmd, arg, sizeof(cmd))) {
+		pr_err("get_su_usage: copy_from_user failed\n");
+		return -EFAULT;
+	}
+
+	ret = ksu_su_usage_export(&cmd);
+	if (ret)
+		return ret;
+
+	if (copy_to_user(arg, &cmd, sizeof(cmd))) {
+		pr_err("get_su_usage: copy_to_user failed\n");
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+// Returns the new fd, like GET_WRAPPER_FD
+static int do_sulog_open(void __user *arg)
+{
+	struct ksu_sulog_open_cmd cmd;
+
+	if (copy_from_user(&cmd, arg, sizeof(cmd))) {
+		pr_err("sulog_open: copy_from_user failed\n");
+		return -EFAULT;
+	}
+
+	return sulog_open_fd(cmd.flags);
+}
+
 static int do_get_wrapper_fd(void __user *arg)
 {
     if (!ksu_file_sid) {
@@ -491,7 +598,7 @@ static int do_get_hook_mode(void __user *arg)
 {
 	struct ksu_get_hook_mode_cmd cmd = {0};
 
-	strscpy(cmd.mode, "Kprobes", sizeof(cmd.mode));
+	strscpy(cmd.mode, ksu_hook_mode_name(), sizeof(cmd.mode));
 
 	if (copy_to_user(arg, &cmd, sizeof(cmd))) {
 		pr_err("get_hook_mode: copy_to_user failed\n");
@@ -501,6 +608,48 @@ static int do_get_hook_mode(void __user *arg)
 	return 0;
 }
 
+static int do_hook_benchmark(void __user *arg)
+{
+	struct ksu_hook_benchmark_cmd cmd;
+	struct ksu_hook_bench_result res;
+	int ret;
+
+	if (copy_from_user(&cmd, arg, sizeof(cmd))) {
+		pr_err("hook_benchmark: copy_from_user failed\n");
+		return -EFAULT;
+	}
+
+	ret = ksu_hook_benchmark(cmd.iterations, &res);
+	if (ret)
+		return ret;
+
+	cmd.iterations = res.iterations;
+	cmd.baseline_ns = res.baseline_ns;
+	cmd.kprobe_ns = res.kprobe_ns;
+	cmd.fprobe_ns = res.fprobe_ns;
+
+	if (copy_to_user(arg, &cmd, sizeof(cmd))) {
+		pr_err("hook_benchmark: copy_to_user failed\n");
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+static int do_get_boot_timeline(void __user *arg)
+{
+	struct ksu_get_boot_timeline_cmd cmd = {0};
+
+	cmd.count = ksu_boot_timeline_read(cmd.stamps_ns, KSU_BOOT_TIMELINE_MAX);
+
+	if (copy_to_user(arg, &cmd, sizeof(cmd))) {
+		pr_err("get_boot_timeline: copy_to_user failed\n");
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
 static int do_get_version_tag(void __user *arg)
 {
 	struct ksu_get_version_tag_cmd cmd = {0};
@@ -520,6 +669,8 @@ static int do_get_version_tag(void __user *arg)
  * descriptors (ksu_driver + fdwrapper).  Both have f_op->owner == THIS_MODULE.
  * This is necessary because fdwrapper fds are invisible to userspace (d_dname
  * spoofs the path), so only the kernel can find them.
+ * A status page mapping holds the driver file as well, fd or not, so its
+ * owner is killed too.
  * Skips the calling process (manager) so it can proceed with rmmod.
  */
 static int do_prepare_unload(void __user *arg)
@@ -554,6 +705,8 @@ static int do_prepare_unload(void __user *arg)
 			}
 		}
 		spin_unlock(&files->file_lock);
+		if (!found && task->mm)
+			found = ksu_status_mapped_by(task->mm);
 		task_unlock(task);
 
 		if (found)
@@ -593,78 +746,37 @@ static int do_nuke_ext4_sysfs(void __user *arg)
     return nuke_ext4_sysfs(mnt);
 }
 
-struct list_head mount_list = LIST_HEAD_INIT(mount_list);
-DECLARE_RWSEM(mount_list_lock);
-
 static int add_try_umount(void __user *arg)
 {
-    struct mount_entry *new_entry, *entry, *tmp;
     struct ksu_add_try_umount_cmd cmd;
-    char buf[256] = { 0 };
+    char buf[KSU_UMOUNT_PATH_MAX] = { 0 };
 
     if (copy_from_user(&cmd, arg, sizeof cmd))
         return -EFAULT;
 
     switch (cmd.mode) {
     case KSU_UMOUNT_WIPE: {
-        struct mount_entry *entry, *tmp;
-        down_write(&mount_list_lock);
-        list_for_each_entry_safe (entry, tmp, &mount_list, list) {
-            pr_info("wipe_umount_list: removing entry: %s\n",
-                    entry->umountable);
-            list_del(&entry->list);
-            kfree(entry->umountable);
-            kfree(entry);
-        }
-        up_write(&mount_list_lock);
-
+        pr_info("wipe_umount_list\n");
+        ksu_umount_list_wipe();
         return 0;
     }
 
     case KSU_UMOUNT_ADD: {
-        long len = strncpy_from_user(buf, (const char __user *)cmd.arg, 256);
+        int ret;
+        long len = strncpy_from_user(buf, (const char __user *)cmd.arg,
+                                     sizeof(buf));
         if (len <= 0)
             return -EFAULT;
 
         buf[sizeof(buf) - 1] = '\0';
 
-        new_entry = kzalloc(sizeof(*new_entry), GFP_KERNEL);
-        if (!new_entry)
-            return -ENOMEM;
+        ret = ksu_umount_list_add(buf, cmd.flags);
+        if (ret == -EEXIST)
+            pr_info("cmd_add_try_umount: %s is already here!\n", buf);
+        else if (!ret)
+            pr_info("cmd_add_try_umount: %s added!\n", buf);
 
-        new_entry->umountable = kstrdup(buf, GFP_KERNEL);
-        if (!new_entry->umountable) {
-            kfree(new_entry);
-            return -ENOMEM;
-        }
-
-        down_write(&mount_list_lock);
-
-        // disallow dupes
-        // if this gets too many, we can consider moving this whole task to a kthread
-        list_for_each_entry (entry, &mount_list, list) {
-            if (!strcmp(entry->umountable, buf)) {
-                pr_info("cmd_add_try_umount: %s is already here!\n", buf);
-                up_write(&mount_list_lock);
-                kfree(new_entry->umountable);
-                kfree(new_entry);
-                return -EEXIST;
-            }
-        }
-
-        // now check flags and add
-        // this also serves as a null check
-        if (cmd.flags)
-            new_entry->flags = cmd.flags;
-        else
-            new_entry->flags = 0;
-
-        // debug
-        list_add(&new_entry->list, &mount_list);
-        up_write(&mount_list_lock);
-        pr_info("cmd_add_try_umount: %s added!\n", buf);
-
-        return 0;
+        return ret;
     }
 
     // this is just strcmp'd wipe anyway
@@ -676,19 +788,25 @@ static int add_try_umount(void __user *arg)
 
         buf[sizeof(buf) - 1] = '\0';
 
-        down_write(&mount_list_lock);
-        list_for_each_entry_safe (entry, tmp, &mount_list, list) {
-            if (!strcmp(entry->umountable, buf)) {
-                pr_info("cmd_add_try_umount: entry removed: %s\n",
-                        entry->umountable);
-                list_del(&entry->list);
-                kfree(entry->umountable);
-                kfree(entry);
-            }
-        }
-        up_write(&mount_list_lock);
+        pr_info("cmd_add_try_umount: removing: %s\n", buf);
+        return ksu_umount_list_del(buf);
+    }
 
-        return 0;
+    // one call for the whole list, instead of an ADD per path
+    case KSU_UMOUNT_REPLACE: {
+        void *records;
+        int ret;
+
+        if (cmd.flags > KSU_UMOUNT_REPLACE_MAX)
+            return -E2BIG;
+
+        records = vmemdup_user((const void __user *)cmd.arg, cmd.flags);
+        if (IS_ERR(records))
+            return PTR_ERR(records);
+
+        ret = ksu_umount_list_replace(records, cmd.flags);
+        kvfree(records);
+        return ret;
     }
 
     // this way userspace can deduce the memory it has to prepare.
@@ -697,13 +815,7 @@ static int add_try_umount(void __user *arg)
         if (!cmd.arg)
             return -EFAULT;
         
-        size_t total_size = 0; // size of list in bytes
-
-        down_read(&mount_list_lock);
-        list_for_each_entry(entry, &mount_list, list) {
-            total_size = total_size + strlen(entry->umountable) + 1; // + 1 for \0
-        }
-        up_read(&mount_list_lock);
+        size_t total_size = ksu_umount_list_paths_len(); // size of list in bytes
 
         // debug
         // pr_info("cmd_add_try_umount: total_size: %zu\n", total_size);
@@ -718,30 +830,21 @@ static int add_try_umount(void __user *arg)
     // this way we dont need to redefine the ioctl defs.
     // this also avoids us needing to kmalloc
     // userspace have to send pointer to memory (malloc/alloca) or pointer to a VLA.
+    // unbounded, KSU_UMOUNT_SNAPSHOT is the safe way to read the list.
     case KSU_UMOUNT_GETLIST: {
         // check for pointer first
         if (!cmd.arg)
             return -EFAULT;
             
-        char *user_buf = (char *)cmd.arg;
-
-        down_read(&mount_list_lock);
-        list_for_each_entry(entry, &mount_list, list) {
-
-            //debug
-            //pr_info("cmd_add_try_umount: entry: %s\n", entry->umountable);
-            
-            if (copy_to_user((char __user *)user_buf, entry->umountable, strlen(entry->umountable) + 1 )) {
-                up_read(&mount_list_lock);
-                return -EFAULT;
-            }
+        return ksu_umount_list_copy_paths((char __user *)cmd.arg);
+    }
 
-            // walk it! +1 for null terminator
-            user_buf = user_buf + strlen(entry->umountable) + 1;
-        }
-        up_read(&mount_list_lock);
+    // one bounded copy of a single list generation, paths and flags
+    case KSU_UMOUNT_SNAPSHOT: {
+        if (!cmd.arg)
+            return -EFAULT;
 
-        return 0;
+        return ksu_umount_list_snapshot((void __user *)cmd.arg, cmd.flags);
     }
 
     default: {
@@ -772,6 +875,10 @@ static const struct ksu_ioctl_cmd_map ksu_ioctl_handlers[] = {
       .name = "SET_SEPOLICY",
       .handler = do_set_sepolicy,
       .perm_check = only_root },
+    { .cmd = KSU_IOCTL_SET_SEPOLICY_BATCH,
+      .name = "SET_SEPOLICY_BATCH",
+      .handler = do_set_sepolicy_batch,
+      .perm_check = only_root },
     { .cmd = KSU_IOCTL_CHECK_SAFEMODE,
       .name = "CHECK_SAFEMODE",
       .handler = do_check_safemode,
@@ -820,6 +927,18 @@ static const struct ksu_ioctl_cmd_map ksu_ioctl_handlers[] = {
       .name = "SET_FEATURE",
       .handler = do_set_feature,
       .perm_check = manager_or_root },
+    { .cmd = KSU_IOCTL_GET_ALL_FEATURES,
+      .name = "GET_ALL_FEATURES",
+      .handler = do_get_all_features,
+      .perm_check = manager_or_root },
+    { .cmd = KSU_IOCTL_SULOG_OPEN,
+      .name = "SULOG_OPEN",
+      .handler = do_sulog_open,
+      .perm_check = manager_or_root },
+    { .cmd = KSU_IOCTL_GET_SU_USAGE,
+      .name = "GET_SU_USAGE",
+      .handler = do_get_su_usage,
+      .perm_check = manager_or_root },
     { .cmd = KSU_IOCTL_GET_WRAPPER_FD,
       .name = "GET_WRAPPER_FD",
       .handler = do_get_wrapper_fd,
@@ -836,6 +955,14 @@ static const struct ksu_ioctl_cmd_map ksu_ioctl_handlers[] = {
       .name = "ADD_TRY_UMOUNT",
       .handler = add_try_umount,
       .perm_check = manager_or_root },
+	{ .cmd = KSU_IOCTL_HOOK_BENCHMARK,
+	  .name = "HOOK_BENCHMARK",
+	  .handler = do_hook_benchmark,
+	  .perm_check = only_root },
+	{ .cmd = KSU_IOCTL_GET_BOOT_TIMELINE,
+	  .name = "GET_BOOT_TIMELINE",
+	  .handler = do_get_boot_timeline,
+	  .perm_check = manager_or_root },
 	{ .cmd = KSU_IOCTL_GET_HOOK_MODE,
 	  .name = "GET_HOOK_MODE",
 	  .handler = do_get_hook_mode,
@@ -876,7 +1003,7 @@ static void ksu_install_fd_tw_func(struct callback_head *cb)
 	module_put(THIS_MODULE); /* Release module ref taken before task_work_add */
 }
 
-static int reboot_handler_pre(struct kprobe *p, struct pt_regs *regs)
+static int reboot_handler_pre(struct pt_regs *regs, void *data)
 {
 	struct pt_regs *real_regs = PT_REAL_REGS(regs);
 	int magic1 = (int)PT_REGS_PARM1(real_regs);
@@ -943,6 +1070,7 @@ static int reboot_handler_pre(struct kprobe *p, struct pt_regs *regs)
 
         pr_info("sys_reboot: ksu_change_ksuver to: %d\n", cmd);
         ksuver_override = cmd;
+        ksu_status_changed();
 
         if (copy_to_user((void __user *)arg4, &reply, sizeof(reply) ))
             return 0;
@@ -1025,80 +1153,240 @@ static int reboot_handler_pre(struct kprobe *p, struct pt_regs *regs)
 	return 0;
 }
 
-static struct kprobe reboot_kp = {
-	.symbol_name = REBOOT_SYMBOL,
-	.pre_handler = reboot_handler_pre,
+static struct ksu_hook reboot_hook = {
+	.symbol = REBOOT_SYMBOL,
+	.entry = reboot_handler_pre,
 };
 
 void ksu_supercalls_init(void)
 {
 	int i;
 
+    ksu_ioctl_build_index();
+
     pr_info("KernelSU IOCTL Commands:\n");
     for (i = 0; ksu_ioctl_handlers[i].handler; i++) {
         pr_info("  %-18s = 0x%08x\n", ksu_ioctl_handlers[i].name,
                 ksu_ioctl_handlers[i].cmd);
     }
 
-	int rc = register_kprobe(&reboot_kp);
+	int rc = ksu_hook_register(&reboot_hook);
 	if (rc) {
-		pr_err("reboot kprobe failed: %d\n", rc);
+		pr_err("reboot hook failed: %d\n", rc);
 	} else {
-		pr_info("reboot kprobe registered successfully\n");
+		pr_info("reboot hook registered successfully\n");
 	}
 
+    ksu_su_usage_init();
     sulog_init_heap(); // grab heap memory
 }
 
 void ksu_supercalls_exit(void)
 {
-    struct mount_entry *entry, *tmp;
+    ksu_hook_unregister(&reboot_hook);
+    sulog_exit_heap();
+    ksu_su_usage_exit();
+}
 
-    unregister_kprobe(&reboot_kp);
+// IOCTL dispatcher
+/*
+ * Handlers indexed by _IOC_NR. A few numbers carry both a legacy and a new
+ * encoding (e.g. GET_ALLOW_LIST), so slots chain to the next entry with the
+ * same number; no chain is longer than two.
+ */
+#define KSU_IOCTL_NR_MAX 128
 
-    /* Free mount_list entries */
-    down_write(&mount_list_lock);
-    list_for_each_entry_safe(entry, tmp, &mount_list, list) {
-        list_del(&entry->list);
-        kfree(entry->umountable);
-        kfree(entry);
-    }
-    up_write(&mount_list_lock);
+static s8 ksu_ioctl_index[KSU_IOCTL_NR_MAX];
+static s8 ksu_ioctl_next[ARRAY_SIZE(ksu_ioctl_handlers)];
+
+static void ksu_ioctl_build_index(void)
+{
+	int i;
+
+	BUILD_BUG_ON(ARRAY_SIZE(ksu_ioctl_handlers) > S8_MAX);
+	memset(ksu_ioctl_index, -1, sizeof(ksu_ioctl_index));
+	// walk backwards so each chain keeps table order
+	for (i = ARRAY_SIZE(ksu_ioctl_handlers) - 1; i >= 0; i--) {
+		unsigned int nr = _IOC_NR(ksu_ioctl_handlers[i].cmd);
+
+		if (!ksu_ioctl_handlers[i].handler)
+			continue;
+		if (WARN_ON(nr >= KSU_IOCTL_NR_MAX))
+			continue;
+		ksu_ioctl_next[i] = ksu_ioctl_index[nr];
+		ksu_ioctl_index[nr] = i;
+	}
+}
+
+static const struct ksu_ioctl_cmd_map *ksu_ioctl_lookup(unsigned int cmd)
+{
+	unsigned int nr = _IOC_NR(cmd);
+	int i;
+
+	if (_IOC_TYPE(cmd) != 'K' || nr >= KSU_IOCTL_NR_MAX)
+		return NULL;
+
+	for (i = ksu_ioctl_index[nr]; i >= 0; i = ksu_ioctl_next[i]) {
+		if (ksu_ioctl_handlers[i].cmd == cmd)
+			return &ksu_ioctl_handlers[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Per-fd caller snapshot, stored in filp->private_data. uid, manager
+ * generation and roles are packed into one word so a reader never pairs
+ * one caller's uid with another caller's roles.
+ */
+struct ksu_fd_ctx {
+	atomic64_t snap;
+};
+
+#define KSU_SNAP_ROLE_BITS 2
+#define KSU_SNAP_ROLE_MASK ((1U << KSU_SNAP_ROLE_BITS) - 1)
+#define KSU_SNAP_GEN_MASK ((1ULL << (32 - KSU_SNAP_ROLE_BITS)) - 1)
+
+static u64 ksu_make_snap(uid_t uid, unsigned int gen, u32 roles)
+{
+	return ((u64)uid << 32) |
+	       (((u64)gen & KSU_SNAP_GEN_MASK) << KSU_SNAP_ROLE_BITS) | roles;
+}
+
+static u64 ksu_current_snap(uid_t uid, unsigned int gen)
+{
+	u32 roles = 0;
+
+	smp_rmb(); // pairs with ksu_set_manager_appid()
+	if (uid == 0)
+		roles |= KSU_ROLE_ROOT;
+	if (is_uid_manager(uid))
+		roles |= KSU_ROLE_MANAGER;
+
+	return ksu_make_snap(uid, gen, roles);
+}
+
+/*
+ * The fd may be inherited across fork and setuid, so the snapshot is only
+ * trusted while the caller's uid and the manager generation still match.
+ */
+static u32 ksu_fd_roles(struct file *filp)
+{
+	struct ksu_fd_ctx *ctx = filp->private_data;
+	uid_t uid = current_uid().val;
+	unsigned int gen = ksu_get_manager_gen();
+	u64 snap;
+
+	if (likely(ctx)) {
+		snap = atomic64_read(&ctx->snap);
+		if (likely((snap & ~(u64)KSU_SNAP_ROLE_MASK) ==
+			   ksu_make_snap(uid, gen, 0)))
+			return snap & KSU_SNAP_ROLE_MASK;
+	}
+
+	snap = ksu_current_snap(uid, gen);
+	if (ctx)
+		atomic64_set(&ctx->snap, snap);
+
+	return snap & KSU_SNAP_ROLE_MASK;
+}
+
+static long ksu_ioctl_dispatch(u32 roles, unsigned int cmd,
+			       void __user *argp)
+{
+	const struct ksu_ioctl_cmd_map *map = ksu_ioctl_lookup(cmd);
+
+	if (!map) {
+		pr_warn("ksu ioctl: unsupported command 0x%x\n", cmd);
+		return -ENOTTY;
+	}
+
+	// Check permission first
+	if (map->perm_check && !map->perm_check(roles)) {
+		pr_warn("ksu ioctl: permission denied for cmd=0x%x uid=%d\n",
+			cmd, current_uid().val);
+		if (cmd == KSU_IOCTL_GRANT_ROOT)
+			write_sulog(KSU_SULOG_IOCTL, KSU_SULOG_DENIED);
+		return -EPERM;
+	}
+
+	// Execute handler
+	return map->handler(argp);
+}
+
+/*
+ * Run several commands in one syscall. Each entry goes through the same
+ * lookup and permission check as a standalone ioctl; its return value is
+ * written back to the entry and a failing entry doesn't stop the rest.
+ */
+static long ksu_ioctl_batch(u32 roles, void __user *argp)
+{
+	struct ksu_batch_entry entries[KSU_BATCH_MAX];
+	struct ksu_batch_cmd cmd;
+	void __user *uentries;
+	u32 i;
+
+	if (copy_from_user(&cmd, argp, sizeof(cmd))) {
+		pr_err("batch: copy_from_user failed\n");
+		return -EFAULT;
+	}
+
+	if (!cmd.count || cmd.count > KSU_BATCH_MAX)
+		return -EINVAL;
+
+	uentries = (void __user *)cmd.entries;
+	if (copy_from_user(entries, uentries, cmd.count * sizeof(entries[0]))) {
+		pr_err("batch: copy entries failed\n");
+		return -EFAULT;
+	}
+
+	for (i = 0; i < cmd.count; i++) {
+		if (entries[i].cmd == KSU_IOCTL_BATCH) {
+			entries[i].result = -EINVAL;
+			continue;
+		}
+		entries[i].result = ksu_ioctl_dispatch(
+			roles, entries[i].cmd, (void __user *)entries[i].arg);
+	}
+
+	if (copy_to_user(uentries, entries, cmd.count * sizeof(entries[0]))) {
+		pr_err("batch: copy results failed\n");
+		return -EFAULT;
+	}
+
+	return 0;
 }
 
-// IOCTL dispatcher
 static long anon_ksu_ioctl(struct file *filp, unsigned int cmd,
                            unsigned long arg)
 {
 	void __user *argp = (void __user *)arg;
-	int i;
+	u32 roles = ksu_fd_roles(filp);
 
 #ifdef CONFIG_KSU_DEBUG
 	pr_info("ksu ioctl: cmd=0x%x from uid=%d\n", cmd, current_uid().val);
 #endif
 
-    for (i = 0; ksu_ioctl_handlers[i].handler; i++) {
-        if (cmd == ksu_ioctl_handlers[i].cmd) {
-            // Check permission first
-            if (ksu_ioctl_handlers[i].perm_check &&
-                !ksu_ioctl_handlers[i].perm_check()) {
-                pr_warn("ksu ioctl: permission denied for cmd=0x%x uid=%d\n",
-                        cmd, current_uid().val);
-                return -EPERM;
-            }
-            // Execute handler
-            return ksu_ioctl_handlers[i].handler(argp);
-        }
-    }
+	// open to every fd holder, each entry is checked on its own
+	if (cmd == KSU_IOCTL_BATCH)
+		return ksu_ioctl_batch(roles, argp);
 
-	pr_warn("ksu ioctl: unsupported command 0x%x\n", cmd);
-	return -ENOTTY;
+	return ksu_ioctl_dispatch(roles, cmd, argp);
+}
+
+static int anon_ksu_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	if (!manager_or_root(ksu_fd_roles(filp)))
+		return -EPERM;
+
+	return ksu_status_mmap(vma);
 }
 
 // File release handler
 static int anon_ksu_release(struct inode *inode, struct file *filp)
 {
 	pr_info("ksu fd released\n");
+	kfree(filp->private_data);
 	return 0;
 }
 
@@ -1107,12 +1395,14 @@ static const struct file_operations anon_ksu_fops = {
 	.owner = THIS_MODULE,
 	.unlocked_ioctl = anon_ksu_ioctl,
 	.compat_ioctl = anon_ksu_ioctl,
+	.mmap = anon_ksu_mmap,
 	.release = anon_ksu_release,
 };
 
 // Install KSU fd to current process
 int ksu_install_fd(void)
 {
+	struct ksu_fd_ctx *ctx;
 	struct file *filp;
 	int fd;
 
@@ -1123,11 +1413,20 @@ int ksu_install_fd(void)
 		return fd;
 	}
 
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx) {
+		put_unused_fd(fd);
+		return -ENOMEM;
+	}
+	atomic64_set(&ctx->snap, ksu_current_snap(current_uid().val,
+						 ksu_get_manager_gen()));
+
     // Create anonymous inode file
-    filp = anon_inode_getfile("[ksu_driver]", &anon_ksu_fops, NULL,
+    filp = anon_inode_getfile("[ksu_driver]", &anon_ksu_fops, ctx,
                               O_RDWR | O_CLOEXEC);
     if (IS_ERR(filp)) {
         pr_err("ksu_install_fd: failed to create anon inode file\n");
+        kfree(ctx);
         put_unused_fd(fd);
         return PTR_ERR(filp);
     }
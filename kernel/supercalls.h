@@ -38,6 +38,15 @@ struct ksu_set_sepolicy_cmd {
 	__aligned_u64 arg; // Input: sepolicy argument pointer
 };
 
+#define KSU_SEPOLICY_BATCH_MAX 1024
+
+struct ksu_set_sepolicy_batch_cmd {
+	__u32 count; // Input: number of rules, at most KSU_SEPOLICY_BATCH_MAX
+	__u32 failed; // Output: number of rules that failed
+	__aligned_u64 rules; // Input: array of rules, each what SET_SEPOLICY's arg points to
+	__aligned_u64 results; // Output: optional __s32 array, 0 or the error of each rule
+};
+
 struct ksu_check_safemode_cmd {
 	__u8 in_safe_mode; // Output: true if in safe mode, false otherwise
 };
@@ -107,6 +116,13 @@ struct ksu_get_version_tag_cmd {
 	char tag[32];
 };
 
+struct ksu_hook_benchmark_cmd {
+	__u32 iterations; // Input/Output: calls per backend, 0 for default
+	__u64 baseline_ns; // Output: unhooked loop time
+	__u64 kprobe_ns; // Output: loop time under kprobe, 0 if unavailable
+	__u64 fprobe_ns; // Output: loop time under fprobe, 0 if unavailable
+};
+
 #define KSU_MARK_GET 1
 #define KSU_MARK_MARK 2
 #define KSU_MARK_UNMARK 3
@@ -119,12 +135,150 @@ struct ksu_nuke_ext4_sysfs_cmd {
 struct ksu_add_try_umount_cmd {
     __aligned_u64 arg; // char ptr, this is the mountpoint
     __u32 flags; // this is the flag we use for it
-    __u8 mode; // denotes what to do with it 0:wipe_list 1:add_to_list 2:delete_entry
+    __u8 mode; // denotes what to do with it 0:wipe_list 1:add_to_list 2:delete_entry 3:replace_list 4:snapshot
+};
+
+#define KSU_UMOUNT_PATH_MAX 256 // including the NUL
+#define KSU_UMOUNT_REPLACE_MAX (256 * 1024)
+
+// KSU_UMOUNT_REPLACE input, records follow each other without padding
+struct ksu_umount_record {
+    __u32 flags;
+    __u32 len; // bytes in path, including the NUL
+    char path[];
+};
+
+// KSU_UMOUNT_SNAPSHOT output, the ksu_umount_record stream follows it.
+// A buffer smaller than total_len gets only this header and -ENOSPC.
+struct ksu_umount_snapshot {
+    __u32 total_len; // bytes needed for the header and every record
+    __u32 count; // records in the stream
+};
+
+// su log record types, also the legacy GET_SULOG_DUMP_V2 symbols
+#define KSU_SULOG_FACCESSAT 'a'
+#define KSU_SULOG_STAT 's'
+#define KSU_SULOG_EXECVE 'x'
+#define KSU_SULOG_IOCTL 'i'
+
+// su log outcomes
+#define KSU_SULOG_REDIRECTED 1 // su path swapped for sh
+#define KSU_SULOG_GRANTED 2 // caller escalated to root
+#define KSU_SULOG_DENIED 3 // escalation refused
+
+struct ksu_sulog_record {
+    __u64 seq; // global event number, starts at 1
+    __u64 ts_ns; // CLOCK_BOOTTIME
+    __u32 uid;
+    __u32 pid; // tgid of the caller
+    char comm[16];
+    __u8 type; // KSU_SULOG_FACCESSAT...
+    __u8 outcome; // KSU_SULOG_REDIRECTED...
+    __u8 reserved[6];
+};
+
+#define KSU_SULOG_FROM_START (1 << 0) // replay the records still held first
+
+// KSU_IOCTL_SULOG_OPEN returns a read-only fd streaming struct ksu_sulog_record
+struct ksu_sulog_open_cmd {
+    __u32 flags; // Input: KSU_SULOG_FROM_START
+};
+
+#define KSU_SU_USAGE_MAX 512 // uids the kernel tracks at once
+#define KSU_SU_USAGE_RESET (1 << 0) // start a new table after this read
+
+// Events per uid since boot or the last reset, non-denied ones by sulog type
+struct ksu_su_usage_entry {
+    __u32 uid;
+    __u32 faccessat;
+    __u32 stat;
+    __u32 execve;
+    __u32 ioctl; // root granted over the ioctl
+    __u32 denied; // root refused over the ioctl
+    __u64 last_ns; // CLOCK_BOOTTIME of the latest event
+};
+
+struct ksu_get_su_usage_cmd {
+    __aligned_u64 entries; // Input: struct ksu_su_usage_entry array, newest first
+    __u32 count; // Input: array capacity; Output: entries written
+    __u32 total; // Output: uids in the table, above count if truncated
+    __u32 dropped; // Output: events not counted because the table was full
+    __u32 flags; // Input: KSU_SU_USAGE_RESET
+};
+
+#define KSU_BOOT_TIMELINE_MAX 16
+
+struct ksu_get_boot_timeline_cmd {
+	__u32 count; // Output: number of valid entries in stamps_ns
+	__u64 stamps_ns[KSU_BOOT_TIMELINE_MAX]; // Output: CLOCK_BOOTTIME per milestone, 0 if not reached
+};
+
+#define KSU_FEATURE_LIST_MAX 16
+
+struct ksu_feature_entry {
+	__u32 id; // enum ksu_feature_id
+	__u32 reserved;
+	__u64 value;
+};
+
+struct ksu_get_all_features_cmd {
+	__u32 count; // Output: number of valid entries in features
+	__u32 total; // Output: supported features, above count if truncated
+	struct ksu_feature_entry features[KSU_FEATURE_LIST_MAX];
+};
+
+#define KSU_BATCH_MAX 16
+
+struct ksu_batch_entry {
+	__u32 cmd; // Input: any KSU_IOCTL_* except KSU_IOCTL_BATCH
+	__s32 result; // Output: return value of that command
+	__aligned_u64 arg; // Input: argument pointer for that command
+};
+
+struct ksu_batch_cmd {
+	__u32 count; // Input: number of entries, at most KSU_BATCH_MAX
+	__u32 reserved;
+	__aligned_u64 entries; // Input: pointer to struct ksu_batch_entry array
+};
+
+/*
+ * Read-only page mapped by mmap() on the ksu driver fd. The kernel bumps
+ * seq to odd before an update and back to even after it, so readers copy
+ * the page and retry while seq is odd or changed under them.
+ */
+#define KSU_STATUS_MAGIC 0x5355534b // "KSUS"
+#define KSU_STATUS_FEATURE_MAX 8
+
+struct ksu_status_feature {
+	__u32 id; // enum ksu_feature_id
+	__u32 supported;
+	__u64 value;
+};
+
+struct ksu_status_page {
+	__u32 seq;
+	__u32 magic; // KSU_STATUS_MAGIC once the page is populated
+	__u32 size; // sizeof(struct ksu_status_page) of the kernel
+	__u32 version; // same as ksu_get_info_cmd.version
+	__u32 flags; // bit 0: MODULE mode; the per-caller manager bit is never set
+	__u32 manager_appid;
+	__u32 manager_gen; // bumped on every manager change
+	__u32 allow_count; // allowlist entries granted root, manager excluded
+	__u32 deny_count;
+	__u8 safe_mode;
+	__u8 reserved[3];
+	char hook_mode[16];
+	char version_tag[32];
+	__u32 feature_count;
+	__u32 reserved2;
+	struct ksu_status_feature features[KSU_STATUS_FEATURE_MAX];
 };
 
 #define KSU_UMOUNT_WIPE 0 // ignore everything and wipe list
 #define KSU_UMOUNT_ADD 1 // add entry (path + flags)
 #define KSU_UMOUNT_DEL 2 // delete entry, strcmp
+#define KSU_UMOUNT_REPLACE 3 // arg: ksu_umount_record stream, flags: its size
+#define KSU_UMOUNT_SNAPSHOT 4 // arg: ksu_umount_snapshot buffer, flags: its size
 
 // IOCTL command definitions
 #define KSU_IOCTL_GRANT_ROOT _IOC(_IOC_NONE, 'K', 1, 0)
@@ -151,13 +305,24 @@ struct ksu_add_try_umount_cmd {
 #define KSU_IOCTL_MANAGE_MARK _IOC(_IOC_READ | _IOC_WRITE, 'K', 16, 0)
 #define KSU_IOCTL_NUKE_EXT4_SYSFS _IOC(_IOC_WRITE, 'K', 17, 0)
 #define KSU_IOCTL_ADD_TRY_UMOUNT _IOC(_IOC_WRITE, 'K', 18, 0)
+#define KSU_IOCTL_HOOK_BENCHMARK _IOC(_IOC_READ | _IOC_WRITE, 'K', 19, 0)
+#define KSU_IOCTL_GET_BOOT_TIMELINE _IOC(_IOC_READ, 'K', 20, 0)
+#define KSU_IOCTL_BATCH _IOC(_IOC_READ | _IOC_WRITE, 'K', 21, 0)
+#define KSU_IOCTL_GET_ALL_FEATURES _IOC(_IOC_READ, 'K', 22, 0)
+#define KSU_IOCTL_SULOG_OPEN _IOC(_IOC_WRITE, 'K', 23, 0)
+#define KSU_IOCTL_GET_SU_USAGE _IOC(_IOC_READ | _IOC_WRITE, 'K', 24, 0)
+#define KSU_IOCTL_SET_SEPOLICY_BATCH _IOC(_IOC_READ | _IOC_WRITE, 'K', 25, 0)
 #define KSU_IOCTL_GET_HOOK_MODE _IOC(_IOC_READ, 'K', 98, 0)
 #define KSU_IOCTL_GET_VERSION_TAG _IOC(_IOC_READ, 'K', 99, 0)
 #define KSU_IOCTL_PREPARE_UNLOAD _IOC(_IOC_NONE, 'K', 100, 0) /* Kill all KSU fd holders for rmmod */
 
+// Caller roles, snapshotted per fd
+#define KSU_ROLE_ROOT (1 << 0)
+#define KSU_ROLE_MANAGER (1 << 1)
+
 // IOCTL handler types
 typedef int (*ksu_ioctl_handler_t)(void __user *arg);
-typedef bool (*ksu_perm_check_t)(void);
+typedef bool (*ksu_perm_check_t)(u32 roles);
 
 // IOCTL command mapping
 struct ksu_ioctl_cmd_map {
@@ -170,6 +335,9 @@ struct ksu_ioctl_cmd_map {
 // Install KSU fd to current process
 int ksu_install_fd(void);
 
+// Version reported to userspace, honours CHANGE_KSUVER
+u32 ksu_get_reported_version(void);
+
 void ksu_supercalls_init(void);
 void ksu_supercalls_exit(void);
 #endif // __KSU_H_SUPERCALLS
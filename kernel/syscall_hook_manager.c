@@ -19,6 +19,7 @@
 #include "selinux/selinux.h"
 #include "util.h"
 #include "ksud.h"
+#include "hook_backend.h"
 
 // Tracepoint registration count management
 // == 1: just us
@@ -162,40 +163,7 @@ int ksu_set_task_mark(pid_t pid, bool mark)
 
 #ifdef CONFIG_KRETPROBES
 
-static struct kretprobe *init_kretprobe(const char *name,
-                                        kretprobe_handler_t handler)
-{
-    struct kretprobe *rp = kzalloc(sizeof(struct kretprobe), GFP_KERNEL);
-    if (!rp)
-        return NULL;
-    rp->kp.symbol_name = name;
-    rp->handler = handler;
-    rp->data_size = 0;
-    rp->maxactive = 0;
-
-    int ret = register_kretprobe(rp);
-    pr_info("hook_manager: register_%s kretprobe: %d\n", name, ret);
-    if (ret) {
-        kfree(rp);
-        return NULL;
-    }
-
-    return rp;
-}
-
-static void destroy_kretprobe(struct kretprobe **rp_ptr)
-{
-    struct kretprobe *rp = *rp_ptr;
-    if (!rp)
-        return;
-    unregister_kretprobe(rp);
-    synchronize_rcu();
-    kfree(rp);
-    *rp_ptr = NULL;
-}
-
-static int syscall_regfunc_handler(struct kretprobe_instance *ri,
-                                   struct pt_regs *regs)
+static void syscall_regfunc_handler(struct pt_regs *regs, void *data)
 {
     unsigned long flags;
     spin_lock_irqsave(&tracepoint_reg_lock, flags);
@@ -208,11 +176,9 @@ static int syscall_regfunc_handler(struct kretprobe_instance *ri,
     }
     tracepoint_reg_count++;
     spin_unlock_irqrestore(&tracepoint_reg_lock, flags);
-    return 0;
 }
 
-static int syscall_unregfunc_handler(struct kretprobe_instance *ri,
-                                     struct pt_regs *regs)
+static void syscall_unregfunc_handler(struct pt_regs *regs, void *data)
 {
     unsigned long flags;
     spin_lock_irqsave(&tracepoint_reg_lock, flags);
@@ -225,11 +191,17 @@ static int syscall_unregfunc_handler(struct kretprobe_instance *ri,
         ksu_mark_running_process_locked();
     }
     spin_unlock_irqrestore(&tracepoint_reg_lock, flags);
-    return 0;
 }
 
-static struct kretprobe *syscall_regfunc_rp = NULL;
-static struct kretprobe *syscall_unregfunc_rp = NULL;
+static struct ksu_hook syscall_regfunc_hook = {
+    .symbol = "syscall_regfunc",
+    .exit = syscall_regfunc_handler,
+};
+
+static struct ksu_hook syscall_unregfunc_hook = {
+    .symbol = "syscall_unregfunc",
+    .exit = syscall_unregfunc_handler,
+};
 #endif
 
 static inline bool check_syscall_fastpath(int nr)
@@ -336,12 +308,11 @@ void ksu_syscall_hook_manager_init(void)
     pr_info("hook_manager: ksu_hook_manager_init called\n");
 
 #ifdef CONFIG_KRETPROBES
-    // Register kretprobe for syscall_regfunc
-    syscall_regfunc_rp =
-        init_kretprobe("syscall_regfunc", syscall_regfunc_handler);
-    // Register kretprobe for syscall_unregfunc
-    syscall_unregfunc_rp =
-        init_kretprobe("syscall_unregfunc", syscall_unregfunc_handler);
+    // Register return hooks for syscall_regfunc/syscall_unregfunc
+    ret = ksu_hook_register(&syscall_regfunc_hook);
+    pr_info("hook_manager: register syscall_regfunc hook: %d\n", ret);
+    ret = ksu_hook_register(&syscall_unregfunc_hook);
+    pr_info("hook_manager: register syscall_unregfunc hook: %d\n", ret);
 #endif
 
 #ifdef CONFIG_HAVE_SYSCALL_TRACEPOINTS
@@ -373,8 +344,8 @@ void ksu_syscall_hook_manager_exit(void)
 #endif
 
 #ifdef CONFIG_KRETPROBES
-    destroy_kretprobe(&syscall_regfunc_rp);
-    destroy_kretprobe(&syscall_unregfunc_rp);
+    ksu_hook_unregister(&syscall_regfunc_hook);
+    ksu_hook_unregister(&syscall_unregfunc_hook);
 #endif
 
     ksu_sucompat_exit();
@@ -1,31 +1,65 @@
 
 #include <linux/err.h>
 #include <linux/fs.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/namei.h>
+#include <linux/sched/task.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/stat.h>
 #include <linux/string.h>
+#include <linux/task_work.h>
 #include <linux/types.h>
 #include <linux/version.h>
+#include <linux/workqueue.h>
 
 #include "allowlist.h"
 #include "apk_sign.h"
 #include "klog.h" // IWYU pragma: keep
 #include "manager.h"
 #include "throne_tracker.h"
+#include "boot_timeline.h"
+
+#include "packages_list.c"
 
 uid_t ksu_manager_appid = KSU_INVALID_APPID;
+unsigned int ksu_manager_gen;
 
 #define SYSTEM_PACKAGES_LIST_PATH "/data/system/packages.list"
 
-struct uid_data {
-	struct list_head list;
-	u32 uid;
-	char package[KSU_MAX_PACKAGE_NAME];
-};
+/*
+ * packages.list is rewritten (and renamed over) on every install, so a burst
+ * of installs fires a burst of events. The observer only queues this work;
+ * the first event of a burst arms it and later ones within the window find
+ * it pending, so each window costs one parse.
+ */
+static unsigned int throne_debounce_ms = 500;
+module_param(throne_debounce_ms, uint, 0);
+MODULE_PARM_DESC(throne_debounce_ms, "delay before packages.list is parsed after a change");
 
-static void crown_manager(const char *apk, struct list_head *uid_data)
+static struct workqueue_struct *throne_wq;
+static DEFINE_SPINLOCK(throne_wq_lock); // guards throne_wq against exit
+static struct delayed_work throne_work;
+static bool throne_inline; // set if the workqueue could not be allocated
+
+// Serializes track_throne() callers (the debounced work, ksud at boot
+// completion) and everything they cache between runs
+static DEFINE_MUTEX(throne_mutex);
+
+static void crown_manager(const char *apk, struct package_map *map)
 {
 	char pkg[KSU_MAX_PACKAGE_NAME];
+	struct package_entry *e;
+
 	if (get_pkg_from_apk_path(pkg, apk) < 0) {
 		pr_err("Failed to get package name from apk path: %s\n", apk);
 		return;
@@ -33,15 +67,11 @@ static void crown_manager(const char *apk, struct list_head *uid_data)
 
 	pr_info("manager pkg: %s\n", pkg);
 
-	struct list_head *list = (struct list_head *)uid_data;
-	struct uid_data *np;
-
-	list_for_each_entry (np, list, list) {
-		if (strncmp(np->package, pkg, KSU_MAX_PACKAGE_NAME) == 0) {
-			pr_info("Crowning manager: %s(uid=%d)\n", pkg, np->uid);
-			ksu_set_manager_appid(np->uid);
-			break;
-		}
+	e = package_map_find(map, KSU_INVALID_APPID, pkg);
+	if (e) {
+		pr_info("Crowning manager: %s(uid=%d)\n", pkg, e->uid);
+		ksu_set_manager_appid(e->uid);
+		ksu_boot_mark(KSU_BOOT_MANAGER_CROWNED);
 	}
 }
 
@@ -53,21 +83,279 @@ struct data_path {
 	struct list_head list;
 };
 
-struct apk_path_hash {
-	unsigned int hash;
-	bool exists;
-	struct list_head list;
+/*
+ * APKs already known not to be the manager, keyed by what changes whenever
+ * the file does. Positive verdicts are not cached: the manager is verified
+ * once per search anyway and a stale "yes" would crown the wrong app.
+ * Neither are failed checks, a read or allocation error says nothing about
+ * the APK and caching it would lock the manager out until it is updated.
+ * The table is saved to APK_VERDICT_PATH after a search changes it and
+ * loaded at post-fs-data, so a cold boot only hashes new or updated APKs.
+ * Guarded by throne_mutex.
+ */
+#define APK_VERDICT_PATH "/data/adb/ksu/.apk_verdicts"
+#define APK_VERDICT_MAGIC 0x4155534b // "KSUA"
+#define APK_VERDICT_VERSION 2
+#define APK_VERDICT_MAX 4096
+
+struct apk_verdict_key {
+	u64 ino;
+	s64 mtime_ns;
+	u64 size;
+	u32 dev;
+	u32 reserved;
+};
+
+struct apk_verdict {
+	struct hlist_node node;
+	struct apk_verdict_key key;
+	bool seen; // met by the current search
+};
+
+// on-disk header, then hint_len bytes of manager_hint, then count keys
+struct apk_verdict_header {
+	u32 magic;
+	u32 version;
+	u32 salt; // the expected manager, verdicts of another build don't apply
+	u32 count;
+	u32 hint_len;
+	u32 reserved;
 };
 
-static struct list_head apk_path_hash_list = LIST_HEAD_INIT(apk_path_hash_list);
+static DEFINE_HASHTABLE(apk_verdicts, 8);
+static u32 apk_verdict_count;
+static bool apk_verdicts_dirty;
+
+// base.apk the manager was last crowned from, tried before any scan
+static char manager_hint[DATA_PATH_LEN];
+
+static u32 apk_verdict_salt(void)
+{
+	u32 salt = EXPECTED_MANAGER_SIZE;
+
+	salt ^= full_name_hash(NULL, EXPECTED_MANAGER_HASH,
+			       strlen(EXPECTED_MANAGER_HASH));
+#ifdef KSU_MANAGER_PACKAGE
+	salt ^= full_name_hash(NULL, KSU_MANAGER_PACKAGE,
+			       strlen(KSU_MANAGER_PACKAGE));
+#endif
+	return salt;
+}
+
+static u32 apk_verdict_hash(const struct apk_verdict_key *key)
+{
+	return jhash2((const u32 *)key, sizeof(*key) / sizeof(u32), 0);
+}
+
+static int apk_verdict_key_of(const char *path, struct apk_verdict_key *key)
+{
+	struct path kpath;
+	struct kstat st;
+	int ret;
+
+	ret = kern_path(path, 0, &kpath);
+	if (ret)
+		return ret;
+
+	ret = vfs_getattr(&kpath, &st, STATX_INO | STATX_SIZE | STATX_MTIME,
+			  AT_STATX_SYNC_AS_STAT);
+	path_put(&kpath);
+	if (ret)
+		return ret;
+
+	memset(key, 0, sizeof(*key));
+	key->ino = st.ino;
+	key->mtime_ns = timespec64_to_ns(&st.mtime);
+	key->size = st.size;
+	key->dev = st.dev;
+	return 0;
+}
+
+static struct apk_verdict *apk_verdict_find(const struct apk_verdict_key *key)
+{
+	struct apk_verdict *v;
+
+	hash_for_each_possible (apk_verdicts, v, node, apk_verdict_hash(key)) {
+		if (!memcmp(&v->key, key, sizeof(*key)))
+			return v;
+	}
+	return NULL;
+}
+
+static void apk_verdict_add(const struct apk_verdict_key *key)
+{
+	struct apk_verdict *v;
+
+	if (apk_verdict_count >= APK_VERDICT_MAX || apk_verdict_find(key))
+		return;
+
+	v = kzalloc(sizeof(*v), GFP_KERNEL);
+	if (!v)
+		return;
+
+	v->key = *key;
+	v->seen = true;
+	hash_add(apk_verdicts, &v->node, apk_verdict_hash(key));
+	apk_verdict_count++;
+	apk_verdicts_dirty = true;
+}
+
+static void apk_verdict_del(struct apk_verdict *v)
+{
+	hash_del(&v->node);
+	kfree(v);
+	apk_verdict_count--;
+	apk_verdicts_dirty = true;
+}
+
+static void apk_verdicts_clear(void)
+{
+	struct apk_verdict *v;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe (apk_verdicts, bkt, tmp, v, node)
+		apk_verdict_del(v);
+	apk_verdicts_dirty = false;
+}
+
+// Runs on init, like the allowlist save, so the file gets init's context
+static void do_save_apk_verdicts(struct callback_head *cb)
+{
+	struct apk_verdict_header hdr = {
+		.magic = APK_VERDICT_MAGIC,
+		.version = APK_VERDICT_VERSION,
+		.salt = apk_verdict_salt(),
+	};
+	struct apk_verdict_key *keys = NULL;
+	char hint[DATA_PATH_LEN];
+	struct apk_verdict *v;
+	struct file *fp;
+	loff_t off = 0;
+	size_t len;
+	int bkt;
+
+	kfree(cb);
+
+	mutex_lock(&throne_mutex);
+	keys = kvmalloc_array(max_t(u32, apk_verdict_count, 1), sizeof(*keys),
+			      GFP_KERNEL);
+	if (keys) {
+		hash_for_each (apk_verdicts, bkt, v, node)
+			keys[hdr.count++] = v->key;
+	}
+	hdr.hint_len = strscpy(hint, manager_hint, sizeof(hint));
+	mutex_unlock(&throne_mutex);
+
+	if (!keys) {
+		pr_err("save_apk_verdicts: alloc failed\n");
+		goto out;
+	}
+
+	fp = filp_open(APK_VERDICT_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (IS_ERR(fp)) {
+		pr_err("save_apk_verdicts: open failed: %ld\n", PTR_ERR(fp));
+		goto out;
+	}
+
+	len = (size_t)hdr.count * sizeof(*keys);
+	if (kernel_write(fp, &hdr, sizeof(hdr), &off) != sizeof(hdr) ||
+	    kernel_write(fp, hint, hdr.hint_len, &off) != hdr.hint_len ||
+	    kernel_write(fp, keys, len, &off) != len)
+		pr_err("save_apk_verdicts: write failed\n");
+	filp_close(fp, 0);
+
+out:
+	kvfree(keys);
+	module_put(THIS_MODULE); /* taken before task_work_add */
+}
+
+static void save_apk_verdicts(void)
+{
+	struct callback_head *cb;
+	struct task_struct *tsk;
+
+	tsk = get_pid_task(find_vpid(1), PIDTYPE_PID);
+	if (!tsk)
+		return;
+
+	cb = kzalloc(sizeof(*cb), GFP_KERNEL);
+	if (!cb)
+		goto put_task;
+	if (!try_module_get(THIS_MODULE)) {
+		kfree(cb);
+		goto put_task;
+	}
+
+	cb->func = do_save_apk_verdicts;
+	if (task_work_add(tsk, cb, TWA_RESUME)) {
+		module_put(THIS_MODULE);
+		kfree(cb);
+		pr_warn("save_apk_verdicts: task_work_add failed\n");
+	}
+
+put_task:
+	put_task_struct(tsk);
+}
+
+void ksu_throne_tracker_load_cache(void)
+{
+	struct apk_verdict_header hdr;
+	struct apk_verdict_key *keys;
+	char hint[DATA_PATH_LEN];
+	struct file *fp;
+	loff_t off = 0;
+	size_t len;
+	u32 i;
+
+	fp = filp_open(APK_VERDICT_PATH, O_RDONLY, 0);
+	if (IS_ERR(fp))
+		return;
+
+	if (kernel_read(fp, &hdr, sizeof(hdr), &off) != sizeof(hdr) ||
+	    hdr.magic != APK_VERDICT_MAGIC ||
+	    hdr.version != APK_VERDICT_VERSION) {
+		pr_err("apk verdict cache invalid, ignoring it\n");
+		goto close;
+	}
+	if (hdr.salt != apk_verdict_salt()) {
+		pr_info("apk verdict cache is for another manager, ignoring it\n");
+		goto close;
+	}
+	if (hdr.count > APK_VERDICT_MAX || hdr.hint_len >= sizeof(hint) ||
+	    kernel_read(fp, hint, hdr.hint_len, &off) != hdr.hint_len)
+		goto close;
+	hint[hdr.hint_len] = '\0';
+
+	len = (size_t)hdr.count * sizeof(*keys);
+	keys = kvmalloc(max_t(size_t, len, 1), GFP_KERNEL);
+	if (!keys)
+		goto close;
+
+	if (kernel_read(fp, keys, len, &off) == len) {
+		mutex_lock(&throne_mutex);
+		for (i = 0; i < hdr.count; i++)
+			apk_verdict_add(&keys[i]);
+		strscpy(manager_hint, hint, sizeof(manager_hint));
+		// nothing new to save yet
+		apk_verdicts_dirty = false;
+		mutex_unlock(&throne_mutex);
+		pr_info("apk verdict cache: %u entries loaded, manager hint: %s\n",
+			hdr.count, hint[0] ? hint : "none");
+	}
+	kvfree(keys);
+
+close:
+	filp_close(fp, 0);
+}
 
 struct my_dir_context {
 	struct dir_context ctx;
 	struct list_head *data_path_list;
 	char *parent_dir;
-	void *private_data;
+	struct list_head *candidates;
+	int *errors; // directories or APKs the walk had to leave out
 	int depth;
-	int *stop;
 };
 // https://docs.kernel.org/filesystems/porting.html
 // filldir_t (readdir callbacks) calling conventions have changed. Instead of returning 0 or -E... it returns bool now. false means "no more" (as -E... used to) and true - "keep going" (as 0 in old calling conventions). Rationale: callers never looked at specific -E... values anyway. -> iterate_shared() instances require no changes at all, all filldir_t ones in the tree converted.
@@ -80,7 +368,20 @@ struct my_dir_context {
 #define FILLDIR_ACTOR_CONTINUE 0
 #define FILLDIR_ACTOR_STOP -EINVAL
 #endif
-extern bool is_manager_apk(char *path);
+
+/*
+ * A base.apk the walk found without a cached verdict. The walk only collects
+ * these; verifying them is what costs, so that part runs on search_wq.
+ */
+struct apk_candidate {
+	struct list_head list;
+	struct apk_verdict_key key;
+	bool have_key;
+	bool checked;
+	int is_manager; // is_manager_apk(), only a 0 may be cached
+	char path[DATA_PATH_LEN];
+};
+
 FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
 							int namelen, loff_t off, u64 ino,
 							unsigned int d_type)
@@ -93,10 +394,6 @@ FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
 		pr_err("Invalid context\n");
 		return FILLDIR_ACTOR_STOP;
 	}
-	if (my_ctx->stop && *my_ctx->stop) {
-		pr_info("Stop searching\n");
-		return FILLDIR_ACTOR_STOP;
-	}
 
 	if (!strncmp(name, "..", namelen) || !strncmp(name, ".", namelen))
 		return FILLDIR_ACTOR_CONTINUE; // Skip "." and ".."
@@ -113,12 +410,12 @@ FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
 		return FILLDIR_ACTOR_CONTINUE;
 	}
 
-	if (d_type == DT_DIR && my_ctx->depth > 0 &&
-		(my_ctx->stop && !*my_ctx->stop)) {
-		struct data_path *data = kzalloc(sizeof(struct data_path), GFP_ATOMIC);
+	if (d_type == DT_DIR && my_ctx->depth > 0) {
+		struct data_path *data = kzalloc(sizeof(struct data_path), GFP_KERNEL);
 
 		if (!data) {
 			pr_err("Failed to allocate memory for %s\n", dirpath);
+			(*my_ctx->errors)++;
 			return FILLDIR_ACTOR_CONTINUE;
 		}
 
@@ -127,51 +424,160 @@ FILLDIR_RETURN_TYPE my_actor(struct dir_context *ctx, const char *name,
 		list_add_tail(&data->list, my_ctx->data_path_list);
 	} else {
 		if ((namelen == 8) && (strncmp(name, "base.apk", namelen) == 0)) {
-			struct apk_path_hash *pos, *n;
-			unsigned int hash = full_name_hash(NULL, dirpath, strlen(dirpath));
-			list_for_each_entry (pos, &apk_path_hash_list, list) {
-				if (hash == pos->hash) {
-					pos->exists = true;
+			struct apk_candidate *c;
+			struct apk_verdict *v;
+			struct apk_verdict_key key;
+			bool have_key = !apk_verdict_key_of(dirpath, &key);
+
+			if (have_key) {
+				v = apk_verdict_find(&key);
+				if (v) {
+					v->seen = true;
 					return FILLDIR_ACTOR_CONTINUE;
 				}
 			}
 
-			bool is_manager = is_manager_apk(dirpath);
-			pr_info("Found new base.apk at path: %s, is_manager: %d\n", dirpath,
-					is_manager);
-			if (is_manager) {
-				crown_manager(dirpath, my_ctx->private_data);
-				*my_ctx->stop = 1;
-
-				// Manager found, clear APK cache list
-				list_for_each_entry_safe (pos, n, &apk_path_hash_list, list) {
-					list_del(&pos->list);
-					kfree(pos);
-				}
-			} else {
-				struct apk_path_hash *apk_data =
-					kzalloc(sizeof(struct apk_path_hash), GFP_ATOMIC);
-				apk_data->hash = hash;
-				apk_data->exists = true;
-				list_add_tail(&apk_data->list, &apk_path_hash_list);
+			c = kmalloc(sizeof(*c), GFP_KERNEL);
+			if (!c) {
+				pr_err("Failed to allocate memory for %s\n", dirpath);
+				(*my_ctx->errors)++;
+				return FILLDIR_ACTOR_CONTINUE;
 			}
+			if (have_key)
+				c->key = key;
+			c->have_key = have_key;
+			c->checked = false;
+			c->is_manager = 0;
+			strscpy(c->path, dirpath, DATA_PATH_LEN);
+			list_add_tail(&c->list, my_ctx->candidates);
 		}
 	}
 
 	return FILLDIR_ACTOR_CONTINUE;
 }
 
-void search_manager(const char *path, int depth, struct list_head *uid_data)
+/*
+ * Candidates are verified by up to throne_search_workers work items on an
+ * unbound workqueue. Each takes the next unchecked candidate until the list
+ * runs out or one of them finds the manager, which stops the rest.
+ *
+ * Sequential by default: the gain over one worker hasn't been measured on
+ * a device yet. search_manager() logs the time taken, so compare runs with
+ * throne_search_workers=1 and =4 before raising it.
+ */
+#define SEARCH_WORKERS_MAX 8
+
+static unsigned int throne_search_workers = 1;
+module_param(throne_search_workers, uint, 0);
+MODULE_PARM_DESC(throne_search_workers, "APKs verified in parallel by a manager search, 1 is sequential");
+
+static struct workqueue_struct *search_wq; // guarded by throne_mutex
+
+struct manager_search {
+	spinlock_t lock; // guards next and found
+	struct list_head candidates;
+	struct list_head *next;
+	struct apk_candidate *found;
+	atomic_t verified;
+	atomic_t errors; // candidates is_manager_apk() couldn't tell about
+};
+
+struct search_worker {
+	struct work_struct work;
+	struct manager_search *s;
+};
+
+static void verify_candidates(struct manager_search *s)
+{
+	struct apk_candidate *c;
+
+	for (;;) {
+		spin_lock(&s->lock);
+		if (s->found || s->next == &s->candidates) {
+			spin_unlock(&s->lock);
+			return;
+		}
+		c = list_entry(s->next, struct apk_candidate, list);
+		s->next = s->next->next;
+		spin_unlock(&s->lock);
+
+		c->is_manager = is_manager_apk(c->path);
+		c->checked = true;
+		atomic_inc(&s->verified);
+		if (c->is_manager < 0)
+			atomic_inc(&s->errors);
+		pr_info("Found new base.apk at path: %s, is_manager: %d\n", c->path,
+				c->is_manager);
+
+		if (c->is_manager > 0) {
+			spin_lock(&s->lock);
+			if (!s->found)
+				s->found = c;
+			spin_unlock(&s->lock);
+		}
+	}
+}
+
+static void search_worker_fn(struct work_struct *work)
+{
+	struct search_worker *w = container_of(work, struct search_worker, work);
+
+	verify_candidates(w->s);
+}
+
+static int verify_candidates_parallel(struct manager_search *s, u32 count)
+{
+	struct search_worker workers[SEARCH_WORKERS_MAX];
+	int i, n = min3(throne_search_workers, (unsigned int)SEARCH_WORKERS_MAX,
+			count);
+
+	if (!search_wq || n <= 1) {
+		verify_candidates(s);
+		return 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		INIT_WORK_ONSTACK(&workers[i].work, search_worker_fn);
+		workers[i].s = s;
+		queue_work(search_wq, &workers[i].work);
+	}
+	for (i = 0; i < n; i++) {
+		flush_work(&workers[i].work);
+		destroy_work_on_stack(&workers[i].work);
+	}
+
+	return n;
+}
+
+/*
+ * Walk @path for a manager base.apk. @full means @path is all of /data/app,
+ * so verdicts the walk didn't meet belong to removed APKs. Returns false if
+ * a directory or APK couldn't be looked at, the manager may be among them.
+ */
+static bool search_manager(const char *path, int depth,
+			   struct package_map *map, bool full)
 {
-	int i, stop = 0;
+	int i, workers, errors = 0;
+	u32 count = 0;
 	struct list_head data_path_list;
 	INIT_LIST_HEAD(&data_path_list);
 	unsigned long data_app_magic = 0;
 
-	// Initialize APK cache list
-	struct apk_path_hash *pos, *n;
-	list_for_each_entry (pos, &apk_path_hash_list, list) {
-		pos->exists = false;
+	struct manager_search s = { .found = NULL };
+	struct apk_candidate *c, *cn;
+	struct apk_verdict *v;
+	struct hlist_node *tmp;
+	ktime_t start = ktime_get();
+	int bkt;
+
+	spin_lock_init(&s.lock);
+	INIT_LIST_HEAD(&s.candidates);
+	atomic_set(&s.verified, 0);
+	atomic_set(&s.errors, 0);
+
+	if (full) {
+		hash_for_each (apk_verdicts, bkt, v, node)
+			v->seen = false;
 	}
 
 	// First depth
@@ -187,42 +593,41 @@ void search_manager(const char *path, int depth, struct list_head *uid_data)
 			struct my_dir_context ctx = { .ctx.actor = my_actor,
 										.data_path_list = &data_path_list,
 										.parent_dir = pos->dirpath,
-										.private_data = uid_data,
-										.depth = pos->depth,
-										.stop = &stop };
+										.candidates = &s.candidates,
+										.errors = &errors,
+										.depth = pos->depth };
 			struct file *file;
 
-			if (!stop) {
-				file = filp_open(pos->dirpath, O_RDONLY | O_NOFOLLOW, 0);
-				if (IS_ERR(file)) {
-					pr_err("Failed to open directory: %s, err: %ld\n",
-						pos->dirpath, PTR_ERR(file));
-					goto skip_iterate;
-				}
-
-				// grab magic on first folder, which is /data/app
-				if (!data_app_magic) {
-					if (file->f_inode->i_sb->s_magic) {
-						data_app_magic = file->f_inode->i_sb->s_magic;
-						pr_info("%s: dir: %s got magic! 0x%lx\n", __func__,
-								pos->dirpath, data_app_magic);
-					} else {
-						filp_close(file, NULL);
-						goto skip_iterate;
-					}
-				}
+			file = filp_open(pos->dirpath, O_RDONLY | O_NOFOLLOW, 0);
+			if (IS_ERR(file)) {
+				pr_err("Failed to open directory: %s, err: %ld\n",
+					pos->dirpath, PTR_ERR(file));
+				errors++;
+				goto skip_iterate;
+			}
 
-				if (file->f_inode->i_sb->s_magic != data_app_magic) {
-					pr_info("%s: skip: %s magic: 0x%lx expected: 0x%lx\n",
-							__func__, pos->dirpath,
-							file->f_inode->i_sb->s_magic, data_app_magic);
+			// grab magic on first folder, which is /data/app
+			if (!data_app_magic) {
+				if (file->f_inode->i_sb->s_magic) {
+					data_app_magic = file->f_inode->i_sb->s_magic;
+					pr_info("%s: dir: %s got magic! 0x%lx\n", __func__,
+							pos->dirpath, data_app_magic);
+				} else {
 					filp_close(file, NULL);
 					goto skip_iterate;
 				}
+			}
 
-				iterate_dir(file, &ctx.ctx);
+			if (file->f_inode->i_sb->s_magic != data_app_magic) {
+				pr_info("%s: skip: %s magic: 0x%lx expected: 0x%lx\n",
+						__func__, pos->dirpath,
+						file->f_inode->i_sb->s_magic, data_app_magic);
 				filp_close(file, NULL);
+				goto skip_iterate;
 			}
+
+			iterate_dir(file, &ctx.ctx);
+			filp_close(file, NULL);
 		skip_iterate:
 			list_del(&pos->list);
 			if (pos != &data)
@@ -230,136 +635,422 @@ void search_manager(const char *path, int depth, struct list_head *uid_data)
 		}
 	}
 
-	// Remove stale cached APK entries
-	list_for_each_entry_safe (pos, n, &apk_path_hash_list, list) {
-		if (!pos->exists) {
-			list_del(&pos->list);
-			kfree(pos);
+	list_for_each_entry (c, &s.candidates, list)
+		count++;
+	s.next = s.candidates.next;
+	workers = verify_candidates_parallel(&s, count);
+
+	if (s.found) {
+		crown_manager(s.found->path, map);
+		// not in packages.list yet, look again once it is
+		if (!ksu_is_manager_appid_valid())
+			errors++;
+		if (ksu_is_manager_appid_valid() &&
+		    strcmp(manager_hint, s.found->path)) {
+			strscpy(manager_hint, s.found->path, sizeof(manager_hint));
+			apk_verdicts_dirty = true;
 		}
 	}
+
+	list_for_each_entry_safe (c, cn, &s.candidates, list) {
+		if (c->checked && c->is_manager == 0 && c->have_key)
+			apk_verdict_add(&c->key);
+		list_del(&c->list);
+		kfree(c);
+	}
+
+	errors += atomic_read(&s.errors);
+	pr_info("%s: %s: %d of %u APKs verified (%d errors) by %d workers in %lld ms\n",
+			__func__, path, atomic_read(&s.verified), count, errors,
+			workers, ktime_ms_delta(ktime_get(), start));
+
+	// A full walk met every APK that is still installed, unless some
+	// directory couldn't be opened
+	if (full && !errors) {
+		hash_for_each_safe (apk_verdicts, bkt, tmp, v, node) {
+			if (!v->seen)
+				apk_verdict_del(v);
+		}
+	}
+
+	if (apk_verdicts_dirty) {
+		apk_verdicts_dirty = false;
+		save_apk_verdicts();
+	}
+
+	return !errors;
 }
 
 static bool is_uid_exist(uid_t uid, char *package, void *data)
 {
-	struct list_head *list = (struct list_head *)data;
-	struct uid_data *np;
-
-	bool exist = false;
-	list_for_each_entry (np, list, list) {
-		if (np->uid == uid % PER_USER_RANGE &&
-			strncmp(np->package, package, KSU_MAX_PACKAGE_NAME) == 0) {
-			exist = true;
-			break;
-		}
-	}
-	return exist;
+	return package_map_find(data, uid % PER_USER_RANGE, package) != NULL;
 }
 
-void track_throne(bool prune_only)
+/*
+ * Package directories created in /data/app since boot, noted by the
+ * observer. Once the boot scan is done, a search only walks these. A note
+ * lives for APP_DIR_NOTE_TTL rather than one search: on Android 11+ the
+ * observer sees the ~~<random> parent, and the package directory is moved
+ * into it a moment later, possibly after a search already ran.
+ */
+#define APP_DIR_NOTES 16
+#define APP_DIR_NOTE_TTL (30 * HZ)
+
+struct app_dir_note {
+	unsigned long stamp; // jiffies when noted
+	char name[128];
+};
+
+static struct app_dir_note app_dir_notes[APP_DIR_NOTES];
+static u32 app_dir_note_count;
+static bool app_dir_notes_overflow; // some were lost, scan everything
+static DEFINE_SPINLOCK(app_dir_notes_lock);
+static bool app_dirs_watched;
+static bool throne_full_scan_done;
+
+void ksu_throne_tracker_watching_app_dirs(void)
 {
-	struct file *fp = filp_open(SYSTEM_PACKAGES_LIST_PATH, O_RDONLY, 0);
-	if (IS_ERR(fp)) {
-		pr_err("%s: open " SYSTEM_PACKAGES_LIST_PATH " failed: %ld\n", __func__,
-			PTR_ERR(fp));
+	WRITE_ONCE(app_dirs_watched, true);
+}
+
+void ksu_throne_tracker_note_app_dir(const char *name, int len)
+{
+	// staging directories, renamed once the install commits
+	if (len >= 8 && !strncmp(name, "vmdl", 4) &&
+	    !strncmp(name + len - 4, ".tmp", 4))
+		return;
+
+#ifdef KSU_MANAGER_PACKAGE
+	// pre-11 layout names the directory <package>-<suffix> directly, the
+	// ~~<random> parent of newer ones says nothing about the package
+	const int pkg_len = sizeof(KSU_MANAGER_PACKAGE) - 1;
+	bool randomized = len > 2 && name[0] == '~' && name[1] == '~';
+
+	if (!randomized &&
+	    (len <= pkg_len || strncmp(name, KSU_MANAGER_PACKAGE, pkg_len) ||
+	     name[pkg_len] != '-'))
 		return;
+#endif
+
+	spin_lock(&app_dir_notes_lock);
+	if (app_dir_note_count == APP_DIR_NOTES ||
+	    len >= sizeof(app_dir_notes[0].name)) {
+		app_dir_notes_overflow = true;
+	} else {
+		struct app_dir_note *note = &app_dir_notes[app_dir_note_count++];
+
+		note->stamp = jiffies;
+		memcpy(note->name, name, len);
+		note->name[len] = '\0';
 	}
+	spin_unlock(&app_dir_notes_lock);
+}
 
-	struct list_head uid_list;
-	INIT_LIST_HEAD(&uid_list);
+// Drop expired notes, copy out the rest; returns false if a full scan is due
+static bool take_app_dir_notes(struct app_dir_note *out, u32 *count)
+{
+	bool overflow;
+	u32 i, n = 0;
 
-	char chr = 0;
-	loff_t pos = 0;
-	loff_t line_start = 0;
-	char buf[KSU_MAX_PACKAGE_NAME];
-	for (;;) {
-		ssize_t count = kernel_read(fp, &chr, sizeof(chr), &pos);
-		if (count != sizeof(chr))
-			break;
-		if (chr != '\n')
+	spin_lock(&app_dir_notes_lock);
+	for (i = 0; i < app_dir_note_count; i++) {
+		if (time_after(jiffies, app_dir_notes[i].stamp + APP_DIR_NOTE_TTL))
 			continue;
+		app_dir_notes[n++] = app_dir_notes[i];
+	}
+	app_dir_note_count = n;
+	memcpy(out, app_dir_notes, n * sizeof(*out));
+	*count = n;
 
-		count = kernel_read(fp, buf, sizeof(buf), &line_start);
+	overflow = app_dir_notes_overflow;
+	app_dir_notes_overflow = false;
+	spin_unlock(&app_dir_notes_lock);
 
-		struct uid_data *data = kzalloc(sizeof(struct uid_data), GFP_ATOMIC);
-		if (!data) {
-			filp_close(fp, 0);
-			goto out;
-		}
+	return !overflow;
+}
+
+static void clear_app_dir_notes(void)
+{
+	spin_lock(&app_dir_notes_lock);
+	app_dir_note_count = 0;
+	app_dir_notes_overflow = false;
+	spin_unlock(&app_dir_notes_lock);
+}
+
+/*
+ * The first search of a boot tries where the manager was last time, then
+ * falls back to the full walk. Later ones only look at new directories.
+ * Returns false if the manager wasn't found and the search hit errors; the
+ * next one is then a full walk again, the notes may have expired by then.
+ */
+static bool find_manager(struct package_map *map)
+{
+	static struct app_dir_note notes[APP_DIR_NOTES];
+	char path[DATA_PATH_LEN];
+	u32 i, count;
+	bool complete = true;
 
-		char *tmp = buf;
-		const char *delim = " ";
-		char *package = strsep(&tmp, delim);
-		char *uid = strsep(&tmp, delim);
-		if (!uid || !package) {
-			kfree(data);
-			pr_err("update_uid: package or uid is NULL!\n");
-			break;
+	if (!throne_full_scan_done) {
+		throne_full_scan_done = true;
+		clear_app_dir_notes();
+
+		if (manager_hint[0]) {
+			pr_info("Trying manager hint: %s\n", manager_hint);
+			if (is_manager_apk(manager_hint) > 0)
+				crown_manager(manager_hint, map);
+			if (ksu_is_manager_appid_valid())
+				return true;
 		}
 
-		u32 res;
-		if (kstrtou32(uid, 10, &res)) {
-			kfree(data);
-			pr_err("update_uid: uid parse err\n");
-			break;
+		pr_info("Searching manager...\n");
+		complete = search_manager("/data/app", 2, map, true);
+		pr_info("Search manager finished\n");
+		goto out;
+	}
+
+	if (!take_app_dir_notes(notes, &count) || !READ_ONCE(app_dirs_watched)) {
+		pr_info("New app dirs unknown, searching manager...\n");
+		complete = search_manager("/data/app", 2, map, true);
+		goto out;
+	}
+
+	for (i = 0; i < count && !ksu_is_manager_appid_valid(); i++) {
+		snprintf(path, sizeof(path), "/data/app/%s", notes[i].name);
+		pr_info("Searching manager in %s\n", path);
+		// ~~<random>/<package>-<suffix>/base.apk, or <package>-<suffix>/base.apk
+		if (!search_manager(path, 1, map, false))
+			complete = false;
+	}
+
+out:
+	if (ksu_is_manager_appid_valid()) {
+		clear_app_dir_notes();
+		return true;
+	}
+	if (!complete)
+		throne_full_scan_done = false;
+	return complete;
+}
+
+/*
+ * Sorted (uid, name hash) pairs of the last parse that got to search, so the
+ * next one can tell what changed. Nothing removed means nothing to prune;
+ * nothing added means no new package could be the manager. Prune-only runs
+ * leave it alone, or what was installed before them would never be
+ * searched. Guarded by throne_mutex.
+ */
+struct package_key {
+	u32 uid;
+	u32 hash;
+};
+
+static struct package_key *throne_snapshot;
+static u32 throne_snapshot_count;
+
+/*
+ * Set while the manager is unknown and no search since it went missing has
+ * finished without errors. Such a search is retried on the next change even
+ * if nothing was added. Guarded by throne_mutex.
+ */
+static bool throne_search_owed = true;
+
+static int package_key_cmp(const void *a, const void *b)
+{
+	const struct package_key *x = a, *y = b;
+
+	if (x->uid != y->uid)
+		return x->uid < y->uid ? -1 : 1;
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	return 0;
+}
+
+static struct package_key *package_map_keys(struct package_map *map)
+{
+	struct package_key *keys;
+	u32 i;
+
+	keys = kvmalloc_array(max_t(u32, map->count, 1), sizeof(*keys),
+			      GFP_KERNEL);
+	if (!keys)
+		return NULL;
+
+	for (i = 0; i < map->count; i++) {
+		keys[i].uid = map->entries[i].uid;
+		keys[i].hash = map->entries[i].hash;
+	}
+	sort(keys, map->count, sizeof(*keys), package_key_cmp, NULL);
+	return keys;
+}
+
+// Merge walk of two sorted key arrays
+static void package_keys_diff(const struct package_key *old, u32 old_count,
+			      const struct package_key *new, u32 new_count,
+			      u32 *added, u32 *removed)
+{
+	u32 i = 0, j = 0;
+
+	*added = *removed = 0;
+	while (i < old_count || j < new_count) {
+		int cmp = i == old_count ? 1 :
+			  j == new_count ? -1 :
+					   package_key_cmp(&old[i], &new[j]);
+
+		if (cmp < 0) {
+			(*removed)++;
+			i++;
+		} else if (cmp > 0) {
+			(*added)++;
+			j++;
+		} else {
+			i++;
+			j++;
 		}
-		data->uid = res;
-		strncpy(data->package, package, KSU_MAX_PACKAGE_NAME);
-		list_add_tail(&data->list, &uid_list);
-		// reset line start
-		line_start = pos;
 	}
-	filp_close(fp, 0);
+}
+
+static void __track_throne(bool prune_only)
+{
+	struct file *fp = filp_open(SYSTEM_PACKAGES_LIST_PATH, O_RDONLY, 0);
+	if (IS_ERR(fp)) {
+		pr_err("%s: open " SYSTEM_PACKAGES_LIST_PATH " failed: %ld\n", __func__,
+			PTR_ERR(fp));
+		return;
+	}
+
+	struct package_map map = { 0 };
+	loff_t size = i_size_read(file_inode(fp));
 
-	// now update uid list
-	struct uid_data *np;
-	struct uid_data *n;
+	// size the arenas for typical ~100 byte lines up front, they still
+	// grow if the guess is short
+	package_map_grow((void **)&map.entries, &map.max, sizeof(*map.entries),
+			 min_t(loff_t, size / 64, U16_MAX));
+	package_map_grow((void **)&map.names, &map.names_max, 1,
+			 min_t(loff_t, size / 2, SZ_1M));
+	map.manager_appid = ksu_get_manager_appid();
 
+	ktime_t start = ktime_get();
+	int parsed = parse_packages_list(fp, &map);
+	filp_close(fp, 0);
+	if (parsed >= 0)
+		parsed = package_map_index(&map) ?: parsed;
+	if (parsed < 0) {
+		pr_err("%s: read " SYSTEM_PACKAGES_LIST_PATH " failed: %d\n", __func__,
+			parsed);
+		goto out;
+	}
+	pr_info("%s: %d packages parsed in %lld us\n", __func__, parsed,
+		ktime_us_delta(ktime_get(), start));
+
+	// the boot completed prune is the first one that takes effect, so it
+	// always runs in full
 	if (prune_only)
 		goto prune;
 
-	// first, check if manager_uid exist!
-	bool manager_exist = false;
-	list_for_each_entry (np, &uid_list, list) {
-		if (np->uid == ksu_get_manager_appid()) {
-			manager_exist = true;
-			break;
-		}
+	// without a previous parse to compare with, assume everything changed
+	u32 added = U32_MAX, removed = U32_MAX;
+	struct package_key *keys = package_map_keys(&map);
+
+	if (keys && throne_snapshot) {
+		package_keys_diff(throne_snapshot, throne_snapshot_count, keys,
+				  map.count, &added, &removed);
+		pr_info("%s: %u packages added, %u removed\n", __func__, added,
+			removed);
 	}
+	kvfree(throne_snapshot);
+	throne_snapshot = keys;
+	throne_snapshot_count = keys ? map.count : 0;
 
-	if (!manager_exist) {
+	// first, check if manager_uid exist!
+	if (!map.manager_seen) {
 		if (ksu_is_manager_appid_valid()) {
 			pr_info("manager is uninstalled, invalidate it!\n");
 			ksu_invalidate_manager_uid();
+			throne_search_owed = true;
 			goto prune;
 		}
-		pr_info("Searching manager...\n");
-		search_manager("/data/app", 2, &uid_list);
-		pr_info("Search manager finished\n");
+		if (added || throne_search_owed)
+			throne_search_owed = !find_manager(&map);
 	}
 
+	if (!removed)
+		goto out;
+
 prune:
 	// then prune the allowlist
-	ksu_prune_allowlist(is_uid_exist, &uid_list);
+	ksu_prune_allowlist(is_uid_exist, &map);
 out:
-	// free uid_list
-	list_for_each_entry_safe (np, n, &uid_list, list) {
-		list_del(&np->list);
-		kfree(np);
+	package_map_free(&map);
+}
+
+void track_throne(bool prune_only)
+{
+	mutex_lock(&throne_mutex);
+	__track_throne(prune_only);
+	mutex_unlock(&throne_mutex);
+}
+
+static void throne_work_fn(struct work_struct *work)
+{
+	track_throne(false);
+}
+
+void ksu_throne_tracker_schedule(void)
+{
+	bool queued = false;
+
+	spin_lock(&throne_wq_lock);
+	if (throne_wq) {
+		queue_delayed_work(throne_wq, &throne_work,
+				   msecs_to_jiffies(throne_debounce_ms));
+		queued = true;
 	}
+	spin_unlock(&throne_wq_lock);
+
+	// the workqueue never came up, track in the caller as before
+	if (!queued && throne_inline)
+		track_throne(false);
 }
 
 void ksu_throne_tracker_init()
 {
-	// nothing to do
+	INIT_DELAYED_WORK(&throne_work, throne_work_fn);
+	throne_wq = alloc_ordered_workqueue("ksu_throne", 0);
+	if (!throne_wq) {
+		pr_err("throne: alloc workqueue failed, tracking inline\n");
+		throne_inline = true;
+	}
+	search_wq = alloc_workqueue("ksu_throne_search", WQ_UNBOUND,
+				    SEARCH_WORKERS_MAX);
+	if (!search_wq)
+		pr_err("throne: alloc search workqueue failed, searching sequentially\n");
 }
 
 void ksu_throne_tracker_exit()
 {
-	/* Free cached APK path hash entries */
-	struct apk_path_hash *pos, *n;
+	struct workqueue_struct *wq;
+
+	spin_lock(&throne_wq_lock);
+	wq = throne_wq;
+	throne_wq = NULL;
+	spin_unlock(&throne_wq_lock);
 
-	list_for_each_entry_safe(pos, n, &apk_path_hash_list, list) {
-		list_del(&pos->list);
-		kfree(pos);
+	if (wq) {
+		cancel_delayed_work_sync(&throne_work);
+		destroy_workqueue(wq);
 	}
+
+	mutex_lock(&throne_mutex);
+	wq = search_wq;
+	search_wq = NULL;
+	mutex_unlock(&throne_mutex);
+	if (wq)
+		destroy_workqueue(wq);
+
+	kvfree(throne_snapshot);
+	throne_snapshot = NULL;
+	throne_snapshot_count = 0;
+	throne_search_owed = true;
+
+	apk_verdicts_clear();
 }
@@ -5,6 +5,18 @@ void ksu_throne_tracker_init();
 
 void ksu_throne_tracker_exit();
 
+// Load the saved APK verdicts, once /data is decrypted
+void ksu_throne_tracker_load_cache(void);
+
 void track_throne(bool prune_only);
 
+// Parse packages.list after throne_debounce_ms, coalescing calls meanwhile
+void ksu_throne_tracker_schedule(void);
+
+// The observer reports new /data/app directories from now on
+void ksu_throne_tracker_watching_app_dirs(void);
+
+// A directory @name appeared in /data/app, the next search only needs it
+void ksu_throne_tracker_note_app_dir(const char *name, int len);
+
 #endif
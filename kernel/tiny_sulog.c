@@ -1,63 +1,486 @@
-// half assed ringbuffer
-// 8 bytes
-struct sulog_entry {
-	uint32_t s_time; // uptime in seconds
-	uint32_t data; // uint8_t[0,1,2] = uid, basically uint24_t, uint8_t[3] = symbol
-} __attribute__((packed));
+/*
+ * su audit log. Every CPU owns a ring of sulog_size records and only ever
+ * writes its own, with preemption off, so the write path needs neither a
+ * lock nor an atomic beyond the global event counter. Writers all run in
+ * process context (syscall hooks and the ioctl path), never from an IRQ.
+ *
+ * Each slot carries a sequence word: 2 * pos + 1 while record pos is being
+ * written, 2 * pos + 2 once it is complete. Readers copy a slot and check
+ * the word on both sides, dropping records that were overwritten under
+ * them, and merge the rings newest first by timestamp.
+ */
 
-#define SULOG_ENTRY_MAX 250
-#define SULOG_BUFSIZ SULOG_ENTRY_MAX * (sizeof (struct sulog_entry))
+static unsigned int sulog_size = 256;
+module_param(sulog_size, uint, 0);
+MODULE_PARM_DESC(sulog_size, "su log records kept per CPU, rounded up to a power of two");
+
+#define SULOG_SIZE_MIN 16
+#define SULOG_SIZE_MAX 4096
 
-static void *sulog_buf_ptr = NULL;
-static uint8_t sulog_index_next = 0;
+struct sulog_slot {
+	unsigned long seq;
+	struct ksu_sulog_record rec;
+};
+
+struct sulog_ring {
+	unsigned long head; // next position to write
+	struct sulog_slot *slots;
+};
 
-static DEFINE_SPINLOCK(sulog_lock);
+static struct sulog_ring __percpu *sulog_rings;
+static unsigned long sulog_mask;
+static atomic64_t sulog_seq = ATOMIC64_INIT(0);
+
+// Merge state, one cursor per possible CPU, serializes readers only
+struct sulog_cursor {
+	unsigned long pos; // walking down from the ring's head
+	unsigned long end; // oldest position the ring still held
+	bool have;
+	struct ksu_sulog_record rec;
+};
+
+static struct sulog_cursor *sulog_cursors;
+static DEFINE_SPINLOCK(sulog_read_lock);
+
+// Stream readers sleep here; writers kick it through irq_work so they never
+// take the waitqueue lock themselves
+static DECLARE_WAIT_QUEUE_HEAD(sulog_wait);
+static struct irq_work sulog_wake_work;
+
+static void sulog_wake(struct irq_work *work)
+{
+	wake_up_interruptible(&sulog_wait);
+}
+
+void write_sulog(uint8_t sym, uint8_t outcome)
+{
+	struct sulog_ring __percpu *rings;
+	struct sulog_ring *ring;
+	struct sulog_slot *slot;
+	unsigned long pos;
+	uid_t uid = current_uid().val;
+	u64 now;
+
+	preempt_disable();
+
+	// stamp with preemption off so each ring stays in time order
+	now = ktime_to_ns(ktime_get_boottime());
+	ksu_su_usage_account(uid, sym, outcome, now);
+
+	rings = READ_ONCE(sulog_rings);
+	if (!rings)
+		goto out;
+
+	ring = this_cpu_ptr(rings);
+	pos = ring->head;
+	slot = &ring->slots[pos & sulog_mask];
+
+	WRITE_ONCE(slot->seq, 2 * pos + 1);
+	smp_wmb();
+
+	slot->rec.seq = atomic64_inc_return(&sulog_seq);
+	slot->rec.ts_ns = now;
+	slot->rec.uid = uid;
+	slot->rec.pid = task_tgid_nr(current);
+	// only current renames itself, so no lock is needed for its comm
+	memcpy(slot->rec.comm, current->comm, sizeof(slot->rec.comm));
+	slot->rec.type = sym;
+	slot->rec.outcome = outcome;
+
+	smp_wmb();
+	WRITE_ONCE(slot->seq, 2 * pos + 2);
+	smp_store_release(&ring->head, pos + 1);
+
+	if (wq_has_sleeper(&sulog_wait))
+		irq_work_queue(&sulog_wake_work);
+
+out:
+	preempt_enable();
+}
+
+static bool sulog_slot_read(struct sulog_ring *ring, unsigned long pos,
+			    struct ksu_sulog_record *rec)
+{
+	struct sulog_slot *slot = &ring->slots[pos & sulog_mask];
+
+	if (READ_ONCE(slot->seq) != 2 * pos + 2)
+		return false;
+	smp_rmb();
+	*rec = slot->rec;
+	smp_rmb();
+
+	// a writer lapped us mid copy
+	return READ_ONCE(slot->seq) == 2 * pos + 2;
+}
+
+static void sulog_cursor_next(struct sulog_ring *ring, struct sulog_cursor *c)
+{
+	c->have = false;
+	while (c->pos > c->end) {
+		if (sulog_slot_read(ring, --c->pos, &c->rec)) {
+			c->have = true;
+			return;
+		}
+	}
+}
+
+/*
+ * Feed records to @emit newest first, across all CPUs by timestamp, until
+ * it returns false or the rings run dry. @emit runs under sulog_read_lock.
+ *
+ * If @settled isn't NULL it gets the lowest seq that may still be written:
+ * a seq below it that wasn't emitted was overwritten and is gone for good.
+ * A writer marks its slot before taking a seq and every ring is in seq
+ * order, so a ring caught mid write holds that seq above its newest record.
+ */
+static void sulog_merge(bool (*emit)(const struct ksu_sulog_record *, void *),
+			void *ctx, u64 *settled)
+{
+	struct sulog_ring __percpu *rings = READ_ONCE(sulog_rings);
+	u64 taken;
+	int cpu;
+
+	if (!rings)
+		return;
+
+	spin_lock(&sulog_read_lock);
+
+	taken = atomic64_read(&sulog_seq);
+	// pairs with the smp_wmb() between marking the slot and taking a seq
+	smp_rmb();
+	if (settled)
+		*settled = taken + 1;
+
+	for_each_possible_cpu (cpu) {
+		struct sulog_ring *ring = per_cpu_ptr(rings, cpu);
+		struct sulog_cursor *c = &sulog_cursors[cpu];
+		unsigned long head = smp_load_acquire(&ring->head);
+		// being written, or done with head not yet moved past it
+		bool busy = READ_ONCE(ring->slots[head & sulog_mask].seq) > 2 * head;
+
+		c->pos = head;
+		c->end = c->pos > sulog_mask ? c->pos - sulog_mask - 1 : 0;
+		sulog_cursor_next(ring, c);
+
+		if (settled && busy)
+			*settled = min(*settled, c->have ? c->rec.seq + 1 : 1);
+	}
+
+	for (;;) {
+		struct sulog_cursor *newest = NULL;
+		int newest_cpu = -1;
+
+		for_each_possible_cpu (cpu) {
+			struct sulog_cursor *c = &sulog_cursors[cpu];
+
+			if (!c->have)
+				continue;
+			if (!newest || c->rec.ts_ns > newest->rec.ts_ns ||
+			    (c->rec.ts_ns == newest->rec.ts_ns &&
+			     c->rec.seq > newest->rec.seq)) {
+				newest = c;
+				newest_cpu = cpu;
+			}
+		}
+
+		if (!newest || !emit(&newest->rec, ctx))
+			break;
+
+		sulog_cursor_next(per_cpu_ptr(rings, newest_cpu), newest);
+	}
+
+	spin_unlock(&sulog_read_lock);
+}
 
 void sulog_init_heap()
 {
-	sulog_buf_ptr = kzalloc(SULOG_BUFSIZ, GFP_KERNEL);
-	if (!sulog_buf_ptr)
-		sulog_buf_ptr = NULL;
-	
-	pr_info("sulog_init: allocated %lu bytes on 0x%p \n", SULOG_BUFSIZ, sulog_buf_ptr);
+	unsigned int size = clamp_t(unsigned int, sulog_size, SULOG_SIZE_MIN,
+				    SULOG_SIZE_MAX);
+	struct sulog_ring __percpu *rings;
+	int cpu;
+
+	size = roundup_pow_of_two(size);
+	init_irq_work(&sulog_wake_work, sulog_wake);
+
+	rings = alloc_percpu(struct sulog_ring);
+	sulog_cursors = kcalloc(nr_cpu_ids, sizeof(*sulog_cursors), GFP_KERNEL);
+	if (!rings || !sulog_cursors)
+		goto fail;
+
+	for_each_possible_cpu (cpu) {
+		struct sulog_ring *ring = per_cpu_ptr(rings, cpu);
+
+		ring->slots = kvcalloc(size, sizeof(*ring->slots), GFP_KERNEL);
+		if (!ring->slots)
+			goto fail;
+	}
+
+	sulog_mask = size - 1;
+	WRITE_ONCE(sulog_rings, rings);
+
+	pr_info("sulog_init: %u records per cpu, %zu bytes each\n", size,
+		sizeof(struct ksu_sulog_record));
+	return;
+
+fail:
+	pr_err("sulog_init: allocation failed, su log disabled\n");
+	if (rings) {
+		for_each_possible_cpu (cpu)
+			kvfree(per_cpu_ptr(rings, cpu)->slots);
+		free_percpu(rings);
+	}
+	kfree(sulog_cursors);
+	sulog_cursors = NULL;
 }
 
-void write_sulog(uint8_t sym)
+void sulog_exit_heap(void)
 {
-	if (!sulog_buf_ptr)
+	struct sulog_ring __percpu *rings = sulog_rings;
+	int cpu;
+
+	if (!rings)
 		return;
 
-	unsigned int offset = sulog_index_next * sizeof(struct sulog_entry);
-	struct sulog_entry entry = {0};
+	WRITE_ONCE(sulog_rings, NULL);
+	// writers hold preemption off for the whole record. Readers are gone
+	// already: the reboot hook is unregistered and open fds pin the module.
+	synchronize_rcu();
+	irq_work_sync(&sulog_wake_work);
 
-	// WARNING!!! this is LE only!
-	entry.s_time = (uint32_t)(ktime_get_boottime() / 1000000000);
-	entry.data = (uint32_t)current_uid().val;
-	memcpy((void *)&entry.data + 3, &sym, 1);
+	for_each_possible_cpu (cpu)
+		kvfree(per_cpu_ptr(rings, cpu)->slots);
+	free_percpu(rings);
+	kfree(sulog_cursors);
+	sulog_cursors = NULL;
+}
 
-	spin_lock(&sulog_lock);
-	memcpy(sulog_buf_ptr + offset, &entry, sizeof(entry));
-	spin_unlock(&sulog_lock);
+/*
+ * Stream reader: read() hands out whole records newer than the fd's cursor
+ * in seq order, blocking unless O_NONBLOCK; poll() reports when there are
+ * some. seq rather than the timestamp is the cursor because it is unique.
+ * A reader that falls a full ring behind sees a gap in seq.
+ */
+#define SULOG_READ_BATCH 64
+
+struct sulog_reader {
+	struct mutex lock;
+	u64 cursor; // last seq handed out
+	struct ksu_sulog_record recs[SULOG_READ_BATCH];
+};
+
+struct sulog_pending_ctx {
+	u64 after;
+	struct ksu_sulog_record *recs; // sorted by seq
+	unsigned int count, max;
+};
+
+// Keep the @max lowest seqs above the cursor, the merge is in time order
+static bool sulog_pending_emit(const struct ksu_sulog_record *rec, void *data)
+{
+	struct sulog_pending_ctx *ctx = data;
+	unsigned int lo = 0, hi = ctx->count;
 
-	// move ptr for next iteration
-	sulog_index_next = sulog_index_next + 1;
+	if (rec->seq <= ctx->after)
+		return true;
+	if (ctx->count == ctx->max && rec->seq > ctx->recs[ctx->max - 1].seq)
+		return true;
 
-	if (sulog_index_next >= SULOG_ENTRY_MAX)
-		sulog_index_next = 0;
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (ctx->recs[mid].seq < rec->seq)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (ctx->count == ctx->max)
+		ctx->count--;
+	memmove(&ctx->recs[lo + 1], &ctx->recs[lo],
+		(ctx->count - lo) * sizeof(*ctx->recs));
+	ctx->recs[lo] = *rec;
+	ctx->count++;
+
+	return true;
+}
+
+/*
+ * How many of the pending records can be handed out in seq order. Records
+ * are only skipped over a gap that can't fill anymore: a seq below @settled
+ * was overwritten, one at or above it may still be mid write on another CPU
+ * and moving the cursor past it would lose it.
+ */
+static unsigned int sulog_pending_settled(const struct sulog_pending_ctx *ctx,
+					  u64 settled)
+{
+	u64 next = ctx->after + 1;
+	unsigned int i;
+
+	for (i = 0; i < ctx->count; i++) {
+		if (ctx->recs[i].seq != next && ctx->recs[i].seq > settled)
+			break;
+		next = ctx->recs[i].seq + 1;
+	}
+	return i;
+}
+
+static bool sulog_reader_ready(struct sulog_reader *r)
+{
+	return atomic64_read(&sulog_seq) > READ_ONCE(r->cursor);
+}
+
+static ssize_t sulog_fd_read(struct file *file, char __user *buf, size_t count,
+			     loff_t *ppos)
+{
+	struct sulog_reader *r = file->private_data;
+	struct sulog_pending_ctx ctx = {
+		.recs = r->recs,
+		.max = min_t(size_t, count / sizeof(*r->recs), SULOG_READ_BATCH),
+	};
+	ssize_t ret;
+	u64 settled = 0;
+
+	if (!ctx.max)
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&r->lock))
+		return -ERESTARTSYS;
+
+	for (;;) {
+		ctx.after = r->cursor;
+		ctx.count = 0;
+		sulog_merge(sulog_pending_emit, &ctx, &settled);
+		ctx.count = sulog_pending_settled(&ctx, settled);
+		if (ctx.count)
+			break;
+
+		if (file->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto out;
+		}
+
+		// a record whose seq is taken may still be mid write, so this
+		// can wake early and go round until it is done. Writers keep
+		// preemption off for the whole record, that is never long.
+		mutex_unlock(&r->lock);
+		if (wait_event_interruptible(sulog_wait, sulog_reader_ready(r)))
+			return -ERESTARTSYS;
+		if (mutex_lock_interruptible(&r->lock))
+			return -ERESTARTSYS;
+	}
+
+	ret = ctx.count * sizeof(*r->recs);
+	if (copy_to_user(buf, r->recs, ret)) {
+		ret = -EFAULT;
+		goto out;
+	}
+	WRITE_ONCE(r->cursor, r->recs[ctx.count - 1].seq);
+
+out:
+	mutex_unlock(&r->lock);
+	return ret;
+}
+
+static __poll_t sulog_fd_poll(struct file *file, poll_table *wait)
+{
+	struct sulog_reader *r = file->private_data;
+
+	poll_wait(file, &sulog_wait, wait);
+
+	return sulog_reader_ready(r) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static int sulog_fd_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations sulog_fops = {
+	.owner = THIS_MODULE,
+	.read = sulog_fd_read,
+	.poll = sulog_fd_poll,
+	.release = sulog_fd_release,
+	.llseek = noop_llseek,
+};
+
+// New read-only stream fd, starting after the newest record unless @flags asks for the backlog
+static int sulog_open_fd(u32 flags)
+{
+	struct sulog_reader *r;
+	int fd;
+
+	if (!READ_ONCE(sulog_rings))
+		return -EOPNOTSUPP;
+
+	if (flags & ~KSU_SULOG_FROM_START)
+		return -EINVAL;
+
+	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	if (!r)
+		return -ENOMEM;
+
+	mutex_init(&r->lock);
+	if (!(flags & KSU_SULOG_FROM_START))
+		r->cursor = atomic64_read(&sulog_seq);
+
+	fd = anon_inode_getfd("[ksu_sulog]", &sulog_fops, r,
+			      O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		kfree(r);
+
+	return fd;
 }
 
+/*
+ * GET_SULOG_DUMP_V2 keeps its original wire format: 250 packed 8-byte
+ * entries of {uptime seconds, uid:24 | type:8}, the index of the next
+ * entry to be written and the current uptime.
+ */
+struct sulog_entry {
+	uint32_t s_time; // uptime in seconds
+	uint32_t data; // uint8_t[0,1,2] = uid, basically uint24_t, uint8_t[3] = symbol
+} __attribute__((packed));
+
+#define SULOG_ENTRY_MAX 250
+#define SULOG_BUFSIZ SULOG_ENTRY_MAX * (sizeof (struct sulog_entry))
+
 struct sulog_entry_rcv_ptr {
 	uint64_t index_ptr; // send index here
 	uint64_t buf_ptr; // send buf here
 	uint64_t uptime_ptr; // uptime
 };
 
-int send_sulog_dump(void __user *uptr)
+struct sulog_legacy_ctx {
+	struct sulog_entry *entries;
+	unsigned int count;
+};
+
+static bool sulog_legacy_emit(const struct ksu_sulog_record *rec, void *data)
 {
-	if (!sulog_buf_ptr)
-		return 1;
+	struct sulog_legacy_ctx *ctx = data;
+	struct sulog_entry *entry;
+
+	// newest first, fill from the back so the oldest ends up first
+	entry = &ctx->entries[SULOG_ENTRY_MAX - 1 - ctx->count];
+	entry->s_time = (uint32_t)div_u64(rec->ts_ns, NSEC_PER_SEC);
+	entry->data = cpu_to_le32((rec->uid & 0xffffff) | ((u32)rec->type << 24));
+
+	return ++ctx->count < SULOG_ENTRY_MAX;
+}
 
+static struct sulog_entry sulog_legacy_buf[SULOG_ENTRY_MAX];
+static DEFINE_SPINLOCK(sulog_legacy_lock);
+
+int send_sulog_dump(void __user *uptr)
+{
 	struct sulog_entry_rcv_ptr sbuf = {0};
+	struct sulog_legacy_ctx ctx = { .entries = sulog_legacy_buf };
+	uint8_t index_next;
+	int ret = 0;
+
+	if (!sulog_rings)
+		return 1;
 
 	if (copy_from_user(&sbuf, uptr, sizeof(sbuf) ))
 		return 1;
@@ -70,17 +493,26 @@ int send_sulog_dump(void __user *uptr)
 	if (copy_to_user((void __user *)sbuf.uptime_ptr, &uptime, sizeof(uptime) ))
 		return 1;
 
+	spin_lock(&sulog_legacy_lock);
+
+	sulog_merge(sulog_legacy_emit, &ctx, NULL);
+
+	// entries sit at the tail, move them to the front like an unwrapped ring
+	memmove(sulog_legacy_buf, sulog_legacy_buf + SULOG_ENTRY_MAX - ctx.count,
+		ctx.count * sizeof(*sulog_legacy_buf));
+	memset(sulog_legacy_buf + ctx.count, 0,
+	       (SULOG_ENTRY_MAX - ctx.count) * sizeof(*sulog_legacy_buf));
+	index_next = ctx.count % SULOG_ENTRY_MAX;
+
 	// send index
-	if (copy_to_user((void __user *)sbuf.index_ptr, &sulog_index_next, sizeof(sulog_index_next) ))
-		return 1;
+	if (copy_to_user((void __user *)sbuf.index_ptr, &index_next, sizeof(index_next) ))
+		ret = 1;
 
 	// send buffer data
-	spin_lock(&sulog_lock);
-	if (copy_to_user((void __user *)sbuf.buf_ptr, sulog_buf_ptr, SULOG_BUFSIZ )) {
-		spin_unlock(&sulog_lock);
-		return 1;
-	}
-	spin_unlock(&sulog_lock);
+	else if (copy_to_user((void __user *)sbuf.buf_ptr, sulog_legacy_buf, SULOG_BUFSIZ ))
+		ret = 1;
 
-	return 0;
+	spin_unlock(&sulog_legacy_lock);
+
+	return ret;
 }
@@ -6,6 +6,7 @@
 
 #include <android/log.h>
 #include <cstring>
+#include <cstdlib>
 
 #include "ksu.h"
 
@@ -72,6 +73,102 @@ Java_com_rifsxd_ksunext_Natives_getSuperuserCount(JNIEnv *env, jobject) {
     return result ? cmd.total_count : 0;
 }
 
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_com_rifsxd_ksunext_Natives_getHomeState(JNIEnv *env, jobject) {
+    struct ksu_home_state state = {};
+    get_home_state(&state);
+
+    int version = state.info.version;
+    uint32_t flags = state.info.flags;
+    if (version <= 0) {
+        // try legacy method as fallback
+        auto legacy = legacy_get_info();
+        version = legacy.first;
+        flags = legacy.second;
+    }
+
+    auto cls = env->FindClass("com/rifsxd/ksunext/Natives$HomeState");
+    auto constructor = env->GetMethodID(cls, "<init>", "()V");
+    auto obj = env->NewObject(cls, constructor);
+
+    env->SetIntField(obj, env->GetFieldID(cls, "version", "I"), version);
+    env->SetBooleanField(obj, env->GetFieldID(cls, "isLkmMode", "Z"), (flags & 0x1) != 0);
+    env->SetBooleanField(obj, env->GetFieldID(cls, "isManager", "Z"),
+                         state.info.version > 0 ? (flags & 0x2) != 0 : version > 0);
+    env->SetBooleanField(obj, env->GetFieldID(cls, "isSafeMode", "Z"), state.safe_mode);
+    env->SetBooleanField(obj, env->GetFieldID(cls, "isSuEnabled", "Z"), state.su_enabled);
+    env->SetBooleanField(obj, env->GetFieldID(cls, "isKernelUmountEnabled", "Z"),
+                         state.kernel_umount_enabled);
+    env->SetBooleanField(obj, env->GetFieldID(cls, "isAvcSpoofEnabled", "Z"),
+                         state.avc_spoof_enabled);
+    env->SetObjectField(obj, env->GetFieldID(cls, "hookMode", "Ljava/lang/String;"),
+                        env->NewStringUTF(state.hook_mode));
+    env->SetObjectField(obj, env->GetFieldID(cls, "versionTag", "Ljava/lang/String;"),
+                        env->NewStringUTF(state.version_tag));
+    env->SetIntField(obj, env->GetFieldID(cls, "managerAppid", "I"), (jint) state.manager_appid);
+    env->SetIntField(obj, env->GetFieldID(cls, "superuserCount", "I"),
+                     (jint) state.superuser_count);
+
+    return obj;
+}
+
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_com_rifsxd_ksunext_Natives_getUmountList(JNIEnv *env, jobject) {
+    auto cls = env->FindClass("com/rifsxd/ksunext/Natives$UmountEntry");
+    auto constructor = env->GetMethodID(cls, "<init>", "(Ljava/lang/String;I)V");
+
+    auto snapshot = get_umount_list();
+    if (!snapshot) {
+        return env->NewObjectArray(0, cls, nullptr);
+    }
+
+    auto array = env->NewObjectArray((jsize) snapshot->count, cls, nullptr);
+    auto base = reinterpret_cast<const char *>(snapshot);
+    size_t off = sizeof(*snapshot);
+    for (uint32_t i = 0; i < snapshot->count; i++) {
+        auto record = reinterpret_cast<const ksu_umount_record *>(base + off);
+        auto path = env->NewStringUTF(reinterpret_cast<const char *>(record + 1));
+        auto entry = env->NewObject(cls, constructor, path, (jint) record->flags);
+        env->SetObjectArrayElement(array, (jsize) i, entry);
+        env->DeleteLocalRef(entry);
+        env->DeleteLocalRef(path);
+        off += sizeof(*record) + record->len;
+    }
+    free(snapshot);
+
+    return array;
+}
+
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_com_rifsxd_ksunext_Natives_getSuUsage(JNIEnv *env, jobject) {
+    auto cls = env->FindClass("com/rifsxd/ksunext/Natives$SuUsage");
+    auto constructor = env->GetMethodID(cls, "<init>", "(IIIIIIJ)V");
+
+    auto entries = static_cast<ksu_su_usage_entry *>(
+            calloc(KSU_SU_USAGE_MAX, sizeof(ksu_su_usage_entry)));
+    int count = entries ? get_su_usage(entries, KSU_SU_USAGE_MAX) : -1;
+    if (count < 0) {
+        free(entries);
+        return env->NewObjectArray(0, cls, nullptr);
+    }
+
+    auto array = env->NewObjectArray(count, cls, nullptr);
+    for (int i = 0; i < count; i++) {
+        const auto &e = entries[i];
+        auto usage = env->NewObject(cls, constructor, (jint) e.uid, (jint) e.faccessat,
+                                    (jint) e.stat, (jint) e.execve, (jint) e.ioctl,
+                                    (jint) e.denied, (jlong) e.last_ns);
+        env->SetObjectArrayElement(array, i, usage);
+        env->DeleteLocalRef(usage);
+    }
+    free(entries);
+
+    return array;
+}
+
 extern "C"
 JNIEXPORT jboolean JNICALL
 Java_com_rifsxd_ksunext_Natives_isSafeMode(JNIEnv *env, jclass clazz) {
@@ -15,6 +15,9 @@
 #include <unistd.h>
 #include <climits>
 #include <sys/syscall.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <cerrno>
 #include "ksu.h"
 
 static int fd = -1;
@@ -74,9 +77,84 @@ static int ksuctl(unsigned long op, Args &&... args) {
     return ioctl(fd, op, std::forward<Args>(args)...);
 }
 
+static std::atomic<const ksu_status_page *> status_map{nullptr};
+static std::atomic<bool> status_unsupported{false};
+
+static const ksu_status_page *map_status_page() {
+    auto page = status_map.load(std::memory_order_acquire);
+    if (page || status_unsupported.load(std::memory_order_relaxed)) {
+        return page;
+    }
+
+    if (fd < 0) {
+        fd = scan_driver_fd();
+    }
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    void *addr = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        // older kernel, stick to ioctls from now on
+        status_unsupported.store(true, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    const ksu_status_page *expected = nullptr;
+    if (!status_map.compare_exchange_strong(expected, static_cast<const ksu_status_page *>(addr))) {
+        // another thread mapped it first
+        munmap(addr, page_size);
+        return expected;
+    }
+    return static_cast<const ksu_status_page *>(addr);
+}
+
+bool get_status(struct ksu_status_page *out) {
+    auto page = map_status_page();
+    if (!page) {
+        return false;
+    }
+
+    // seqlock read side, the kernel holds seq odd while it writes
+    for (int tries = 0; tries < 64; tries++) {
+        uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        memcpy(out, page, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq) {
+            return out->magic == KSU_STATUS_MAGIC;
+        }
+    }
+    return false;
+}
+
+static const ksu_status_feature *find_status_feature(const ksu_status_page &st, uint32_t feature_id) {
+    for (uint32_t i = 0; i < st.feature_count && i < KSU_STATUS_FEATURE_MAX; i++) {
+        if (st.features[i].id == feature_id) {
+            return &st.features[i];
+        }
+    }
+    return nullptr;
+}
+
+static bool is_manager_appid(uint32_t appid) {
+    return appid == getuid() % 100000;
+}
+
 static struct ksu_get_info_cmd g_version {};
 
 struct ksu_get_info_cmd get_info() {
+    struct ksu_status_page st;
+    if (!g_version.version && get_status(&st)) {
+        g_version.version = st.version;
+        g_version.flags = st.flags;
+        if (is_manager_appid(st.manager_appid)) {
+            g_version.flags |= 0x2;
+        }
+    }
     if (!g_version.version) {
         ksuctl(KSU_IOCTL_GET_INFO, &g_version);
     }
@@ -93,6 +171,10 @@ bool get_allow_list(struct ksu_new_get_allow_list_cmd *cmd) {
 }
 
 bool is_safe_mode() {
+    struct ksu_status_page st;
+    if (get_status(&st)) {
+        return st.safe_mode;
+    }
     struct ksu_check_safemode_cmd cmd = {};
     ksuctl(KSU_IOCTL_CHECK_SAFEMODE, &cmd);
     return cmd.in_safe_mode;
@@ -134,44 +216,6 @@ int get_app_profile(app_profile *profile) {
     return ret;
 }
 
-bool set_su_enabled(bool enabled) {
-    struct ksu_set_feature_cmd cmd = {};
-    cmd.feature_id = KSU_FEATURE_SU_COMPAT;
-    cmd.value = enabled ? 1 : 0;
-    return ksuctl(KSU_IOCTL_SET_FEATURE, &cmd) == 0;
-}
-
-bool is_su_enabled() {
-    struct ksu_get_feature_cmd cmd = {};
-    cmd.feature_id = KSU_FEATURE_SU_COMPAT;
-    if (ksuctl(KSU_IOCTL_GET_FEATURE, &cmd) != 0) {
-        return false;
-    }
-    if (!cmd.supported) {
-        return false;
-    }
-    return cmd.value != 0;
-}
-
-bool set_avc_spoof_enabled(bool enabled) {
-    struct ksu_set_feature_cmd cmd = {};
-    cmd.feature_id = KSU_FEATURE_AVC_SPOOF;
-    cmd.value = enabled ? 1 : 0;
-    return ksuctl(KSU_IOCTL_SET_FEATURE, &cmd) == 0;
-}
-
-bool is_avc_spoof_enabled() {
-    struct ksu_get_feature_cmd cmd = {};
-    cmd.feature_id = KSU_FEATURE_AVC_SPOOF;
-    if (ksuctl(KSU_IOCTL_GET_FEATURE, &cmd) != 0) {
-        return false;
-    }
-    if (!cmd.supported) {
-        return false;
-    }
-    return cmd.value != 0;
-}
-
 static inline bool get_feature(uint32_t feature_id, uint64_t *out_value, bool *out_supported) {
     struct ksu_get_feature_cmd cmd = {};
     cmd.feature_id = feature_id;
@@ -190,14 +234,17 @@ static inline bool set_feature(uint32_t feature_id, uint64_t value) {
     return ksuctl(KSU_IOCTL_SET_FEATURE, &cmd) == 0;
 }
 
-bool set_kernel_umount_enabled(bool enabled) {
-    return set_feature(KSU_FEATURE_KERNEL_UMOUNT, enabled ? 1 : 0);
-}
+static bool is_feature_enabled(uint32_t feature_id) {
+    struct ksu_status_page st;
+    if (get_status(&st)) {
+        if (auto f = find_status_feature(st, feature_id)) {
+            return f->supported && f->value != 0;
+        }
+    }
 
-bool is_kernel_umount_enabled() {
     uint64_t value = 0;
     bool supported = false;
-    if (!get_feature(KSU_FEATURE_KERNEL_UMOUNT, &value, &supported)) {
+    if (!get_feature(feature_id, &value, &supported)) {
         return false;
     }
     if (!supported) {
@@ -206,9 +253,40 @@ bool is_kernel_umount_enabled() {
     return value != 0;
 }
 
+bool set_su_enabled(bool enabled) {
+    return set_feature(KSU_FEATURE_SU_COMPAT, enabled ? 1 : 0);
+}
+
+bool is_su_enabled() {
+    return is_feature_enabled(KSU_FEATURE_SU_COMPAT);
+}
+
+bool set_avc_spoof_enabled(bool enabled) {
+    return set_feature(KSU_FEATURE_AVC_SPOOF, enabled ? 1 : 0);
+}
+
+bool is_avc_spoof_enabled() {
+    return is_feature_enabled(KSU_FEATURE_AVC_SPOOF);
+}
+
+bool set_kernel_umount_enabled(bool enabled) {
+    return set_feature(KSU_FEATURE_KERNEL_UMOUNT, enabled ? 1 : 0);
+}
+
+bool is_kernel_umount_enabled() {
+    return is_feature_enabled(KSU_FEATURE_KERNEL_UMOUNT);
+}
+
 const char* get_hook_mode(void)
 {
     static struct ksu_get_hook_mode_cmd cmd = {0};
+    struct ksu_status_page st;
+
+    if (get_status(&st)) {
+        memcpy(cmd.mode, st.hook_mode, sizeof(cmd.mode));
+        cmd.mode[sizeof(cmd.mode) - 1] = '\0';
+        return cmd.mode;
+    }
 
     if (ksuctl(KSU_IOCTL_GET_HOOK_MODE, &cmd) == 0)
         return cmd.mode;
@@ -219,6 +297,10 @@ const char* get_hook_mode(void)
 uid_t get_manager_appid(void)
 {
     static struct ksu_get_manager_appid_cmd cmd = {0};
+    struct ksu_status_page st;
+
+    if (get_status(&st))
+        return st.manager_appid;
 
     if (ksuctl(KSU_IOCTL_GET_MANAGER_APPID, &cmd) == 0)
         return cmd.appid;
@@ -229,6 +311,13 @@ uid_t get_manager_appid(void)
 const char* get_version_tag(void)
 {
     static struct ksu_get_version_tag_cmd cmd = {0};
+    struct ksu_status_page st;
+
+    if (get_status(&st)) {
+        memcpy(cmd.tag, st.version_tag, sizeof(cmd.tag));
+        cmd.tag[sizeof(cmd.tag) - 1] = '\0';
+        return cmd.tag;
+    }
 
     if (ksuctl(KSU_IOCTL_GET_VERSION_TAG, &cmd) == 0)
         return cmd.tag;
@@ -240,6 +329,47 @@ bool is_zygisk_enabled() {
     return !!getenv("ZYGISK_ENABLED");
 }
 
+struct ksu_umount_snapshot *get_umount_list() {
+    uint32_t size = 4096;
+    // retry if the list grew between the size probe and the read
+    for (int attempt = 0; attempt < 4; attempt++) {
+        auto snapshot = static_cast<ksu_umount_snapshot *>(malloc(size));
+        if (!snapshot) {
+            return nullptr;
+        }
+
+        struct ksu_add_try_umount_cmd cmd = {
+            .arg = reinterpret_cast<uint64_t>(snapshot),
+            .flags = size,
+            .mode = KSU_UMOUNT_SNAPSHOT,
+        };
+        if (ksuctl(KSU_IOCTL_ADD_TRY_UMOUNT, &cmd) == 0) {
+            return snapshot;
+        }
+
+        bool retry = errno == ENOSPC && snapshot->total_len > size;
+        if (retry) {
+            size = snapshot->total_len;
+        }
+        free(snapshot);
+        if (!retry) {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+int get_su_usage(struct ksu_su_usage_entry *entries, uint32_t capacity) {
+    struct ksu_get_su_usage_cmd cmd = {
+        .entries = reinterpret_cast<uint64_t>(entries),
+        .count = capacity,
+    };
+    if (ksuctl(KSU_IOCTL_GET_SU_USAGE, &cmd) < 0) {
+        return -1;
+    }
+    return (int) cmd.count;
+}
+
 /* Ask kernel to SIGKILL all processes holding KSU fds, preparing for rmmod */
 bool prepare_unload() {
     return ksuctl(KSU_IOCTL_PREPARE_UNLOAD) == 0;
@@ -247,8 +377,98 @@ bool prepare_unload() {
 
 /* Close the cached driver fd so module refcount drops to allow rmmod */
 void close_driver_fd() {
+    // the mapping pins the file too
+    auto page = status_map.exchange(nullptr);
+    if (page) {
+        munmap(const_cast<ksu_status_page *>(page), sysconf(_SC_PAGESIZE));
+    }
     if (fd >= 0) {
         close(fd);
         fd = -1;
     }
 }
+
+bool ksu_batch(struct ksu_batch_entry *entries, uint32_t count) {
+    struct ksu_batch_cmd cmd = {};
+    cmd.count = count;
+    cmd.entries = reinterpret_cast<uint64_t>(entries);
+    return ksuctl(KSU_IOCTL_BATCH, &cmd) == 0;
+}
+
+static bool feature_enabled(const ksu_batch_entry &entry, const ksu_get_feature_cmd &cmd) {
+    return entry.result == 0 && cmd.supported && cmd.value != 0;
+}
+
+static bool feature_enabled(const ksu_status_page &st, uint32_t feature_id) {
+    auto f = find_status_feature(st, feature_id);
+    return f && f->supported && f->value != 0;
+}
+
+void get_home_state(struct ksu_home_state *state) {
+    *state = {};
+
+    struct ksu_status_page st;
+    if (get_status(&st)) {
+        state->info = get_info();
+        state->safe_mode = st.safe_mode;
+        state->su_enabled = feature_enabled(st, KSU_FEATURE_SU_COMPAT);
+        state->kernel_umount_enabled = feature_enabled(st, KSU_FEATURE_KERNEL_UMOUNT);
+        state->avc_spoof_enabled = feature_enabled(st, KSU_FEATURE_AVC_SPOOF);
+        memcpy(state->hook_mode, st.hook_mode, sizeof(state->hook_mode) - 1);
+        memcpy(state->version_tag, st.version_tag, sizeof(state->version_tag) - 1);
+        state->manager_appid = st.manager_appid;
+        state->superuser_count = st.allow_count;
+        return;
+    }
+
+    struct ksu_check_safemode_cmd safemode = {};
+    struct ksu_get_feature_cmd su = {.feature_id = KSU_FEATURE_SU_COMPAT};
+    struct ksu_get_feature_cmd umount = {.feature_id = KSU_FEATURE_KERNEL_UMOUNT};
+    struct ksu_get_feature_cmd avc = {.feature_id = KSU_FEATURE_AVC_SPOOF};
+    struct ksu_get_hook_mode_cmd hook_mode = {};
+    struct ksu_get_version_tag_cmd version_tag = {};
+    struct ksu_get_manager_appid_cmd appid = {};
+    struct ksu_new_get_allow_list_cmd allow_list = {.count = 0};
+
+    auto arg = [](auto *p) { return reinterpret_cast<uint64_t>(p); };
+    struct ksu_batch_entry entries[] = {
+        {KSU_IOCTL_GET_INFO, 0, arg(&state->info)},
+        {KSU_IOCTL_CHECK_SAFEMODE, 0, arg(&safemode)},
+        {KSU_IOCTL_GET_FEATURE, 0, arg(&su)},
+        {KSU_IOCTL_GET_FEATURE, 0, arg(&umount)},
+        {KSU_IOCTL_GET_FEATURE, 0, arg(&avc)},
+        {KSU_IOCTL_GET_HOOK_MODE, 0, arg(&hook_mode)},
+        {KSU_IOCTL_GET_VERSION_TAG, 0, arg(&version_tag)},
+        {KSU_IOCTL_GET_MANAGER_APPID, 0, arg(&appid)},
+        {KSU_IOCTL_NEW_GET_ALLOW_LIST, 0, arg(&allow_list)},
+    };
+    static_assert(sizeof(entries) / sizeof(entries[0]) <= KSU_BATCH_MAX);
+
+    if (!ksu_batch(entries, sizeof(entries) / sizeof(entries[0]))) {
+        // kernel without batch support, one ioctl per field
+        state->info = get_info();
+        state->safe_mode = is_safe_mode();
+        state->su_enabled = is_su_enabled();
+        state->kernel_umount_enabled = is_kernel_umount_enabled();
+        state->avc_spoof_enabled = is_avc_spoof_enabled();
+        strncpy(state->hook_mode, get_hook_mode(), sizeof(state->hook_mode) - 1);
+        strncpy(state->version_tag, get_version_tag(), sizeof(state->version_tag) - 1);
+        state->manager_appid = get_manager_appid();
+        state->superuser_count = get_allow_list(&allow_list) ? allow_list.total_count : 0;
+        return;
+    }
+
+    if (entries[0].result == 0) {
+        g_version = state->info;
+    }
+    state->safe_mode = entries[1].result == 0 && safemode.in_safe_mode;
+    state->su_enabled = feature_enabled(entries[2], su);
+    state->kernel_umount_enabled = feature_enabled(entries[3], umount);
+    state->avc_spoof_enabled = feature_enabled(entries[4], avc);
+    strncpy(state->hook_mode, entries[5].result == 0 ? hook_mode.mode : "Unknown",
+            sizeof(state->hook_mode) - 1);
+    strncpy(state->version_tag, entries[6].result == 0 ? version_tag.tag : "Unknown",
+            sizeof(state->version_tag) - 1);
+    state->manager_appid = entries[7].result == 0 ? appid.appid : 0;
+    state->superuser_count = entries[8].result == 0 ? allow_list.total_count : 0;
+}
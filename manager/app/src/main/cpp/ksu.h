@@ -193,6 +193,53 @@ bool prepare_unload();
 // Close the cached KSU driver fd
 void close_driver_fd();
 
+// Kernel umount list, see kernel/supercalls.h
+#define KSU_UMOUNT_SNAPSHOT 4
+
+struct ksu_add_try_umount_cmd {
+    uint64_t arg;   // Input: buffer pointer
+    uint32_t flags; // Input: buffer size
+    uint8_t mode;   // Input: KSU_UMOUNT_*
+};
+
+// followed by len bytes of path, records are packed back to back
+struct ksu_umount_record {
+    uint32_t flags;
+    uint32_t len;   // bytes in path, including the NUL
+};
+
+struct ksu_umount_snapshot {
+    uint32_t total_len; // bytes for the header and every record
+    uint32_t count;     // records following the header
+};
+
+// malloc'd snapshot of the umount list with its records, free() it; nullptr on failure
+struct ksu_umount_snapshot *get_umount_list();
+
+// Per-uid su counters, see kernel/supercalls.h
+#define KSU_SU_USAGE_MAX 512
+
+struct ksu_su_usage_entry {
+    uint32_t uid;
+    uint32_t faccessat;
+    uint32_t stat;
+    uint32_t execve;
+    uint32_t ioctl;     // root granted over the ioctl
+    uint32_t denied;    // root refused over the ioctl
+    uint64_t last_ns;   // CLOCK_BOOTTIME of the latest event
+};
+
+struct ksu_get_su_usage_cmd {
+    uint64_t entries;   // Input: struct ksu_su_usage_entry array
+    uint32_t count;     // Input: array capacity; Output: entries written
+    uint32_t total;     // Output: uids in the table
+    uint32_t dropped;   // Output: events the table had no room for
+    uint32_t flags;     // Input: 0, the manager never resets
+};
+
+// Fill up to capacity entries, newest first; returns how many, or -1 on failure
+int get_su_usage(struct ksu_su_usage_entry *entries, uint32_t capacity);
+
 // IOCTL command definitions
 #define KSU_IOCTL_GRANT_ROOT _IOC(_IOC_NONE, 'K', 1, 0)
 #define KSU_IOCTL_GET_INFO _IOC(_IOC_READ, 'K', 2, 0)
@@ -211,6 +258,73 @@ void close_driver_fd();
 #define KSU_IOCTL_GET_HOOK_MODE _IOC(_IOC_READ, 'K', 98, 0)
 #define KSU_IOCTL_GET_VERSION_TAG _IOC(_IOC_READ, 'K', 99, 0)
 #define KSU_IOCTL_PREPARE_UNLOAD _IOC(_IOC_NONE, 'K', 100, 0)
+#define KSU_IOCTL_ADD_TRY_UMOUNT _IOC(_IOC_WRITE, 'K', 18, 0)
+#define KSU_IOCTL_BATCH _IOC(_IOC_READ|_IOC_WRITE, 'K', 21, 0)
+#define KSU_IOCTL_GET_SU_USAGE _IOC(_IOC_READ|_IOC_WRITE, 'K', 24, 0)
+
+#define KSU_BATCH_MAX 16
+
+struct ksu_batch_entry {
+    uint32_t cmd;    // Input: any KSU_IOCTL_* except KSU_IOCTL_BATCH
+    int32_t result;  // Output: return value of that command
+    uint64_t arg;    // Input: argument pointer for that command
+};
+
+struct ksu_batch_cmd {
+    uint32_t count;    // Input: number of entries, at most KSU_BATCH_MAX
+    uint32_t reserved;
+    uint64_t entries;  // Input: pointer to struct ksu_batch_entry array
+};
+
+// Run up to KSU_BATCH_MAX commands in one syscall, per-entry results land in entries[i].result
+bool ksu_batch(struct ksu_batch_entry *entries, uint32_t count);
+
+// Everything the home screen shows, fetched with a single batch
+struct ksu_home_state {
+    struct ksu_get_info_cmd info;
+    bool safe_mode;
+    bool su_enabled;
+    bool kernel_umount_enabled;
+    bool avc_spoof_enabled;
+    char hook_mode[16];
+    char version_tag[32];
+    uint32_t manager_appid;
+    uint32_t superuser_count;
+};
+
+void get_home_state(struct ksu_home_state *state);
+
+// Read-only page mapped from the driver fd, see kernel/supercalls.h
+#define KSU_STATUS_MAGIC 0x5355534b
+#define KSU_STATUS_FEATURE_MAX 8
+
+struct ksu_status_feature {
+    uint32_t id;
+    uint32_t supported;
+    uint64_t value;
+};
+
+struct ksu_status_page {
+    uint32_t seq;           // odd while the kernel is updating
+    uint32_t magic;
+    uint32_t size;
+    uint32_t version;
+    uint32_t flags;         // bit 0: MODULE mode
+    uint32_t manager_appid;
+    uint32_t manager_gen;
+    uint32_t allow_count;
+    uint32_t deny_count;
+    uint8_t safe_mode;
+    uint8_t reserved[3];
+    char hook_mode[16];
+    char version_tag[32];
+    uint32_t feature_count;
+    uint32_t reserved2;
+    struct ksu_status_feature features[KSU_STATUS_FEATURE_MAX];
+};
+
+// Consistent copy of the status page without a syscall, false on kernels without it
+bool get_status(struct ksu_status_page *out);
 
 bool get_allow_list(struct ksu_new_get_allow_list_cmd *);
 
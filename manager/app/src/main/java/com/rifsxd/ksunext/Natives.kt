@@ -59,6 +59,8 @@ object Natives {
      * The return values are:
      * - "Manual": Manual hooks was enabled.
      * - "Kprobes": Kprobes hooks was enabled (CONFIG_KSU_KPROBES_HOOK).
+     * - "Fprobe": all active hooks are attached through fprobe (ftrace).
+     * - "Fprobe+Kprobes": fprobe where possible, kprobes for the rest.
      *
      * @return return hook mode, or null if unavailable.
      */
@@ -127,6 +129,21 @@ object Natives {
 
     external fun getSuperuserCount(): Int
 
+    /**
+     * Fetch everything the home screen shows in a single batched ioctl.
+     */
+    external fun getHomeState(): HomeState
+
+    /**
+     * Paths the kernel unmounts for apps with "Umount modules", read in one call.
+     */
+    external fun getUmountList(): Array<UmountEntry>
+
+    /**
+     * Su events per uid since boot, most recently active first.
+     */
+    external fun getSuUsage(): Array<SuUsage>
+
     private const val NON_ROOT_DEFAULT_PROFILE_KEY = "$"
     private const val NOBODY_UID = 9999
 
@@ -153,6 +170,45 @@ object Natives {
 
     val KSU_WORK_DIR = "/data/adb/ksu/"
 
+    @Immutable
+    @Keep
+    data class UmountEntry(
+        val path: String,
+        val flags: Int,
+    )
+
+    @Immutable
+    @Keep
+    data class SuUsage(
+        val uid: Int,
+        val faccessat: Int,
+        val stat: Int,
+        val execve: Int,
+        val ioctl: Int,
+        val denied: Int,
+        val lastNs: Long, // CLOCK_BOOTTIME, same base as SystemClock.elapsedRealtimeNanos()
+    ) {
+        // times the uid actually became root, through su or the manager ioctl
+        val grants: Int
+            get() = execve + ioctl
+    }
+
+    @Immutable
+    @Keep
+    data class HomeState(
+        val version: Int = -1,
+        val isLkmMode: Boolean = false,
+        val isManager: Boolean = false,
+        val isSafeMode: Boolean = false,
+        val isSuEnabled: Boolean = false,
+        val isKernelUmountEnabled: Boolean = false,
+        val isAvcSpoofEnabled: Boolean = false,
+        val hookMode: String? = null,
+        val versionTag: String? = null,
+        val managerAppid: Int = 0,
+        val superuserCount: Int = 0,
+    )
+
     @Immutable
     @Parcelize
     @Keep
@@ -85,10 +85,12 @@ fun HomeScreen(navigator: DestinationsNavigator) {
     val kernelVersion = getKernelVersion()
     val scrollBehavior = TopAppBarDefaults.pinnedScrollBehavior(rememberTopAppBarState())
 
-    val isManager = Natives.isManager
+    // one batched ioctl instead of a call per field
+    val homeState = remember { Natives.getHomeState() }
+    val isManager = homeState.isManager
     val fullFeatured = isManager && !Natives.requireNewKernel() && rootAvailable()
-    val ksuVersion = if (isManager) Natives.version else null
-    val ksuVersionTag = if (isManager) Natives.getVersionTag() else null
+    val ksuVersion = if (isManager) homeState.version else null
+    val ksuVersionTag = if (isManager) homeState.versionTag else null
 
     val context = LocalContext.current
     val prefs = context.getSharedPreferences("settings", Context.MODE_PRIVATE)
@@ -140,10 +142,16 @@ fun HomeScreen(navigator: DestinationsNavigator) {
             verticalArrangement = Arrangement.spacedBy(16.dp)
         ) {
             val lkmMode = ksuVersion?.let {
-                Natives.isLkmMode
+                homeState.isLkmMode
             }
 
-            StatusCard(kernelVersion, ksuVersion, lkmMode, ksuVersionTag = ksuVersionTag) {
+            StatusCard(
+                kernelVersion,
+                ksuVersion,
+                lkmMode,
+                ksuVersionTag = ksuVersionTag,
+                safeMode = homeState.isSafeMode
+            ) {
                 navigator.navigate(InstallScreenDestination)
             }
 
@@ -155,7 +163,7 @@ fun HomeScreen(navigator: DestinationsNavigator) {
                     horizontalArrangement = Arrangement.spacedBy(14.dp)
                 ) {
                     Box(modifier = Modifier.weight(1f)) {
-                        SuperuserCard(onClick = {
+                        SuperuserCard(count = homeState.superuserCount, onClick = {
                             navigator.navigate(SuperUserScreenDestination)
                         })
                     }
@@ -191,7 +199,7 @@ fun HomeScreen(navigator: DestinationsNavigator) {
                 UpdateCard()
             }
 
-            InfoCard(autoExpand = developerOptionsEnabled)
+            InfoCard(homeState, autoExpand = developerOptionsEnabled)
             IssueReportCard()
             Spacer(Modifier)
         }
@@ -199,8 +207,7 @@ fun HomeScreen(navigator: DestinationsNavigator) {
 }
 
 @Composable
-private fun SuperuserCard(onClick: (() -> Unit)? = null) {
-    val count = getSuperuserCount()
+private fun SuperuserCard(count: Int, onClick: (() -> Unit)? = null) {
     ElevatedCard(
         colors = CardDefaults.elevatedCardColors(
             containerColor = MaterialTheme.colorScheme.secondaryContainer
@@ -680,6 +687,7 @@ private fun StatusCard(
     lkmMode: Boolean?,
     moduleUpdateCount: Int = 0,
     ksuVersionTag: String? = null,
+    safeMode: Boolean = false,
     onClickInstall: () -> Unit = {}
 ) {
     val context = LocalContext.current
@@ -736,7 +744,7 @@ private fun StatusCard(
                                     horizontalArrangement = Arrangement.spacedBy(6.dp)
                                 ) {
                                     LabelItem(
-                                        icon = if (Natives.isSafeMode) {
+                                        icon = if (safeMode) {
                                             {
                                                 Icon(
                                                     tint = labelStyle.contentColor,
@@ -858,13 +866,13 @@ fun WarningCard(
 }
 
 @Composable
-private fun InfoCard(autoExpand: Boolean = false) {
+private fun InfoCard(homeState: Natives.HomeState, autoExpand: Boolean = false) {
     val context = LocalContext.current
 
     val prefs = context.getSharedPreferences("settings", Context.MODE_PRIVATE)
 
-    val isManager = Natives.isManager
-    val ksuVersion = if (isManager) Natives.version else null
+    val isManager = homeState.isManager
+    val ksuVersion = if (isManager) homeState.version else null
 
     var expanded by rememberSaveable { mutableStateOf(false) }
 
@@ -921,7 +929,7 @@ private fun InfoCard(autoExpand: Boolean = false) {
                     content = if (
                         developerOptionsEnabled
                     ) {
-                        "${managerVersion.first} (${managerVersion.second}) | UID: ${Natives.getManagerAppid()}"
+                        "${managerVersion.first} (${managerVersion.second}) | UID: ${homeState.managerAppid}"
                     } else {
                         "${managerVersion.first} (${managerVersion.second})"
                     },
@@ -931,7 +939,7 @@ private fun InfoCard(autoExpand: Boolean = false) {
                 if (ksuVersion != null) {
 
                     val hookMode =
-                        Natives.getHookMode()
+                        homeState.hookMode
                             .takeUnless { it.isNullOrBlank() }
                             ?: stringResource(R.string.unavailable)
 
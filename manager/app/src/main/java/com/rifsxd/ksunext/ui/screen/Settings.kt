@@ -232,6 +232,68 @@ fun SettingScreen(navigator: DestinationsNavigator) {
                                     isKernelUmountDisabled = !shouldEnable
                                 }
                             }
+
+                            var umountList by remember { mutableStateOf<List<Natives.UmountEntry>?>(null) }
+
+                            ListItem(
+                                modifier = Modifier
+                                    .fillMaxWidth()
+                                    .clip(RoundedCornerShape(8.dp))
+                                    .clickable {
+                                        scope.launch {
+                                            umountList = withContext(Dispatchers.IO) {
+                                                Natives.getUmountList().toList()
+                                            }
+                                        }
+                                    },
+                                colors = ListItemDefaults.colors(containerColor = Color.Transparent),
+                                leadingContent = {
+                                    Icon(Icons.Filled.FolderOff, null)
+                                },
+                                headlineContent = {
+                                    Text(
+                                        text = stringResource(R.string.settings_umount_list),
+                                        style = MaterialTheme.typography.titleMedium,
+                                        fontWeight = FontWeight.SemiBold
+                                    )
+                                },
+                                supportingContent = {
+                                    Text(stringResource(R.string.settings_umount_list_summary))
+                                }
+                            )
+
+                            umountList?.let { entries ->
+                                AlertDialog(
+                                    onDismissRequest = { umountList = null },
+                                    title = { Text(
+                                        text = stringResource(R.string.settings_umount_list),
+                                        style = MaterialTheme.typography.titleLarge,
+                                        fontWeight = FontWeight.SemiBold
+                                    ) },
+                                    text = {
+                                        if (entries.isEmpty()) {
+                                            Text(stringResource(R.string.settings_umount_list_empty))
+                                        } else {
+                                            Column(
+                                                modifier = Modifier.verticalScroll(rememberScrollState()),
+                                                verticalArrangement = Arrangement.spacedBy(4.dp)
+                                            ) {
+                                                entries.forEach { entry ->
+                                                    Text(
+                                                        text = if (entry.flags != 0) "${entry.path} (0x${entry.flags.toString(16)})" else entry.path,
+                                                        style = MaterialTheme.typography.bodyMedium
+                                                    )
+                                                }
+                                            }
+                                        }
+                                    },
+                                    confirmButton = {
+                                        TextButton(onClick = { umountList = null }) {
+                                            Text(stringResource(android.R.string.ok))
+                                        }
+                                    }
+                                )
+                            }
                         }
 
                         if (avcSpoofStatus == "supported") {
@@ -1,6 +1,8 @@
 package com.rifsxd.ksunext.ui.screen
 
 import android.content.Context
+import android.os.SystemClock
+import android.text.format.DateUtils
 import androidx.compose.foundation.background
 import androidx.compose.foundation.clickable
 import androidx.compose.foundation.layout.*
@@ -161,7 +163,7 @@ fun SuperUserScreen(navigator: DestinationsNavigator) {
                     viewModel.appList.filter { it.packageName != ksuApp.packageName },
                     key = { it.packageName + it.uid }
                 ) { app ->
-                    AppItem(app) {
+                    AppItem(app, viewModel.suUsage[app.uid]) {
                         navigator.navigate(AppProfileScreenDestination(app))
                     }
                 }
@@ -174,6 +176,7 @@ fun SuperUserScreen(navigator: DestinationsNavigator) {
 @Composable
 private fun AppItem(
     app: SuperUserViewModel.AppInfo,
+    usage: Natives.SuUsage?,
     onClickListener: () -> Unit,
 ) {
     val context = LocalContext.current
@@ -203,6 +206,20 @@ private fun AppItem(
                         style = MaterialTheme.typography.bodySmall
                     )
 
+                    if (usage != null && usage.grants > 0) {
+                        val ageMs = (SystemClock.elapsedRealtimeNanos() - usage.lastNs) / 1_000_000
+                        val lastUsed = DateUtils.getRelativeTimeSpanString(
+                            System.currentTimeMillis() - ageMs,
+                            System.currentTimeMillis(),
+                            DateUtils.MINUTE_IN_MILLIS
+                        )
+                        Text(
+                            text = stringResource(R.string.superuser_usage, usage.grants, lastUsed),
+                            style = MaterialTheme.typography.bodySmall,
+                            color = MaterialTheme.colorScheme.outline
+                        )
+                    }
+
                     Spacer(modifier = Modifier.height(4.dp))
 
                     FlowRow(
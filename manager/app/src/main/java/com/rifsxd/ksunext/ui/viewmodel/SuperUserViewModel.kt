@@ -82,6 +82,8 @@ class SuperUserViewModel : ViewModel() {
         private set
     var isRefreshing by mutableStateOf(false)
         private set
+    var suUsage by mutableStateOf<Map<Int, Natives.SuUsage>>(emptyMap())
+        private set
 
     fun updateShowSystemApps(newValue: Boolean) {
         showSystemApps = newValue
@@ -184,6 +186,7 @@ class SuperUserViewModel : ViewModel() {
                         profile = profile,
                     )
                 }
+                suUsage = Natives.getSuUsage().associateBy { it.uid }
                 Log.i(TAG, "load cost: ${SystemClock.elapsedRealtime() - start}")
             }
         }
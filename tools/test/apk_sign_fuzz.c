@@ -0,0 +1,295 @@
+/*
+ * Host build of kernel/apk_sign.c, the APK signature check that decides
+ * which app becomes the manager. The file is built unchanged; filp_open()
+ * and kernel_read() serve the input from memory.
+ *
+ *   apk_sign_fuzz --expect FILE...        pass-* must verify, fail-* must not,
+ *                                         and a failed read, allocation or
+ *                                         digest may only turn that into an
+ *                                         error, never into the other verdict
+ *   apk_sign_fuzz --mutate N FILE...      N mutations of each file, none of
+ *                                         which may crash or read out of bounds
+ *
+ * Built with -DKSU_LIBFUZZER it is a libFuzzer target instead.
+ */
+#include "ksu_host.h"
+
+#include "apk_sign.c"
+
+#define APK_PATH "/data/app/~~host==/com.rifsxd.ksunext-test==/base.apk"
+
+int LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+	ksu_host_put_file(APK_PATH, data, size);
+	is_manager_apk(APK_PATH);
+	return 0;
+}
+
+#ifndef KSU_LIBFUZZER
+
+#include <libgen.h>
+
+static u8 *read_file(const char *path, size_t *size)
+{
+	FILE *f = fopen(path, "rb");
+	u8 *data;
+	long len;
+
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	rewind(f);
+	data = malloc(len ?: 1);
+	if (fread(data, 1, len, f) != (size_t)len) {
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	*size = len;
+	return data;
+}
+
+// The file gets a buffer of exactly @size, so ASan sees any overread
+static int verify(const u8 *data, size_t size)
+{
+	ksu_host_put_file(APK_PATH, data, size);
+	return is_manager_apk(APK_PATH);
+}
+
+/*
+ * Run @data again with each fault the kernel can hit while checking it:
+ * failed allocations, short reads, a failed digest, a missing file. Each
+ * must give @want or an error. Returns how many didn't.
+ */
+static int expect_faults(const char *name, const u8 *data, size_t size,
+			 int want)
+{
+	int budget, got, failures = 0;
+
+	for (budget = 0; budget < 3; budget++) {
+		ksu_host_alloc_budget = budget;
+		got = verify(data, size);
+		ksu_host_alloc_budget = -1;
+		if (got != want && got >= 0) {
+			fprintf(stderr, "%s: %d allocations: verified %d, want %d or an error\n",
+				name, budget, got, want);
+			failures++;
+		}
+	}
+
+	ksu_host_read_max = 1000;
+	got = verify(data, size);
+	ksu_host_read_max = 0;
+	if (got != want && got >= 0) {
+		fprintf(stderr, "%s: short reads: verified %d, want %d or an error\n",
+			name, got, want);
+		failures++;
+	}
+
+	ksu_host_digest_err = -ENOMEM;
+	got = verify(data, size);
+	ksu_host_digest_err = 0;
+	if (got != want && got >= 0) {
+		fprintf(stderr, "%s: digest error: verified %d, want %d or an error\n",
+			name, got, want);
+		failures++;
+	}
+
+	if (is_manager_apk(APK_PATH "-missing") >= 0) {
+		fprintf(stderr, "%s: missing file gave a verdict\n", name);
+		failures++;
+	}
+	return failures;
+}
+
+static int expect(int argc, char **argv)
+{
+	int i, failures = 0;
+
+	for (i = 0; i < argc; i++) {
+		char *path = strdup(argv[i]);
+		const char *name = basename(path);
+		size_t size;
+		u8 *data = read_file(argv[i], &size);
+		int want, got;
+
+		if (!data) {
+			fprintf(stderr, "%s: can't read\n", argv[i]);
+			failures++;
+		} else if (strncmp(name, "pass-", 5) && strncmp(name, "fail-", 5)) {
+			verify(data, size); // no verdict to check, just parse it
+		} else {
+			want = !strncmp(name, "pass-", 5);
+			got = verify(data, size);
+			if (got != want) {
+				fprintf(stderr, "%s: verified %d, want %d\n",
+					argv[i], got, want);
+				failures++;
+			}
+			failures += expect_faults(argv[i], data, size, want);
+		}
+		free(data);
+		free(path);
+	}
+
+	printf("apk_sign_fuzz: %d files, %d failures\n", argc, failures);
+	return failures ? 1 : 0;
+}
+
+/*
+ * Where a seed keeps what the parser trusts: the EOCD, the central
+ * directory and the signing block. Found the simple way, good enough for
+ * seeds that are well formed to begin with.
+ */
+struct seed_regions {
+	size_t start[3], end[3];
+	int count;
+};
+
+static void find_regions(const u8 *data, size_t size, struct seed_regions *r)
+{
+	size_t eocd, cd;
+	u64 block;
+
+	r->count = 0;
+	if (size < 22)
+		return;
+	for (eocd = size - 22; eocd && get_unaligned_le32(data + eocd) != EOCD_MAGIC; eocd--)
+		;
+	if (get_unaligned_le32(data + eocd) != EOCD_MAGIC)
+		return;
+	r->start[r->count] = eocd, r->end[r->count++] = eocd + 22;
+
+	cd = get_unaligned_le32(data + eocd + 16);
+	if (cd >= eocd)
+		return;
+	r->start[r->count] = cd, r->end[r->count++] = eocd;
+
+	if (cd < 24)
+		return;
+	block = get_unaligned_le64(data + cd - 24);
+	if (block + 8 <= cd)
+		r->start[r->count] = cd - block - 8, r->end[r->count++] = cd;
+}
+
+static u32 rnd_state = 0x4b5355;
+
+static u32 rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+/*
+ * Mostly rewrite 16/32/64-bit words inside those regions, with boundary
+ * values or the old value nudged a little. Length and offset fields are
+ * what the parser trusts, and a nudged length is what walks a bounds
+ * check; random bit flips across the file rarely get there.
+ */
+static size_t mutate(u8 *data, size_t size, size_t max,
+		     const struct seed_regions *r)
+{
+	static const u64 values[] = { 0, 1, 3, 4, 7, 8, 12, 22, 24, 0x7f,
+				      0xffff, 0x10000, 0x7fffffff, 0xffffffff,
+				      0x100000000ull, ~0ull };
+	int rounds = 1 + rnd() % 4;
+
+	while (rounds--) {
+		size_t pos = size ? rnd() % size : 0;
+		int width = 1 << (1 + rnd() % 3), i;
+		u64 v = 0;
+
+		if (r->count && rnd() % 4) {
+			i = rnd() % r->count;
+			pos = r->start[i] + rnd() % (r->end[i] - r->start[i]);
+		}
+
+		switch (rnd() % 6) {
+		case 0: // flip a bit
+			if (pos < size)
+				data[pos] ^= 1 << rnd() % 8;
+			break;
+		case 1: // truncate
+			size = pos;
+			break;
+		case 2: // grow with junk
+			while (size < max && rnd() % 64)
+				data[size++] = rnd();
+			break;
+		case 3: // nudge a little-endian word
+			for (i = width - 1; i >= 0; i--)
+				v = v << 8 | (pos + i < size ? data[pos + i] : 0);
+			v += (s32)(rnd() % 129) - 64;
+			goto store;
+		default: // overwrite one with a boundary value
+			v = values[rnd() % 16];
+		store:
+			for (i = 0; i < width && pos + i < size; i++)
+				data[pos + i] = v >> (8 * i);
+			break;
+		}
+	}
+	return size;
+}
+
+static int mutate_files(int n, int argc, char **argv)
+{
+	unsigned long runs = 0, verified = 0, errors = 0;
+	int i, j;
+
+	for (i = 0; i < argc; i++) {
+		struct seed_regions regions;
+		size_t size, max;
+		u8 *seed = read_file(argv[i], &size), *data;
+
+		if (!seed) {
+			fprintf(stderr, "%s: can't read\n", argv[i]);
+			return 1;
+		}
+		find_regions(seed, size, &regions);
+		max = size + 4096;
+		data = malloc(max);
+
+		for (j = 0; j < n; j++) {
+			size_t len;
+			int got;
+
+			memcpy(data, seed, size);
+			len = mutate(data, size, max, &regions);
+			got = verify(data, len);
+			verified += got > 0;
+			errors += got < 0;
+			runs++;
+		}
+		free(data);
+		free(seed);
+	}
+
+	// a mutation that misses everything checked may well still verify
+	printf("apk_sign_fuzz: %lu mutations, %lu still verified\n",
+	       runs, verified);
+	// nothing failed to read, so every one of them deserved a verdict
+	if (errors) {
+		fprintf(stderr, "apk_sign_fuzz: %lu mutations gave an error\n",
+			errors);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "--expect"))
+		return expect(argc - 2, argv + 2);
+	if (argc > 2 && !strcmp(argv[1], "--mutate"))
+		return mutate_files(atoi(argv[2]), argc - 3, argv + 3);
+
+	fprintf(stderr, "usage: %s --expect FILE... | --mutate N FILE...\n",
+		argv[0]);
+	return 2;
+}
+
+#endif
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""
+Write the seed corpus for apk_sign_fuzz into corpus/apk.
+
+Each APK is a real zip with an APK Signing Block laid out the way apksigner
+writes one. The v2 signer's certificate is TEST_CERT, which the Makefile
+builds apk_sign.c to expect. The name says the verdict is_manager_apk()
+must reach: pass-* or fail-*.
+"""
+import hashlib
+import io
+import os
+import struct
+import zipfile
+
+TEST_CERT = b"KernelSU host test certificate, not a real X.509 blob.\n" * 6
+
+V2_ID = 0x7109871A
+V3_ID = 0xF05368C0
+V31_ID = 0x1B93AD61
+PADDING_ID = 0x42726577
+
+OUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "apk")
+
+
+def u16(v):
+    return struct.pack("<H", v)
+
+
+def u32(v):
+    return struct.pack("<I", v)
+
+
+def u64(v):
+    return struct.pack("<Q", v)
+
+
+def prefixed(b):
+    return u32(len(b)) + b
+
+
+def v2_block(cert):
+    digest = prefixed(u32(0x0103) + prefixed(b"\x11" * 32))
+    signed_data = (
+        prefixed(digest)  # digests
+        + prefixed(prefixed(cert))  # certificates
+        + prefixed(b"")  # additional attributes
+    )
+    signature = prefixed(u32(0x0103) + prefixed(b"\x22" * 256))
+    signer = prefixed(signed_data) + prefixed(signature) + prefixed(b"\x33" * 294)
+    return prefixed(prefixed(signer))
+
+
+def zip_bytes(names, comment=b""):
+    buf = io.BytesIO()
+    with zipfile.ZipFile(buf, "w", zipfile.ZIP_STORED) as z:
+        for name in names:
+            info = zipfile.ZipInfo(name, date_time=(2008, 1, 1, 0, 0, 0))
+            z.writestr(info, b"x" * (len(name) % 13))
+        z.comment = comment
+    return buf.getvalue()
+
+
+def apk(names=("AndroidManifest.xml", "classes.dex", "resources.arsc"),
+        pairs=None, comment=b"", first_len_delta=0, cd_size_delta=0):
+    """The deltas skew declared lengths to build inputs that lie about them."""
+    data = zip_bytes(names, comment)
+    eocd = len(data) - 22 - len(comment)
+    cd_offset = struct.unpack_from("<I", data, eocd + 16)[0]
+
+    if pairs is None:
+        pairs = [(V2_ID, v2_block(TEST_CERT))]
+    body = b"".join(
+        u64(len(v) + 4 + (first_len_delta if n == 0 else 0)) + u32(i) + v
+        for n, (i, v) in enumerate(pairs)
+    )
+    size = len(body) + 8 + 16
+    block = u64(size) + body + u64(size) + b"APK Sig Block 42"
+
+    out = bytearray(data[:cd_offset] + block + data[cd_offset:])
+    eocd += len(block)
+    struct.pack_into("<I", out, eocd + 16, cd_offset + len(block))
+    cd_size = struct.unpack_from("<I", out, eocd + 12)[0]
+    struct.pack_into("<I", out, eocd + 12, cd_size + cd_size_delta)
+    return bytes(out)
+
+
+def many(n, last=None):
+    names = ["AndroidManifest.xml"] + ["res/raw/f%05d.bin" % i for i in range(n)]
+    if last:
+        names.append(last)
+    return names
+
+
+def corpus():
+    v2 = (V2_ID, v2_block(TEST_CERT))
+    # declared v2 pair length ending 10 bytes into the certificate
+    cert_cut = v2[1].find(TEST_CERT) + len(TEST_CERT) - 10 - len(v2[1])
+    ok = apk()
+    eocd = ok.rfind(b"PK\x05\x06")
+    cd_offset = struct.unpack_from("<I", ok, eocd + 16)[0]
+    # the size field both ends of the signing block carry
+    block_size = struct.unpack_from("<Q", ok, cd_offset - 24)[0]
+    block_start = cd_offset - block_size - 8
+
+    # a fake EOCD inside the comment whose comment length doesn't fit
+    fake_eocd = b"PK\x05\x06" + b"\0" * 16 + u16(7)
+    seeds = {
+        "pass-v2": ok,
+        "pass-v2-padding": apk(pairs=[v2, (PADDING_ID, b"\0" * 3000)]),
+        "pass-v2-comment": apk(comment=b"c" * 1000),
+        "pass-v2-max-comment": apk(comment=b"m" * 0xFFFF),
+        "pass-v2-eocd-in-comment": apk(comment=fake_eocd + b"tail"),
+        "pass-v2-many-entries": apk(names=many(1000)),
+        "pass-v2-manifest-lookalike": apk(names=many(10, "META-INF/MANIFEST.MFX")),
+        "fail-v1": apk(names=["META-INF/MANIFEST.MF", "AndroidManifest.xml"]),
+        "fail-v1-last": apk(names=many(1000, "META-INF/MANIFEST.MF")),
+        # the central directory size in the EOCD ends inside that entry
+        "pass-v1-beyond-cd-size": apk(names=many(1000, "META-INF/MANIFEST.MF"),
+                                      cd_size_delta=-10),
+        "fail-cert-past-pair": apk(first_len_delta=cert_cut),
+        "fail-pair-past-block": apk(first_len_delta=100),
+        "fail-wrong-cert": apk(pairs=[(V2_ID, v2_block(TEST_CERT[::-1]))]),
+        "fail-cert-size": apk(pairs=[(V2_ID, v2_block(TEST_CERT + b"!"))]),
+        "fail-v3": apk(pairs=[v2, (V3_ID, b"\0" * 64)]),
+        "fail-v31": apk(pairs=[v2, (V31_ID, b"\0" * 64)]),
+        "fail-two-v2": apk(pairs=[v2, v2]),
+        "fail-no-v2": apk(pairs=[(PADDING_ID, b"\0" * 64)]),
+        "fail-unsigned": zip_bytes(["AndroidManifest.xml"]),
+        "fail-bad-magic": ok[: cd_offset - 16] + b"APK Sig Block 43" + ok[cd_offset:],
+        "fail-size-mismatch": ok[:block_start] + u64(block_size + 8) + ok[block_start + 8:],
+        "fail-truncated": ok[: len(ok) // 2],
+        "fail-empty": b"",
+        "fail-eocd-only": b"PK\x05\x06" + b"\0" * 18,
+    }
+    return seeds
+
+
+def main():
+    os.makedirs(OUT, exist_ok=True)
+    for name, data in corpus().items():
+        with open(os.path.join(OUT, name + ".apk"), "wb") as f:
+            f.write(data)
+    print("TEST_CERT_SIZE=%d" % len(TEST_CERT))
+    print("TEST_CERT_HASH=%s" % hashlib.sha256(TEST_CERT).hexdigest())
+
+
+if __name__ == "__main__":
+    main()
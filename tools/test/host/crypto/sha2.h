@@ -0,0 +1 @@
+#include "ksu_host.h"
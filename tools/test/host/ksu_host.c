@@ -0,0 +1,207 @@
+#include "ksu_host.h"
+
+bool ksu_host_verbose;
+long ksu_host_alloc_budget = -1;
+size_t ksu_host_read_max;
+unsigned long ksu_host_reads;
+
+void *ksu_host_alloc(size_t size, bool zero)
+{
+	if (ksu_host_alloc_budget == 0)
+		return NULL;
+	if (ksu_host_alloc_budget > 0)
+		ksu_host_alloc_budget--;
+
+	// malloc(0) may return NULL, the kernel hands out ZERO_SIZE_PTR
+	return zero ? calloc(1, size ?: 1) : malloc(size ?: 1);
+}
+
+// Same rules as the kernel's: optional '+', one trailing newline allowed
+int kstrtou32(const char *s, unsigned int base, u32 *res)
+{
+	u64 val = 0;
+	const char *p = s;
+
+	if (base != 10)
+		return -EINVAL;
+	if (*p == '+')
+		p++;
+	if (*p < '0' || *p > '9')
+		return -EINVAL;
+
+	for (; *p >= '0' && *p <= '9'; p++) {
+		val = val * 10 + (*p - '0');
+		if (val > UINT32_MAX)
+			return -ERANGE;
+	}
+	if (*p == '\n')
+		p++;
+	if (*p)
+		return -EINVAL;
+
+	*res = val;
+	return 0;
+}
+
+ssize_t kernel_read(struct file *file, void *buf, size_t count, loff_t *pos)
+{
+	size_t n;
+
+	ksu_host_reads++;
+	if (*pos < 0)
+		return -EINVAL;
+	if ((u64)*pos >= file->size)
+		return 0;
+
+	n = file->size - *pos;
+	if (n > count)
+		n = count;
+	if (ksu_host_read_max && n > ksu_host_read_max)
+		n = ksu_host_read_max;
+
+	memcpy(buf, file->data + *pos, n);
+	*pos += n;
+	return n;
+}
+
+char *bin2hex(char *dst, const void *src, size_t count)
+{
+	static const char hex[] = "0123456789abcdef";
+	const u8 *p = src;
+
+	while (count--) {
+		*dst++ = hex[*p >> 4];
+		*dst++ = hex[*p++ & 0xf];
+	}
+	return dst;
+}
+
+static const u32 sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR32(x, n) ((x) >> (n) | (x) << (32 - (n)))
+
+static void sha256_block(u32 *h, const u8 *p)
+{
+	u32 w[64], a, b, c, d, e, f, g, k, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = (u32)p[4 * i] << 24 | p[4 * i + 1] << 16 |
+		       p[4 * i + 2] << 8 | p[4 * i + 3];
+	for (; i < 64; i++)
+		w[i] = w[i - 16] + w[i - 7] +
+		       (ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ w[i - 15] >> 3) +
+		       (ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ w[i - 2] >> 10);
+
+	a = h[0], b = h[1], c = h[2], d = h[3];
+	e = h[4], f = h[5], g = h[6], k = h[7];
+	for (i = 0; i < 64; i++) {
+		t1 = k + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) +
+		     ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) +
+		     ((a & b) ^ (a & c) ^ (b & c));
+		k = g, g = f, f = e, e = d + t1;
+		d = c, c = b, b = a, a = t1 + t2;
+	}
+	h[0] += a, h[1] += b, h[2] += c, h[3] += d;
+	h[4] += e, h[5] += f, h[6] += g, h[7] += k;
+}
+
+void ksu_host_sha256(const u8 *data, size_t len, u8 *digest)
+{
+	u32 h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	u8 tail[128] = { 0 };
+	size_t rest = len % 64, tail_len = rest < 56 ? 64 : 128;
+	u64 bits = (u64)len * 8;
+	size_t i;
+
+	for (i = 0; i + 64 <= len; i += 64)
+		sha256_block(h, data + i);
+
+	memcpy(tail, data + i, rest);
+	tail[rest] = 0x80;
+	for (i = 0; i < 8; i++)
+		tail[tail_len - 1 - i] = bits >> (8 * i);
+	for (i = 0; i < tail_len; i += 64)
+		sha256_block(h, tail + i);
+
+	for (i = 0; i < 32; i++)
+		digest[i] = h[i / 4] >> (24 - 8 * (i % 4));
+}
+
+int ksu_host_digest_err;
+
+struct crypto_shash *crypto_alloc_shash(const char *name, u32 type, u32 mask)
+{
+	static struct crypto_shash sha256;
+
+	return strcmp(name, "sha256") ? ERR_PTR(-ENOENT) : &sha256;
+}
+
+struct host_file {
+	struct host_file *next;
+	char *path;
+	u8 *data;
+	size_t size;
+};
+
+static struct host_file *host_files;
+
+void ksu_host_put_file(const char *path, const void *data, size_t size)
+{
+	struct host_file *f;
+
+	for (f = host_files; f; f = f->next) {
+		if (!strcmp(f->path, path))
+			break;
+	}
+	if (!f) {
+		f = calloc(1, sizeof(*f));
+		f->path = strdup(path);
+		f->next = host_files;
+		host_files = f;
+	}
+
+	free(f->data);
+	f->data = malloc(size ?: 1);
+	memcpy(f->data, data, size);
+	f->size = size;
+}
+
+struct file *filp_open(const char *path, int flags, int mode)
+{
+	struct host_file *f;
+	struct file *fp;
+
+	for (f = host_files; f; f = f->next) {
+		if (!strcmp(f->path, path))
+			break;
+	}
+	if (!f)
+		return ERR_PTR(-ENOENT);
+
+	fp = calloc(1, sizeof(*fp));
+	fp->data = f->data;
+	fp->size = f->size;
+	fp->f_inode.i_size = f->size;
+	return fp;
+}
+
+int filp_close(struct file *file, void *id)
+{
+	free(file);
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * Just enough of the kernel API to build KernelSU's parsers on the host.
+ * Every <linux/...> and <crypto/...> header they include is a stub that
+ * includes this one. Files are served from memory and reads can be capped
+ * to force the short reads kernel_read() is allowed to return; allocations
+ * can be made to fail after a budget runs out. Single threaded: locks are
+ * no-ops.
+ */
+#ifndef __KSU_HOST_H
+#define __KSU_HOST_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+// loff_t comes from glibc's <sys/types.h>
+
+#define __user
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif
+
+#define PAGE_SIZE 4096UL
+#define SZ_4M 0x00400000
+#define SZ_8M 0x00800000
+
+#define GFP_KERNEL 0
+
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 12, 0)
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+
+#define min_t(type, a, b) ((type)(a) < (type)(b) ? (type)(a) : (type)(b))
+#define max_t(type, a, b) ((type)(a) > (type)(b) ? (type)(a) : (type)(b))
+
+extern bool ksu_host_verbose;
+
+#define printk_host(fmt, ...)                                                  \
+	do {                                                                   \
+		if (ksu_host_verbose)                                          \
+			fprintf(stderr, fmt, ##__VA_ARGS__);                   \
+	} while (0)
+#define pr_err(fmt, ...) printk_host(fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...) printk_host(fmt, ##__VA_ARGS__)
+#define pr_info(fmt, ...) printk_host(fmt, ##__VA_ARGS__)
+
+// Allocations left before they start failing, negative means unlimited
+extern long ksu_host_alloc_budget;
+
+void *ksu_host_alloc(size_t size, bool zero);
+
+static inline void *kmalloc(size_t size, int flags)
+{
+	return ksu_host_alloc(size, false);
+}
+
+static inline void *kzalloc(size_t size, int flags)
+{
+	return ksu_host_alloc(size, true);
+}
+
+static inline void *kvmalloc(size_t size, int flags)
+{
+	return ksu_host_alloc(size, false);
+}
+
+static inline void *kvmalloc_array(size_t n, size_t size, int flags)
+{
+	if (size && n > SIZE_MAX / size)
+		return NULL;
+	return ksu_host_alloc(n * size, false);
+}
+
+static inline void *kvcalloc(size_t n, size_t size, int flags)
+{
+	if (size && n > SIZE_MAX / size)
+		return NULL;
+	return ksu_host_alloc(n * size, true);
+}
+
+#define kfree free
+#define kvfree free
+
+static inline u32 roundup_pow_of_two(u32 n)
+{
+	u32 r = 1;
+
+	while (r < n)
+		r <<= 1;
+	return r;
+}
+
+// Any decent hash will do, only its distribution matters here
+static inline u32 full_name_hash(const void *salt, const char *name,
+				 unsigned int len)
+{
+	u32 h = 2166136261u;
+
+	while (len--)
+		h = (h ^ (u8)*name++) * 16777619u;
+	return h;
+}
+
+#define MAX_ERRNO 4095
+#define IS_ERR_VALUE(x) ((unsigned long)(void *)(x) >= (unsigned long)-MAX_ERRNO)
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return IS_ERR_VALUE(ptr);
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR_VALUE(ptr);
+}
+
+#define smp_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+#define DEFINE_MUTEX(name) int name
+#define mutex_lock(m) ((void)(m))
+#define mutex_unlock(m) ((void)(m))
+
+static inline u16 get_unaligned_le16(const void *p)
+{
+	const u8 *b = p;
+
+	return b[0] | b[1] << 8;
+}
+
+static inline u32 get_unaligned_le32(const void *p)
+{
+	const u8 *b = p;
+
+	return b[0] | b[1] << 8 | b[2] << 16 | (u32)b[3] << 24;
+}
+
+static inline u64 get_unaligned_le64(const void *p)
+{
+	return get_unaligned_le32(p) | (u64)get_unaligned_le32((const u8 *)p + 4) << 32;
+}
+
+char *bin2hex(char *dst, const void *src, size_t count);
+
+int kstrtou32(const char *s, unsigned int base, u32 *res);
+
+#define SHA256_DIGEST_SIZE 32
+
+void ksu_host_sha256(const u8 *data, size_t len, u8 *digest);
+// Error crypto_shash_digest() returns instead of hashing, 0 to hash
+extern int ksu_host_digest_err;
+
+struct crypto_shash {
+	int unused;
+};
+
+struct shash_desc {
+	struct crypto_shash *tfm;
+};
+
+struct crypto_shash *crypto_alloc_shash(const char *name, u32 type, u32 mask);
+
+static inline void crypto_free_shash(struct crypto_shash *tfm)
+{
+}
+
+#define SHASH_DESC_ON_STACK(desc, shash)                                       \
+	struct shash_desc __##desc##_desc = { 0 }, *desc = &__##desc##_desc
+
+static inline int crypto_shash_digest(struct shash_desc *desc, const u8 *data,
+				      unsigned int len, u8 *out)
+{
+	if (ksu_host_digest_err)
+		return ksu_host_digest_err;
+	ksu_host_sha256(data, len, out);
+	return 0;
+}
+
+static inline void shash_desc_zero(struct shash_desc *desc)
+{
+}
+
+typedef unsigned int fmode_t;
+#define FMODE_NONOTIFY 0x4000000
+
+struct inode {
+	loff_t i_size;
+};
+
+struct file {
+	const u8 *data;
+	size_t size;
+	struct inode f_inode;
+	fmode_t f_mode;
+};
+
+static inline struct inode *file_inode(struct file *f)
+{
+	return &f->f_inode;
+}
+
+static inline loff_t i_size_read(const struct inode *inode)
+{
+	return inode->i_size;
+}
+
+// Serve @data at @path to filp_open(), replacing what was there
+void ksu_host_put_file(const char *path, const void *data, size_t size);
+
+struct file *filp_open(const char *path, int flags, int mode);
+int filp_close(struct file *file, void *id);
+
+// Most bytes one kernel_read() returns, 0 means no cap
+extern size_t ksu_host_read_max;
+// kernel_read() calls so far
+extern unsigned long ksu_host_reads;
+
+ssize_t kernel_read(struct file *file, void *buf, size_t count, loff_t *pos);
+
+#endif
@@ -0,0 +1,442 @@
+/*
+ * Host test and benchmark for kernel/packages_list.c, the packages.list
+ * parser throne_tracker uses. The parser is built unchanged; kernel_read()
+ * serves an in-memory file and can be capped to return short reads, so
+ * lines that cross chunk boundaries get exercised at every offset.
+ *
+ *   packages_list_test            run the tests
+ *   packages_list_test --bench N  parse a synthetic 5000-package file N times
+ */
+#include <time.h>
+
+#include "ksu_host.h"
+#include "app_profile.h"
+
+#define KSU_INVALID_APPID -1 // manager.h, too much kernel behind it to include
+
+#include "packages_list.c"
+
+static int failures;
+
+#define CHECK(cond, ...)                                                       \
+	do {                                                                   \
+		if (!(cond)) {                                                 \
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);        \
+			fprintf(stderr, __VA_ARGS__);                          \
+			fputc('\n', stderr);                                   \
+			failures++;                                            \
+		}                                                              \
+	} while (0)
+
+struct text {
+	char *data;
+	size_t len, max;
+};
+
+static void text_add(struct text *t, const char *s, size_t len)
+{
+	if (t->len + len + 1 > t->max) {
+		t->max = (t->len + len + 1) * 2;
+		t->data = realloc(t->data, t->max);
+	}
+	memcpy(t->data + t->len, s, len);
+	t->len += len;
+	t->data[t->len] = '\0';
+}
+
+static void text_printf(struct text *t, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void text_printf(struct text *t, const char *fmt, ...)
+{
+	char buf[256];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	text_add(t, buf, n);
+}
+
+// A "<name> <uid>" line of exactly @len bytes, newline not counted
+static void text_long_line(struct text *t, size_t len, u32 uid)
+{
+	char tail[16];
+	int n = snprintf(tail, sizeof(tail), " %u", uid);
+	char *name = malloc(len);
+
+	memset(name, 'a', len - n);
+	memcpy(name + len - n, tail, n);
+	text_add(t, name, len);
+	free(name);
+}
+
+struct pkg {
+	u32 uid;
+	char name[KSU_MAX_PACKAGE_NAME];
+};
+
+struct pkgs {
+	struct pkg *v;
+	size_t count, max;
+};
+
+static void pkgs_add(struct pkgs *p, u32 uid, const char *name, size_t len)
+{
+	if (p->count == p->max) {
+		p->max = p->max ? p->max * 2 : 64;
+		p->v = realloc(p->v, p->max * sizeof(*p->v));
+	}
+	if (len > KSU_MAX_PACKAGE_NAME - 1)
+		len = KSU_MAX_PACKAGE_NAME - 1;
+	p->v[p->count].uid = uid;
+	memcpy(p->v[p->count].name, name, len);
+	p->v[p->count].name[len] = '\0';
+	p->count++;
+}
+
+/*
+ * What the parser should produce, worked out from the whole text at once:
+ * every line of "<name> <uid>[ ...]" with a non-empty name and a valid uid,
+ * except lines too long for the parser's page buffer.
+ */
+static void reference_parse(const char *data, size_t len, struct pkgs *out)
+{
+	size_t start = 0, i;
+
+	for (i = 0; i <= len; i++) {
+		const char *line = data + start, *sp, *uid_end;
+		size_t line_len = i - start;
+		char uid[32];
+		u32 val;
+
+		if (i < len && data[i] != '\n')
+			continue;
+		start = i + 1;
+		if (!line_len || line_len >= PAGE_SIZE - 1)
+			continue;
+
+		sp = memchr(line, ' ', line_len);
+		if (!sp || sp == line)
+			continue;
+		uid_end = memchr(sp + 1, ' ', line + line_len - (sp + 1));
+		if (!uid_end)
+			uid_end = line + line_len;
+		if (uid_end - (sp + 1) >= (long)sizeof(uid))
+			continue;
+		memcpy(uid, sp + 1, uid_end - (sp + 1));
+		uid[uid_end - (sp + 1)] = '\0';
+		if (kstrtou32(uid, 10, &val))
+			continue;
+
+		pkgs_add(out, val, line, sp - line);
+	}
+}
+
+// Parse @t the way track_throne() does, with reads capped at @read_max
+static int parse_text(const struct text *t, size_t read_max,
+		      struct package_map *map)
+{
+	struct file fp = { .data = (const u8 *)t->data, .size = t->len };
+	int parsed;
+
+	memset(map, 0, sizeof(*map));
+	map->manager_appid = KSU_INVALID_APPID;
+	ksu_host_read_max = read_max;
+	parsed = parse_packages_list(&fp, map);
+	ksu_host_read_max = 0;
+	if (parsed >= 0 && package_map_index(map))
+		parsed = -ENOMEM;
+	return parsed;
+}
+
+static void check_map(const struct package_map *map, int parsed,
+		      const struct pkgs *want, const char *what)
+{
+	u32 i;
+
+	CHECK(parsed == (int)want->count, "%s: parsed %d, want %zu", what,
+	      parsed, want->count);
+	CHECK(map->count == want->count, "%s: %u entries, want %zu", what,
+	      map->count, want->count);
+
+	for (i = 0; i < map->count && i < want->count; i++) {
+		const char *name = map->names + map->entries[i].name;
+
+		if (map->entries[i].uid != want->v[i].uid ||
+		    strcmp(name, want->v[i].name)) {
+			CHECK(0, "%s: entry %u is %s/%u, want %s/%u", what, i,
+			      name, map->entries[i].uid, want->v[i].name,
+			      want->v[i].uid);
+			return;
+		}
+	}
+}
+
+static const size_t read_caps[] = { 0, 1, 2, 3, 7, 64, 1000,
+				    PAGE_SIZE - 2, PAGE_SIZE - 1, PAGE_SIZE };
+
+// Parse @t under every read cap and compare with the reference
+static void check_text(const struct text *t, const char *what)
+{
+	struct pkgs want = { 0 };
+	size_t i;
+
+	reference_parse(t->data, t->len, &want);
+
+	for (i = 0; i < sizeof(read_caps) / sizeof(read_caps[0]); i++) {
+		struct package_map map;
+		char label[128];
+		int parsed = parse_text(t, read_caps[i], &map);
+
+		snprintf(label, sizeof(label), "%s, reads of %zu", what,
+			 read_caps[i]);
+		check_map(&map, parsed, &want, label);
+		package_map_free(&map);
+	}
+
+	free(want.v);
+}
+
+static void test_basic(void)
+{
+	struct text t = { 0 };
+	struct package_map map;
+	struct pkgs want = { 0 };
+
+	text_printf(&t, "com.android.shell 2000 0 /data/user/0/com.android.shell default:targetSdkVersion=34 none 0 34\n");
+	text_printf(&t, "\n");
+	text_printf(&t, "com.rifsxd.ksunext 10234 1 /data/user/0/com.rifsxd.ksunext\n");
+	text_printf(&t, "no.uid\n");
+	text_printf(&t, " 10001 leading space\n");
+	text_printf(&t, "bad.uid 12ab\n");
+	text_printf(&t, "too.big 4294967296\n");
+	text_printf(&t, "plus.sign +10007\n");
+	text_printf(&t, "org.last 10100");
+
+	pkgs_add(&want, 2000, "com.android.shell", 17);
+	pkgs_add(&want, 10234, "com.rifsxd.ksunext", 18);
+	pkgs_add(&want, 10007, "plus.sign", 9);
+	pkgs_add(&want, 10100, "org.last", 8);
+
+	check_map(&map, parse_text(&t, 0, &map), &want, "basic");
+	CHECK(package_map_find(&map, 10234, "com.rifsxd.ksunext"),
+	      "basic: manager not found");
+	CHECK(package_map_find(&map, KSU_INVALID_APPID, "org.last"),
+	      "basic: last line without newline lost");
+	CHECK(!package_map_find(&map, 10235, "com.rifsxd.ksunext"),
+	      "basic: found under the wrong appid");
+	CHECK(!package_map_find(&map, KSU_INVALID_APPID, "com.rifsxd"),
+	      "basic: prefix matched");
+	package_map_free(&map);
+
+	check_text(&t, "basic");
+	free(want.v);
+	free(t.data);
+}
+
+static void test_empty(void)
+{
+	struct text t = { 0 };
+
+	text_add(&t, "", 0);
+	check_text(&t, "empty file");
+	text_printf(&t, "\n\n\n");
+	check_text(&t, "only newlines");
+	free(t.data);
+}
+
+// Lines around the page buffer's limit, first, in the middle and last
+static void test_long_lines(void)
+{
+	static const size_t lens[] = { PAGE_SIZE - 3, PAGE_SIZE - 2,
+				       PAGE_SIZE - 1, PAGE_SIZE, PAGE_SIZE + 1,
+				       3 * PAGE_SIZE + 5 };
+	size_t i;
+
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		struct text t = { 0 };
+		char what[64];
+
+		text_long_line(&t, lens[i], 10001);
+		text_printf(&t, "\ncom.after.first 10002\n");
+		text_long_line(&t, lens[i], 10003);
+		text_printf(&t, "\ncom.after.middle 10004\n");
+		text_long_line(&t, lens[i], 10005);
+
+		snprintf(what, sizeof(what), "long lines of %zu", lens[i]);
+		check_text(&t, what);
+
+		// and once more ending in a newline
+		text_printf(&t, "\n");
+		check_text(&t, what);
+		free(t.data);
+	}
+}
+
+static u32 rnd_state = 0x4b5355;
+
+static u32 rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static void random_line(struct text *t)
+{
+	switch (rnd() % 10) {
+	case 0:
+		break; // empty
+	case 1:
+		text_long_line(t, PAGE_SIZE - 4 + rnd() % 8, 10000 + rnd() % 100);
+		break;
+	case 2:
+		text_long_line(t, 300 + rnd() % 9000, rnd());
+		break;
+	case 3:
+		text_printf(t, "pkg%u %ux", rnd() % 1000, rnd() % 100000);
+		break;
+	case 4:
+		text_printf(t, "pkg%u", rnd() % 1000);
+		break;
+	default:
+		text_printf(t, "com.example.app%u %u %u /data/user/0/com.example.app%u default:targetSdkVersion=%u 3003",
+			    rnd() % 10000, rnd() % 200000, rnd() % 2,
+			    rnd() % 10000, 28 + rnd() % 8);
+		break;
+	}
+}
+
+// Random mixes of every kind of line, compared under every read cap
+static void test_random(void)
+{
+	int round;
+
+	for (round = 0; round < 200; round++) {
+		struct text t = { 0 };
+		int lines = rnd() % 200, i;
+		char what[32];
+
+		text_add(&t, "", 0);
+		for (i = 0; i < lines; i++) {
+			random_line(&t);
+			if (i < lines - 1 || rnd() % 2)
+				text_add(&t, "\n", 1);
+		}
+
+		snprintf(what, sizeof(what), "random round %d", round);
+		check_text(&t, what);
+		free(t.data);
+	}
+}
+
+static void synthetic_list(struct text *t, int count)
+{
+	int i;
+
+	text_add(t, "", 0);
+	for (i = 0; i < count; i++)
+		text_printf(t, "com.example.vendor%04d.app %u 0 /data/user/0/com.example.vendor%04d.app default:privapp:targetSdkVersion=34 3003,9997 0 %u\n",
+			    i, 10000 + i, i, 34);
+}
+
+// Out of memory at every allocation the parse makes; ASan finds the leaks
+static void test_enomem(void)
+{
+	struct text t = { 0 };
+	struct pkgs want = { 0 };
+	long budget;
+
+	synthetic_list(&t, 300);
+	reference_parse(t.data, t.len, &want);
+
+	for (budget = 0;; budget++) {
+		struct package_map map;
+		int parsed;
+
+		ksu_host_alloc_budget = budget;
+		parsed = parse_text(&t, 0, &map);
+		ksu_host_alloc_budget = -1;
+
+		if (parsed != -ENOMEM) {
+			check_map(&map, parsed, &want, "enomem");
+			package_map_free(&map);
+			break;
+		}
+		package_map_free(&map);
+	}
+
+	free(want.v);
+	free(t.data);
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int bench(int iterations)
+{
+	struct text t = { 0 };
+	double start, parse_us = 0, find_us = 0;
+	unsigned long reads = 0;
+	char name[64];
+	int i, j, found = 0;
+
+	synthetic_list(&t, 5000);
+
+	for (i = 0; i < iterations; i++) {
+		struct package_map map;
+
+		ksu_host_reads = 0;
+		start = now_us();
+		if (parse_text(&t, 0, &map) != 5000) {
+			fprintf(stderr, "bench: parse failed\n");
+			return 1;
+		}
+		parse_us += now_us() - start;
+		reads += ksu_host_reads;
+
+		start = now_us();
+		for (j = 0; j < 5000; j++) {
+			snprintf(name, sizeof(name), "com.example.vendor%04d.app", j);
+			found += !!package_map_find(&map, 10000 + j, name);
+		}
+		find_us += now_us() - start;
+		package_map_free(&map);
+	}
+
+	printf("packages.list: 5000 packages, %zu bytes\n", t.len);
+	printf("parse + index: %.1f us, %lu kernel_read calls (one per byte before chunking: %zu)\n",
+	       parse_us / iterations, reads / iterations, t.len);
+	printf("lookup: %.1f ns per package, %d/%d found\n",
+	       find_us * 1e3 / iterations / 5000, found / iterations, 5000);
+
+	free(t.data);
+	return found == 5000 * iterations ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "--bench"))
+		return bench(argc > 2 ? atoi(argv[2]) : 200);
+
+	test_basic();
+	test_empty();
+	test_long_lines();
+	test_random();
+	test_enomem();
+
+	if (failures) {
+		fprintf(stderr, "packages_list_test: %d failures\n", failures);
+		return 1;
+	}
+	printf("packages_list_test: ok\n");
+	return 0;
+}
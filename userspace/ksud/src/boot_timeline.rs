@@ -0,0 +1,87 @@
+use anyhow::Result;
+use log::warn;
+use rustix::time::{ClockId, clock_gettime};
+use std::{fs::OpenOptions, io::Write};
+
+use crate::{defs, ksucalls, utils};
+
+/// Kernel milestones, indexed like `enum ksu_boot_mark` in kernel/boot_timeline.h
+const KERNEL_MARKS: [&str; 8] = [
+    "module-init",
+    "init-rc-hooked",
+    "first-zygote",
+    "post-fs-data",
+    "allowlist-loaded",
+    "module-mounted",
+    "boot-completed",
+    "manager-crowned",
+];
+
+fn boottime_ns() -> u64 {
+    let ts = clock_gettime(ClockId::Boottime);
+    ts.tv_sec as u64 * 1_000_000_000 + ts.tv_nsec as u64
+}
+
+/// Drop the previous boot's stamps, called once at the start of post-fs-data
+pub fn reset() {
+    let _ = std::fs::remove_file(defs::BOOT_TIMELINE_PATH);
+}
+
+/// Append a ksud stage stamp (CLOCK_BOOTTIME, same clock as the kernel marks)
+pub fn record(stage: &str) {
+    let now = boottime_ns();
+    let result = utils::ensure_dir_exists(defs::LOG_DIR).and_then(|()| {
+        let mut file = OpenOptions::new()
+            .create(true)
+            .append(true)
+            .open(defs::BOOT_TIMELINE_PATH)?;
+        writeln!(file, "{stage} {now}")?;
+        Ok(())
+    });
+    if let Err(e) = result {
+        warn!("record boot stage {stage} failed: {e}");
+    }
+}
+
+/// Print kernel milestones and ksud stages merged in boot order
+pub fn dump() -> Result<()> {
+    let mut events: Vec<(u64, String)> = Vec::new();
+
+    for (i, &ns) in ksucalls::get_boot_timeline()?.iter().enumerate() {
+        if ns == 0 {
+            continue;
+        }
+        let name = KERNEL_MARKS
+            .get(i)
+            .map_or_else(|| format!("kernel:mark{i}"), |n| format!("kernel:{n}"));
+        events.push((ns, name));
+    }
+
+    // stamps later than now were left over from a boot where post-fs-data didn't run
+    let now = boottime_ns();
+    if let Ok(content) = std::fs::read_to_string(defs::BOOT_TIMELINE_PATH) {
+        for line in content.lines() {
+            if let Some((stage, ns)) = line.split_once(' ')
+                && let Ok(ns) = ns.parse::<u64>()
+                && ns <= now
+            {
+                events.push((ns, format!("ksud:{stage}")));
+            }
+        }
+    }
+
+    events.sort_by_key(|e| e.0);
+
+    println!("{:>12} {:>12}  event", "boot(ms)", "delta(ms)");
+    let mut prev = None;
+    for (ns, name) in events {
+        let delta = prev.map_or(0, |p| ns - p);
+        println!(
+            "{:>12.3} {:>12.3}  {name}",
+            ns as f64 / 1e6,
+            delta as f64 / 1e6
+        );
+        prev = Some(ns);
+    }
+    Ok(())
+}
@@ -85,6 +85,27 @@ enum Commands {
         #[command(subcommand)]
         command: Kernel,
     },
+    /// Read the su log
+    Sulog {
+        #[command(subcommand)]
+        command: Sulog,
+    },
+}
+
+#[derive(clap::Subcommand, Debug)]
+enum Sulog {
+    /// Print su log events as they happen
+    Follow {
+        /// replay the events the kernel still holds first
+        #[arg(short, long)]
+        all: bool,
+    },
+    /// Print su event counts per uid
+    Usage {
+        /// clear the counters after reading them
+        #[arg(short, long)]
+        reset: bool,
+    },
 }
 
 #[derive(clap::Subcommand, Debug)]
@@ -145,6 +166,16 @@ enum Debug {
         #[command(subcommand)]
         command: MarkCommand,
     },
+
+    /// Show kernel milestones and ksud stages in boot order
+    BootTimeline,
+
+    /// Compare the per-call cost of kprobe and fprobe hooks
+    HookBench {
+        /// calls per backend, 0 for kernel default
+        #[arg(short, long, default_value = "0")]
+        iterations: u32,
+    },
 }
 
 #[derive(clap::Subcommand, Debug)]
@@ -396,6 +427,28 @@ enum UmountOp {
     },
     /// Wipe all entries from umount list
     Wipe,
+    /// Print the umount list, one "<path> <flags>" per line
+    List,
+    /// Replace the whole umount list at once, one "<path> [flags]" per line
+    Replace {
+        /// file to read the list from (default: stdin)
+        file: Option<PathBuf>,
+    },
+}
+
+fn parse_umount_list(text: &str) -> Vec<(String, u32)> {
+    text.lines()
+        .map(str::trim)
+        .filter(|line| !line.is_empty() && !line.starts_with('#'))
+        .map(|line| {
+            // a trailing number is the flags, anything else is part of the path
+            line.rsplit_once(char::is_whitespace)
+                .and_then(|(path, flags)| Some((path.trim_end(), flags.parse().ok()?)))
+                .map_or((line.to_string(), 0), |(path, flags)| {
+                    (path.to_string(), flags)
+                })
+        })
+        .collect()
 }
 
 pub fn run() -> Result<()> {
@@ -579,6 +632,8 @@ pub fn run() -> Result<()> {
                 MarkCommand::Unmark { pid } => debug::mark_unset(pid),
                 MarkCommand::Refresh => debug::mark_refresh(),
             },
+            Debug::BootTimeline => crate::boot_timeline::dump(),
+            Debug::HookBench { iterations } => debug::hook_bench(iterations),
         },
 
         Commands::BootPatch(boot_patch) => crate::boot_patch::patch(boot_patch),
@@ -630,12 +685,37 @@ pub fn run() -> Result<()> {
                 UmountOp::Add { mnt, flags } => ksucalls::umount_list_add(&mnt, flags),
                 UmountOp::Del { mnt } => ksucalls::umount_list_del(&mnt),
                 UmountOp::Wipe => ksucalls::umount_list_wipe().map_err(Into::into),
+                UmountOp::List => {
+                    for (path, flags) in ksucalls::umount_list_snapshot()? {
+                        println!("{path} {flags}");
+                    }
+                    Ok(())
+                }
+                UmountOp::Replace { file } => {
+                    let text = match file {
+                        Some(file) => std::fs::read_to_string(&file)
+                            .with_context(|| format!("Failed to read {}", file.display()))?,
+                        None => {
+                            use std::io::Read;
+                            let mut buffer = String::new();
+                            std::io::stdin()
+                                .read_to_string(&mut buffer)
+                                .context("Failed to read from stdin")?;
+                            buffer
+                        }
+                    };
+                    ksucalls::umount_list_replace(&parse_umount_list(&text))
+                }
             },
             Kernel::NotifyModuleMounted => {
                 ksucalls::report_module_mounted();
                 Ok(())
             }
         },
+        Commands::Sulog { command } => match command {
+            Sulog::Follow { all } => crate::sulog::follow(all),
+            Sulog::Usage { reset } => crate::sulog::usage(reset),
+        },
     };
 
     if let Err(e) = &result {
@@ -90,3 +90,29 @@ pub fn mark_refresh() -> Result<()> {
     println!("Refreshed mark for all running processes");
     Ok(())
 }
+
+/// Benchmark the hook backends supported by the running kernel
+pub fn hook_bench(iterations: u32) -> Result<()> {
+    let res = ksucalls::hook_benchmark(iterations)?;
+    let calls = u64::from(res.iterations.max(1));
+    let per_call = |ns: u64| {
+        if ns == 0 {
+            "unavailable".to_string()
+        } else {
+            format!(
+                "{} ns total, {} ns/call overhead",
+                ns,
+                ns.saturating_sub(res.baseline_ns) / calls
+            )
+        }
+    };
+    println!("Iterations: {}", res.iterations);
+    println!("Baseline: {} ns total", res.baseline_ns);
+    println!("Kprobe: {}", per_call(res.kprobe_ns));
+    println!("Fprobe: {}", per_call(res.fprobe_ns));
+    if res.fprobe_ns == 0 {
+        // FPROBE needs DYNAMIC_FTRACE_WITH_REGS before 6.14, which arm64 lacks
+        println!("  fprobe needs CONFIG_FPROBE on Linux 6.5+, on arm64 Linux 6.14+");
+    }
+    Ok(())
+}
@@ -6,6 +6,7 @@ mod android {
     pub const WORKING_DIR: &str = concatcp!(ADB_DIR, "ksu/");
     pub const BINARY_DIR: &str = concatcp!(WORKING_DIR, "bin/");
     pub const LOG_DIR: &str = concatcp!(WORKING_DIR, "log/");
+    pub const BOOT_TIMELINE_PATH: &str = concatcp!(LOG_DIR, "boot_timeline");
 
     pub const PROFILE_DIR: &str = concatcp!(WORKING_DIR, "profile/");
     pub const PROFILE_SELINUX_DIR: &str = concatcp!(PROFILE_DIR, "selinux/");
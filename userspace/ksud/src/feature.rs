@@ -158,9 +158,12 @@ pub fn save_binary_config(features: &HashMap<u32, u64>) -> Result<()> {
 pub fn apply_config(features: &HashMap<u32, u64>) {
     log::info!("Applying feature configuration to kernel...");
 
+    let features: Vec<(u32, u64)> = features.iter().map(|(&id, &value)| (id, value)).collect();
+    let results = crate::ksucalls::set_features(&features);
+
     let mut applied = 0;
-    for (&id, &value) in features {
-        match crate::ksucalls::set_feature(id, value) {
+    for (&(id, value), result) in features.iter().zip(results) {
+        match result {
             Ok(()) => {
                 if let Some(feature_id) = FeatureId::from_u32(id) {
                     log::info!("Set feature {} to {value}", feature_id.name());
@@ -293,9 +296,11 @@ pub fn list_features() {
         FeatureId::AvcSpoof,
     ];
 
-    for feature_id in &all_features {
+    let ids = all_features.map(|f| f as u32);
+    let states = crate::ksucalls::get_features(&ids);
+
+    for (feature_id, &(value, supported)) in all_features.iter().zip(&states) {
         let id = *feature_id as u32;
-        let (value, supported) = crate::ksucalls::get_feature(id).unwrap_or((0, false));
 
         let status = if !supported {
             "NOT_SUPPORTED".to_string()
@@ -348,20 +353,32 @@ pub fn load_config_and_apply() -> Result<()> {
 pub fn save_config() -> Result<()> {
     let mut features = HashMap::new();
 
-    let all_features = [
-        FeatureId::SuCompat,
-        FeatureId::KernelUmount,
-        FeatureId::EnhancedSecurity,
-        FeatureId::AvcSpoof,
-    ];
-
-    for feature_id in &all_features {
-        let id = *feature_id as u32;
-        if let Ok((value, supported)) = crate::ksucalls::get_feature(id)
-            && supported
-        {
+    if let Ok(all) = crate::ksucalls::get_all_features() {
+        for (id, value) in all {
             features.insert(id, value);
-            log::info!("Saved feature {} = {value}", feature_id.name());
+            match FeatureId::from_u32(id) {
+                Some(feature_id) => log::info!("Saved feature {} = {value}", feature_id.name()),
+                None => log::info!("Saved feature {id} = {value}"),
+            }
+        }
+    } else {
+        // kernel without GET_ALL_FEATURES, ask for the features we know about
+        let all_features = [
+            FeatureId::SuCompat,
+            FeatureId::KernelUmount,
+            FeatureId::EnhancedSecurity,
+            FeatureId::AvcSpoof,
+        ];
+
+        let ids = all_features.map(|f| f as u32);
+        let states = crate::ksucalls::get_features(&ids);
+
+        for (feature_id, &(value, supported)) in all_features.iter().zip(&states) {
+            let id = *feature_id as u32;
+            if supported {
+                features.insert(id, value);
+                log::info!("Saved feature {} = {value}", feature_id.name());
+            }
         }
     }
 
@@ -5,11 +5,13 @@ use std::path::Path;
 use crate::module::{handle_updated_modules, prune_modules};
 use crate::utils::is_safe_mode;
 use crate::{
-    assets, defs, ksucalls, metamodule, restorecon,
+    assets, boot_timeline, defs, ksucalls, metamodule, restorecon,
     utils::{self},
 };
 
 pub fn on_post_data_fs() -> Result<()> {
+    boot_timeline::reset();
+    boot_timeline::record("post-fs-data");
     ksucalls::report_post_fs_data();
 
     utils::umask(0);
@@ -100,11 +102,13 @@ pub fn on_post_data_fs() -> Result<()> {
     }
 
     // execute metamodule mount script
+    boot_timeline::record("metamount");
     if let Err(e) = metamodule::exec_mount_script(module_dir) {
         warn!("execute metamodule mount failed: {e}");
     }
 
     run_stage("post-mount", true);
+    boot_timeline::record("post-fs-data-done");
 
     std::env::set_current_dir("/").with_context(|| "failed to chdir to /")?;
 
@@ -141,10 +145,12 @@ fn run_stage(stage: &str, block: bool) {
 
 pub fn on_services() {
     info!("on_services triggered!");
+    boot_timeline::record("service");
     run_stage("service", false);
 }
 
 pub fn on_boot_completed() {
+    boot_timeline::record("boot-completed");
     ksucalls::report_boot_complete();
     info!("on_boot_completed triggered!");
 
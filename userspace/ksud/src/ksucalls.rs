@@ -1,8 +1,10 @@
 #![allow(clippy::unreadable_literal)]
 use libc::{_IO, _IOR, _IOW, _IOWR};
+use std::ffi;
 use std::fs;
 use std::os::fd::RawFd;
 use std::sync::OnceLock;
+use std::sync::atomic::{AtomicU32, Ordering, fence};
 
 // Event constants
 const EVENT_POST_FS_DATA: u32 = 1;
@@ -21,6 +23,13 @@ const KSU_IOCTL_GET_WRAPPER_FD: i32 = _IOW::<()>(K, 15);
 const KSU_IOCTL_MANAGE_MARK: i32 = _IOWR::<()>(K, 16);
 const KSU_IOCTL_NUKE_EXT4_SYSFS: i32 = _IOW::<()>(K, 17);
 const KSU_IOCTL_ADD_TRY_UMOUNT: i32 = _IOW::<()>(K, 18);
+const KSU_IOCTL_HOOK_BENCHMARK: i32 = _IOWR::<()>(K, 19);
+const KSU_IOCTL_GET_BOOT_TIMELINE: i32 = _IOR::<()>(K, 20);
+const KSU_IOCTL_BATCH: i32 = _IOWR::<()>(K, 21);
+const KSU_IOCTL_GET_ALL_FEATURES: i32 = _IOR::<()>(K, 22);
+const KSU_IOCTL_SULOG_OPEN: i32 = _IOW::<()>(K, 23);
+const KSU_IOCTL_GET_SU_USAGE: i32 = _IOWR::<()>(K, 24);
+const KSU_IOCTL_SET_SEPOLICY_BATCH: i32 = _IOWR::<()>(K, 25);
 
 #[repr(C)]
 #[derive(Clone, Copy, Default)]
@@ -41,6 +50,34 @@ pub struct SetSepolicyCmd {
     pub arg: u64,
 }
 
+/// One rule as the kernel reads it, what `SetSepolicyCmd::arg` points to.
+/// The strings are borrowed, see `From<&AtomicStatement>` in sepolicy.rs.
+#[derive(Debug)]
+#[repr(C)]
+pub struct FfiPolicy {
+    pub cmd: u32,
+    pub subcmd: u32,
+    pub sepol1: *const ffi::c_char,
+    pub sepol2: *const ffi::c_char,
+    pub sepol3: *const ffi::c_char,
+    pub sepol4: *const ffi::c_char,
+    pub sepol5: *const ffi::c_char,
+    pub sepol6: *const ffi::c_char,
+    pub sepol7: *const ffi::c_char,
+}
+
+/// Most rules a single `KSU_IOCTL_SET_SEPOLICY_BATCH` call accepts
+pub const KSU_SEPOLICY_BATCH_MAX: usize = 1024;
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct SetSepolicyBatchCmd {
+    count: u32,
+    failed: u32,
+    rules: u64,
+    results: u64,
+}
+
 #[repr(C)]
 #[derive(Clone, Copy, Default)]
 struct CheckSafemodeCmd {
@@ -91,6 +128,159 @@ struct AddTryUmountCmd {
     mode: u8,   // denotes what to do with it 0:wipe_list 1:add_to_list 2:delete_entry
 }
 
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct HookBenchmarkCmd {
+    pub iterations: u32,  // 0 lets the kernel pick
+    pub baseline_ns: u64, // unhooked loop
+    pub kprobe_ns: u64,   // 0 if kprobe could not attach
+    pub fprobe_ns: u64,   // 0 if fprobe is unavailable
+}
+
+const KSU_BOOT_TIMELINE_MAX: usize = 16;
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct GetBootTimelineCmd {
+    count: u32,
+    stamps_ns: [u64; KSU_BOOT_TIMELINE_MAX],
+}
+
+const KSU_FEATURE_LIST_MAX: usize = 16;
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct FeatureEntry {
+    id: u32,
+    reserved: u32,
+    value: u64,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct GetAllFeaturesCmd {
+    count: u32,
+    total: u32,
+    features: [FeatureEntry; KSU_FEATURE_LIST_MAX],
+}
+
+/// Most commands a single `KSU_IOCTL_BATCH` call accepts
+const KSU_BATCH_MAX: usize = 16;
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct BatchEntry {
+    cmd: u32,
+    result: i32, // 0 or -errno of this command
+    arg: u64,
+}
+
+impl BatchEntry {
+    fn new<T>(cmd: i32, arg: *mut T) -> Self {
+        Self {
+            cmd: cmd as u32,
+            result: 0,
+            arg: arg as u64,
+        }
+    }
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct BatchCmd {
+    count: u32,
+    reserved: u32,
+    entries: u64,
+}
+
+const KSU_STATUS_MAGIC: u32 = 0x5355534b;
+const KSU_STATUS_FEATURE_MAX: usize = 8;
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct StatusFeature {
+    id: u32,
+    supported: u32,
+    value: u64,
+}
+
+/// Mirror of the kernel's read-only status page, see kernel/supercalls.h
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct StatusPage {
+    seq: u32, // odd while the kernel is updating
+    magic: u32,
+    size: u32,
+    version: u32,
+    flags: u32,
+    manager_appid: u32,
+    manager_gen: u32,
+    allow_count: u32,
+    deny_count: u32,
+    safe_mode: u8,
+    reserved: [u8; 3],
+    hook_mode: [u8; 16],
+    version_tag: [u8; 32],
+    feature_count: u32,
+    reserved2: u32,
+    features: [StatusFeature; KSU_STATUS_FEATURE_MAX],
+}
+
+impl StatusPage {
+    fn feature(&self, id: u32) -> Option<&StatusFeature> {
+        let count = (self.feature_count as usize).min(KSU_STATUS_FEATURE_MAX);
+        self.features[..count].iter().find(|f| f.id == id)
+    }
+}
+
+/// One su log event, `struct ksu_sulog_record` in kernel/supercalls.h
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct SulogRecord {
+    pub seq: u64,
+    pub ts_ns: u64,
+    pub uid: u32,
+    pub pid: u32,
+    pub comm: [u8; 16],
+    pub kind: u8,
+    pub outcome: u8,
+    reserved: [u8; 6],
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct SulogOpenCmd {
+    flags: u32,
+}
+
+const KSU_SULOG_FROM_START: u32 = 1 << 0;
+
+const KSU_SU_USAGE_MAX: usize = 512;
+const KSU_SU_USAGE_RESET: u32 = 1 << 0;
+
+/// Per-uid su counters, `struct ksu_su_usage_entry` in kernel/supercalls.h
+#[repr(C)]
+#[derive(Clone, Copy, Default, Debug)]
+pub struct SuUsageEntry {
+    pub uid: u32,
+    pub faccessat: u32,
+    pub stat: u32,
+    pub execve: u32,
+    pub ioctl: u32,
+    pub denied: u32,
+    pub last_ns: u64,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct GetSuUsageCmd {
+    entries: u64,
+    count: u32,
+    total: u32,
+    dropped: u32,
+    flags: u32,
+}
+
 // Mark operation constants
 const KSU_MARK_GET: u32 = 1;
 const KSU_MARK_MARK: u32 = 2;
@@ -101,10 +291,16 @@ const KSU_MARK_REFRESH: u32 = 4;
 const KSU_UMOUNT_WIPE: u8 = 0;
 const KSU_UMOUNT_ADD: u8 = 1;
 const KSU_UMOUNT_DEL: u8 = 2;
+const KSU_UMOUNT_REPLACE: u8 = 3;
+const KSU_UMOUNT_SNAPSHOT: u8 = 4;
+const KSU_UMOUNT_PATH_MAX: usize = 256;
+const KSU_UMOUNT_REPLACE_MAX: usize = 256 * 1024;
 
 // Global driver fd cache
 static DRIVER_FD: OnceLock<RawFd> = OnceLock::new();
 static INFO_CACHE: OnceLock<GetInfoCmd> = OnceLock::new();
+// Address of the mapped status page, 0 if the kernel has none
+static STATUS_PAGE: OnceLock<usize> = OnceLock::new();
 
 const KSU_INSTALL_MAGIC1: u32 = 0xDEADBEEF;
 const KSU_INSTALL_MAGIC2: u32 = 0xCAFEBABE;
@@ -147,11 +343,15 @@ fn init_driver_fd() -> Option<RawFd> {
     }
 }
 
+fn driver_fd() -> RawFd {
+    *DRIVER_FD.get_or_init(|| init_driver_fd().unwrap_or(-1))
+}
+
 // ioctl wrapper using libc
 fn ksuctl<T>(request: i32, arg: *mut T) -> std::io::Result<i32> {
     use std::io;
 
-    let fd = *DRIVER_FD.get_or_init(|| init_driver_fd().unwrap_or(-1));
+    let fd = driver_fd();
     unsafe {
         let ret = libc::ioctl(fd as libc::c_int, request, arg);
         if ret < 0 {
@@ -162,9 +362,65 @@ fn ksuctl<T>(request: i32, arg: *mut T) -> std::io::Result<i32> {
     }
 }
 
+fn status_page() -> Option<*const StatusPage> {
+    let addr = *STATUS_PAGE.get_or_init(|| {
+        let fd = driver_fd();
+        if fd < 0 {
+            return 0;
+        }
+        let page_size = unsafe { libc::sysconf(libc::_SC_PAGESIZE) } as usize;
+        let addr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                page_size,
+                libc::PROT_READ,
+                libc::MAP_SHARED,
+                fd,
+                0,
+            )
+        };
+        if addr == libc::MAP_FAILED {
+            0
+        } else {
+            addr as usize
+        }
+    });
+    (addr != 0).then_some(addr as *const StatusPage)
+}
+
+/// Consistent copy of the kernel status page without a syscall,
+/// None on kernels that don't expose one
+fn read_status() -> Option<StatusPage> {
+    let page = status_page()?;
+    // SAFETY: the mapping lives for the rest of the process and seq is
+    // the first, naturally aligned field
+    let seq = unsafe { &*page.cast::<AtomicU32>() };
+
+    for _ in 0..64 {
+        let start = seq.load(Ordering::Acquire);
+        if start & 1 != 0 {
+            std::hint::spin_loop();
+            continue;
+        }
+        let snap = unsafe { std::ptr::read_volatile(page) };
+        fence(Ordering::Acquire);
+        if seq.load(Ordering::Relaxed) == start {
+            return (snap.magic == KSU_STATUS_MAGIC).then_some(snap);
+        }
+    }
+
+    None
+}
+
 // API implementations
 fn get_info() -> GetInfoCmd {
     *INFO_CACHE.get_or_init(|| {
+        if let Some(status) = read_status() {
+            return GetInfoCmd {
+                version: status.version,
+                flags: status.flags,
+            };
+        }
         let mut cmd = GetInfoCmd {
             version: 0,
             flags: 0,
@@ -212,9 +468,32 @@ pub fn set_sepolicy(cmd: &SetSepolicyCmd) -> std::io::Result<()> {
     Ok(())
 }
 
+/// Apply `rules` with one AVC reset. `results[i]` gets 0 or -errno of
+/// `rules[i]`; returns how many failed. Errors only if the batch itself was
+/// rejected, e.g. `ENOTTY` on kernels without batch support.
+pub fn set_sepolicy_batch(rules: &[FfiPolicy], results: &mut [i32]) -> std::io::Result<u32> {
+    if rules.is_empty() || rules.len() > KSU_SEPOLICY_BATCH_MAX || results.len() != rules.len() {
+        return Err(std::io::Error::from_raw_os_error(libc::EINVAL));
+    }
+    let mut cmd = SetSepolicyBatchCmd {
+        count: rules.len() as u32,
+        failed: 0,
+        rules: rules.as_ptr() as u64,
+        results: results.as_mut_ptr() as u64,
+    };
+    ksuctl(KSU_IOCTL_SET_SEPOLICY_BATCH, &raw mut cmd)?;
+    Ok(cmd.failed)
+}
+
 /// Get feature value and support status from kernel
 /// Returns (value, supported)
 pub fn get_feature(feature_id: u32) -> std::io::Result<(u64, bool)> {
+    if let Some(status) = read_status()
+        && let Some(f) = status.feature(feature_id)
+    {
+        return Ok((f.value, f.supported != 0));
+    }
+
     let mut cmd = GetFeatureCmd {
         feature_id,
         value: 0,
@@ -224,6 +503,88 @@ pub fn get_feature(feature_id: u32) -> std::io::Result<(u64, bool)> {
     Ok((cmd.value, cmd.supported != 0))
 }
 
+/// Run several commands in one round trip, per-command results land in
+/// `BatchEntry::result`. Errors only if the batch itself was rejected.
+fn batch(entries: &mut [BatchEntry]) -> std::io::Result<()> {
+    if entries.is_empty() || entries.len() > KSU_BATCH_MAX {
+        return Err(std::io::Error::from_raw_os_error(libc::EINVAL));
+    }
+    let mut cmd = BatchCmd {
+        count: entries.len() as u32,
+        reserved: 0,
+        entries: entries.as_mut_ptr() as u64,
+    };
+    ksuctl(KSU_IOCTL_BATCH, &raw mut cmd)?;
+    Ok(())
+}
+
+/// Query several features at once, falling back to one ioctl each on
+/// kernels without batch support. Unsupported or failed ids read as
+/// (0, false).
+pub fn get_features(feature_ids: &[u32]) -> Vec<(u64, bool)> {
+    if let Some(status) = read_status() {
+        let states: Option<Vec<_>> = feature_ids
+            .iter()
+            .map(|&id| status.feature(id).map(|f| (f.value, f.supported != 0)))
+            .collect();
+        if let Some(states) = states {
+            return states;
+        }
+    }
+
+    let mut cmds: Vec<GetFeatureCmd> = feature_ids
+        .iter()
+        .map(|&feature_id| GetFeatureCmd {
+            feature_id,
+            value: 0,
+            supported: 0,
+        })
+        .collect();
+
+    let mut batched = true;
+    for chunk in cmds.chunks_mut(KSU_BATCH_MAX) {
+        let mut entries: Vec<BatchEntry> = chunk
+            .iter_mut()
+            .map(|cmd| BatchEntry::new(KSU_IOCTL_GET_FEATURE, cmd as *mut GetFeatureCmd))
+            .collect();
+        if batch(&mut entries).is_err() {
+            batched = false;
+            break;
+        }
+        for (cmd, entry) in chunk.iter_mut().zip(&entries) {
+            if entry.result != 0 {
+                cmd.value = 0;
+                cmd.supported = 0;
+            }
+        }
+    }
+
+    if !batched {
+        return feature_ids
+            .iter()
+            .map(|&id| get_feature(id).unwrap_or((0, false)))
+            .collect();
+    }
+
+    cmds.iter()
+        .map(|cmd| (cmd.value, cmd.supported != 0))
+        .collect()
+}
+
+/// Every feature the kernel supports as (id, value), in one ioctl
+pub fn get_all_features() -> std::io::Result<Vec<(u32, u64)>> {
+    let mut cmd = GetAllFeaturesCmd::default();
+    ksuctl(KSU_IOCTL_GET_ALL_FEATURES, &raw mut cmd)?;
+    if cmd.total as usize > KSU_FEATURE_LIST_MAX {
+        log::warn!("kernel has {} features, only got {}", cmd.total, cmd.count);
+    }
+    let count = (cmd.count as usize).min(KSU_FEATURE_LIST_MAX);
+    Ok(cmd.features[..count]
+        .iter()
+        .map(|f| (f.id, f.value))
+        .collect())
+}
+
 /// Set feature value in kernel
 pub fn set_feature(feature_id: u32, value: u64) -> std::io::Result<()> {
     let mut cmd = SetFeatureCmd { feature_id, value };
@@ -231,6 +592,38 @@ pub fn set_feature(feature_id: u32, value: u64) -> std::io::Result<()> {
     Ok(())
 }
 
+/// Set several features with as few syscalls as possible, one result per
+/// input. Kernels without batch support get one ioctl per feature.
+pub fn set_features(features: &[(u32, u64)]) -> Vec<std::io::Result<()>> {
+    let mut cmds: Vec<SetFeatureCmd> = features
+        .iter()
+        .map(|&(feature_id, value)| SetFeatureCmd { feature_id, value })
+        .collect();
+    let mut results = Vec::with_capacity(cmds.len());
+
+    for chunk in cmds.chunks_mut(KSU_BATCH_MAX) {
+        let mut entries: Vec<BatchEntry> = chunk
+            .iter_mut()
+            .map(|cmd| BatchEntry::new(KSU_IOCTL_SET_FEATURE, cmd as *mut SetFeatureCmd))
+            .collect();
+        if batch(&mut entries).is_err() {
+            return features
+                .iter()
+                .map(|&(id, value)| set_feature(id, value))
+                .collect();
+        }
+        results.extend(entries.iter().map(|entry| {
+            if entry.result == 0 {
+                Ok(())
+            } else {
+                Err(std::io::Error::from_raw_os_error(-entry.result))
+            }
+        }));
+    }
+
+    results
+}
+
 pub fn get_wrapped_fd(fd: RawFd) -> std::io::Result<RawFd> {
     let mut cmd = GetWrapperFdCmd { fd, flags: 0 };
     let result = ksuctl(KSU_IOCTL_GET_WRAPPER_FD, &raw mut cmd)?;
@@ -324,3 +717,123 @@ pub fn umount_list_del(path: &str) -> anyhow::Result<()> {
     ksuctl(KSU_IOCTL_ADD_TRY_UMOUNT, &raw mut cmd)?;
     Ok(())
 }
+
+/// Replace the whole umount list with `entries` (path, flags) in one call.
+/// The kernel drops duplicate paths, keeping the first.
+pub fn umount_list_replace(entries: &[(String, u32)]) -> anyhow::Result<()> {
+    // packed ksu_umount_record stream: flags, len, then the path and its NUL
+    let mut buf = Vec::new();
+    for (path, flags) in entries {
+        let len = path.len() + 1;
+        anyhow::ensure!(
+            !path.is_empty() && !path.contains('\0') && len <= KSU_UMOUNT_PATH_MAX,
+            "invalid umount path: {path:?}"
+        );
+        buf.extend_from_slice(&flags.to_ne_bytes());
+        buf.extend_from_slice(&(len as u32).to_ne_bytes());
+        buf.extend_from_slice(path.as_bytes());
+        buf.push(0);
+    }
+    anyhow::ensure!(
+        buf.len() <= KSU_UMOUNT_REPLACE_MAX,
+        "umount list too large: {} bytes",
+        buf.len()
+    );
+
+    let mut cmd = AddTryUmountCmd {
+        arg: buf.as_ptr() as u64,
+        flags: buf.len() as u32,
+        mode: KSU_UMOUNT_REPLACE,
+    };
+    ksuctl(KSU_IOCTL_ADD_TRY_UMOUNT, &raw mut cmd)?;
+    Ok(())
+}
+
+/// Current umount list as (path, flags), read from a single list generation
+pub fn umount_list_snapshot() -> std::io::Result<Vec<(String, u32)>> {
+    // ksu_umount_snapshot header: total_len, count
+    const HEADER: usize = 8;
+    const RECORD: usize = 8;
+
+    let mut buf = vec![0u8; 4096];
+    // the list may grow between a too-small read and the retry
+    for _ in 0..4 {
+        let mut cmd = AddTryUmountCmd {
+            arg: buf.as_mut_ptr() as u64,
+            flags: buf.len() as u32,
+            mode: KSU_UMOUNT_SNAPSHOT,
+        };
+        match ksuctl(KSU_IOCTL_ADD_TRY_UMOUNT, &raw mut cmd) {
+            Ok(_) => {}
+            Err(e) if e.raw_os_error() == Some(libc::ENOSPC) => {
+                let total = u32::from_ne_bytes(buf[0..4].try_into().unwrap()) as usize;
+                buf.resize(total.max(buf.len() * 2), 0);
+                continue;
+            }
+            Err(e) => return Err(e),
+        }
+
+        let total = u32::from_ne_bytes(buf[0..4].try_into().unwrap()) as usize;
+        let count = u32::from_ne_bytes(buf[4..8].try_into().unwrap()) as usize;
+        let mut entries = Vec::with_capacity(count);
+        let mut off = HEADER;
+        while entries.len() < count && off + RECORD <= total.min(buf.len()) {
+            let flags = u32::from_ne_bytes(buf[off..off + 4].try_into().unwrap());
+            let len = u32::from_ne_bytes(buf[off + 4..off + 8].try_into().unwrap()) as usize;
+            let path = buf
+                .get(off + RECORD..off + RECORD + len)
+                .ok_or_else(|| std::io::Error::from_raw_os_error(libc::EPROTO))?;
+            let path = path.strip_suffix(&[0]).unwrap_or(path);
+            entries.push((String::from_utf8_lossy(path).into_owned(), flags));
+            off += RECORD + len;
+        }
+        return Ok(entries);
+    }
+
+    Err(std::io::Error::from_raw_os_error(libc::EAGAIN))
+}
+
+/// Open a read-only stream of su log records, replaying the ones the kernel
+/// still holds first when `from_start` is set
+pub fn sulog_open(from_start: bool) -> std::io::Result<std::os::fd::OwnedFd> {
+    use std::os::fd::FromRawFd;
+
+    let mut cmd = SulogOpenCmd {
+        flags: if from_start { KSU_SULOG_FROM_START } else { 0 },
+    };
+    let fd = ksuctl(KSU_IOCTL_SULOG_OPEN, &raw mut cmd)?;
+    Ok(unsafe { std::os::fd::OwnedFd::from_raw_fd(fd) })
+}
+
+/// Read the per-uid su usage table, newest first, with the number of events
+/// the kernel could not count; `reset` starts a new table in the same call
+pub fn su_usage(reset: bool) -> std::io::Result<(Vec<SuUsageEntry>, u32)> {
+    let mut entries = vec![SuUsageEntry::default(); KSU_SU_USAGE_MAX];
+    let mut cmd = GetSuUsageCmd {
+        entries: entries.as_mut_ptr() as u64,
+        count: KSU_SU_USAGE_MAX as u32,
+        flags: if reset { KSU_SU_USAGE_RESET } else { 0 },
+        ..Default::default()
+    };
+    ksuctl(KSU_IOCTL_GET_SU_USAGE, &raw mut cmd)?;
+    entries.truncate(cmd.count as usize);
+    Ok((entries, cmd.dropped))
+}
+
+/// Time calls to a probed function under each hook backend
+pub fn hook_benchmark(iterations: u32) -> std::io::Result<HookBenchmarkCmd> {
+    let mut cmd = HookBenchmarkCmd {
+        iterations,
+        ..Default::default()
+    };
+    ksuctl(KSU_IOCTL_HOOK_BENCHMARK, &raw mut cmd)?;
+    Ok(cmd)
+}
+
+/// Kernel milestone stamps in CLOCK_BOOTTIME ns, 0 for milestones not reached yet
+pub fn get_boot_timeline() -> std::io::Result<Vec<u64>> {
+    let mut cmd = GetBootTimelineCmd::default();
+    ksuctl(KSU_IOCTL_GET_BOOT_TIMELINE, &raw mut cmd)?;
+    let count = (cmd.count as usize).min(KSU_BOOT_TIMELINE_MAX);
+    Ok(cmd.stamps_ns[..count].to_vec())
+}
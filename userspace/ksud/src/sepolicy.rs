@@ -9,6 +9,8 @@ use nom::{
 };
 use std::{ffi, path::Path, vec};
 
+use crate::ksucalls::FfiPolicy;
+
 type SeObject<'a> = Vec<&'a str>;
 
 fn is_sepolicy_char(c: char) -> bool {
@@ -654,20 +656,6 @@ impl<'a> TryFrom<&'a PolicyStatement<'a>> for Vec<AtomicStatement> {
 ///  for C FFI to call kernel interface
 ///////////////////////////////////////////////////////////////
 
-#[derive(Debug)]
-#[repr(C)]
-struct FfiPolicy {
-    cmd: u32,
-    subcmd: u32,
-    sepol1: *const ffi::c_char,
-    sepol2: *const ffi::c_char,
-    sepol3: *const ffi::c_char,
-    sepol4: *const ffi::c_char,
-    sepol5: *const ffi::c_char,
-    sepol6: *const ffi::c_char,
-    sepol7: *const ffi::c_char,
-}
-
 const fn to_c_ptr(pol: &PolicyObject) -> *const ffi::c_char {
     match pol {
         PolicyObject::None | PolicyObject::All => std::ptr::null(),
@@ -675,8 +663,9 @@ const fn to_c_ptr(pol: &PolicyObject) -> *const ffi::c_char {
     }
 }
 
-impl From<AtomicStatement> for FfiPolicy {
-    fn from(policy: AtomicStatement) -> Self {
+// Borrows the statement, the pointers are only valid while it lives
+impl From<&AtomicStatement> for FfiPolicy {
+    fn from(policy: &AtomicStatement) -> Self {
         Self {
             cmd: policy.cmd,
             subcmd: policy.subcmd,
@@ -691,20 +680,46 @@ impl From<AtomicStatement> for FfiPolicy {
     }
 }
 
-fn apply_one_rule<'a>(statement: &'a PolicyStatement<'a>, strict: bool) -> Result<()> {
-    let policies: Vec<AtomicStatement> = statement.try_into()?;
+fn apply_one_rule(statement: &PolicyStatement, policy: &AtomicStatement) {
+    let ffi_policy = FfiPolicy::from(policy);
+    let cmd = crate::ksucalls::SetSepolicyCmd {
+        cmd: 0,
+        arg: &raw const ffi_policy as u64,
+    };
+    if let Err(e) = crate::ksucalls::set_sepolicy(&cmd) {
+        log::warn!("apply rule {statement:?} failed: {e}");
+    }
+}
 
-    for policy in policies {
-        let ffi_policy = FfiPolicy::from(policy);
-        let cmd = crate::ksucalls::SetSepolicyCmd {
-            cmd: 0,
-            arg: &raw const ffi_policy as u64,
-        };
-        if let Err(e) = crate::ksucalls::set_sepolicy(&cmd) {
-            log::warn!("apply rule {statement:?} failed: {e}");
-            if strict {
-                return Err(anyhow::anyhow!("apply rule {statement:?} failed: {e}"));
+/// Apply every statement, up to `KSU_SEPOLICY_BATCH_MAX` atomic rules per
+/// ioctl so the kernel resets the AVC once per batch instead of once per
+/// rule. Kernels without batch support get one ioctl per rule.
+fn apply_rules(statements: &[PolicyStatement]) -> Result<()> {
+    let mut policies: Vec<(usize, AtomicStatement)> = Vec::new();
+    for (i, statement) in statements.iter().enumerate() {
+        let atomics: Vec<AtomicStatement> = statement.try_into()?;
+        policies.extend(atomics.into_iter().map(|policy| (i, policy)));
+    }
+
+    for chunk in policies.chunks(crate::ksucalls::KSU_SEPOLICY_BATCH_MAX) {
+        let rules: Vec<FfiPolicy> = chunk.iter().map(|(_, policy)| policy.into()).collect();
+        let mut results = vec![0i32; rules.len()];
+        match crate::ksucalls::set_sepolicy_batch(&rules, &mut results) {
+            Ok(0) => {}
+            Ok(_) => {
+                for ((i, _), &err) in chunk.iter().zip(&results) {
+                    if err != 0 {
+                        let e = std::io::Error::from_raw_os_error(-err);
+                        log::warn!("apply rule {:?} failed: {e}", statements[*i]);
+                    }
+                }
+            }
+            Err(e) if e.raw_os_error() == Some(libc::ENOTTY) => {
+                for (i, policy) in chunk {
+                    apply_one_rule(&statements[*i], policy);
+                }
             }
+            Err(e) => bail!("apply sepolicy batch failed: {e}"),
         }
     }
 
@@ -713,11 +728,10 @@ fn apply_one_rule<'a>(statement: &'a PolicyStatement<'a>, strict: bool) -> Resul
 
 pub fn live_patch(policy: &str) -> Result<()> {
     let result = parse_sepolicy(policy.trim(), false)?;
-    for statement in result {
+    for statement in &result {
         println!("{statement:?}");
-        apply_one_rule(&statement, false)?;
     }
-    Ok(())
+    apply_rules(&result)
 }
 
 pub fn apply_file<P: AsRef<Path>>(path: P) -> Result<()> {
@@ -0,0 +1,92 @@
+use anyhow::{Context, Result};
+use std::{fs::File, io::Read};
+
+use crate::ksucalls::{self, SulogRecord};
+
+const RECORD_SIZE: usize = std::mem::size_of::<SulogRecord>();
+// the kernel hands out at most 64 records per read
+const BATCH: usize = 64;
+
+fn kind_name(kind: u8) -> &'static str {
+    match kind {
+        b'a' => "faccessat",
+        b's' => "stat",
+        b'x' => "execve",
+        b'i' => "ioctl",
+        _ => "unknown",
+    }
+}
+
+fn outcome_name(outcome: u8) -> &'static str {
+    match outcome {
+        1 => "redirected",
+        2 => "granted",
+        3 => "denied",
+        _ => "unknown",
+    }
+}
+
+fn print_record(rec: &SulogRecord) {
+    let comm_len = rec
+        .comm
+        .iter()
+        .position(|&c| c == 0)
+        .unwrap_or(rec.comm.len());
+    let comm = String::from_utf8_lossy(&rec.comm[..comm_len]);
+    println!(
+        "[{:>5}.{:06}] uid={} pid={} comm={} {} {}",
+        rec.ts_ns / 1_000_000_000,
+        rec.ts_ns % 1_000_000_000 / 1_000,
+        rec.uid,
+        rec.pid,
+        comm,
+        kind_name(rec.kind),
+        outcome_name(rec.outcome)
+    );
+}
+
+/// Stream su log events as they happen, `all` replays the retained backlog first
+pub fn follow(all: bool) -> Result<()> {
+    let mut file = File::from(ksucalls::sulog_open(all).context("Failed to open su log")?);
+    let mut buf = vec![0u8; RECORD_SIZE * BATCH];
+    let mut last_seq = 0u64;
+
+    loop {
+        // blocks until there is something new
+        let n = file.read(&mut buf).context("Failed to read su log")?;
+        for chunk in buf[..n].chunks_exact(RECORD_SIZE) {
+            let rec: SulogRecord = unsafe { std::ptr::read_unaligned(chunk.as_ptr().cast()) };
+            if last_seq != 0 && rec.seq > last_seq + 1 {
+                println!("... {} events lost", rec.seq - last_seq - 1);
+            }
+            last_seq = rec.seq;
+            print_record(&rec);
+        }
+    }
+}
+
+/// Print the kernel's per-uid su counters, most recently active first
+pub fn usage(reset: bool) -> Result<()> {
+    let (entries, dropped) = ksucalls::su_usage(reset).context("Failed to read su usage")?;
+    println!(
+        "{:>8} {:>9} {:>8} {:>8} {:>8} {:>8} {:>14}",
+        "uid", "faccessat", "stat", "execve", "ioctl", "denied", "last"
+    );
+    for e in &entries {
+        println!(
+            "{:>8} {:>9} {:>8} {:>8} {:>8} {:>8} {:>7}.{:06}",
+            e.uid,
+            e.faccessat,
+            e.stat,
+            e.execve,
+            e.ioctl,
+            e.denied,
+            e.last_ns / 1_000_000_000,
+            e.last_ns % 1_000_000_000 / 1_000
+        );
+    }
+    if dropped != 0 {
+        println!("{dropped} events not counted, the table was full");
+    }
+    Ok(())
+}